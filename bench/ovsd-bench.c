@@ -0,0 +1,576 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/* Scale test harness. Starts a private ubusd and an ovsd working against
+ * ovsd-stub, drives workloads through ubus and prints one JSON object per
+ * workload and method with throughput and latency percentiles, e.g.
+ *
+ *   {"workload":"boot","method":"create","calls":1000,"errors":0,
+ *    "seconds":0.84,"throughput":1190.5,"p50_us":410,"p99_us":2210,
+ *    "p999_us":3120,"max_us":3305}
+ *
+ * Latency is measured from sending a request to its completion, so it
+ * includes the time spent in the queues of ovsd.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <libubus.h>
+
+#define BENCH_STARTUP_MS 5000
+#define BENCH_NAME_MAXLEN 32
+
+// keeps the names of bridges and ports within IFNAMSIZ
+#define BENCH_BRIDGES_MAX 99999
+#define BENCH_PORTS_MAX 9999
+
+enum {
+	WL_BOOT,
+	WL_FLAP,
+	WL_RELOAD,
+	WL_POLL,
+	WL_TEARDOWN,
+	__WL_MAX
+};
+
+static const char * const workload_names[__WL_MAX] = {
+	[WL_BOOT] = "boot",
+	[WL_FLAP] = "flap",
+	[WL_RELOAD] = "reload",
+	[WL_POLL] = "poll",
+	[WL_TEARDOWN] = "teardown",
+};
+
+struct bench_call {
+	const char *method;
+	struct blob_attr *msg;
+};
+
+// samples of one method within a workload
+struct bench_stats {
+	const char *method;
+	uint32_t *lat_us;
+	unsigned int n;
+	unsigned int errors;
+};
+
+struct bench_slot {
+	struct ubus_request req;
+	struct bench_call *call;
+	uint64_t start_us;
+	bool busy;
+};
+
+static struct {
+	const char *ubusd;
+	const char *ovsd;
+	const char *stub;
+	unsigned int workloads;
+	int bridges;
+	int ports;
+	int rounds;
+	int concurrency;
+	int timeout_s;
+} opts = {
+	.ubusd = "ubusd",
+	.ovsd = "./ovsd",
+	.stub = "./ovsd-stub",
+	.workloads = (1 << __WL_MAX) - 1,
+	.bridges = 100,
+	.ports = 10,
+	.rounds = 3,
+	.concurrency = 16,
+	.timeout_s = 600,
+};
+
+static struct ubus_context *ctx;
+static uint32_t ovsd_id;
+static struct blob_buf b;
+
+static char tmpdir[] = "/tmp/ovsd-bench.XXXXXX";
+static char ubus_sock[64], db_sock[64], journal[64];
+static pid_t ubusd_pid, ovsd_pid;
+static int db_fd = -1;
+
+// the phase that is running
+static struct bench_call *calls;
+static unsigned int n_calls, next_call, in_flight;
+static struct bench_slot *slots;
+static struct bench_stats *stats;
+static int n_stats;
+
+static uint64_t
+_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void
+_watchdog_cb(struct uloop_timeout *t)
+{
+	fprintf(stderr, "ovsd-bench: timed out, %u requests pending\n",
+		in_flight);
+	exit(1);
+}
+
+static struct uloop_timeout watchdog = { .cb = _watchdog_cb };
+
+static struct bench_stats *
+_stats(const char *method)
+{
+	for (int i = 0; i < n_stats; i++)
+		if (!strcmp(stats[i].method, method))
+			return &stats[i];
+
+	stats = realloc(stats, (n_stats + 1) * sizeof(*stats));
+	if (!stats)
+		exit(1);
+
+	memset(&stats[n_stats], 0, sizeof(*stats));
+	stats[n_stats].method = method;
+	stats[n_stats].lat_us = calloc(n_calls, sizeof(uint32_t));
+	if (!stats[n_stats].lat_us)
+		exit(1);
+
+	return &stats[n_stats++];
+}
+
+static void _issue(void);
+
+static void
+_complete_cb(struct ubus_request *req, int ret)
+{
+	struct bench_slot *s = container_of(req, struct bench_slot, req);
+	struct bench_stats *st = _stats(s->call->method);
+
+	st->lat_us[st->n++] = _now_us() - s->start_us;
+	if (ret)
+		st->errors++;
+
+	s->busy = false;
+	in_flight--;
+	_issue();
+
+	if (!in_flight && next_call == n_calls)
+		uloop_end();
+}
+
+/* Keep up to concurrency requests in flight */
+static void
+_issue(void)
+{
+	struct bench_slot *s;
+
+	for (int i = 0; i < opts.concurrency && next_call < n_calls; i++) {
+		s = &slots[i];
+		if (s->busy)
+			continue;
+
+		memset(&s->req, 0, sizeof(s->req));
+		s->call = &calls[next_call++];
+		s->start_us = _now_us();
+		if (ubus_invoke_async(ctx, ovsd_id, s->call->method, s->call->msg,
+				&s->req)) {
+			_stats(s->call->method)->errors++;
+			continue;
+		}
+
+		s->req.complete_cb = _complete_cb;
+		s->busy = true;
+		in_flight++;
+		ubus_complete_request_async(ctx, &s->req);
+	}
+}
+
+static void
+_add_call(const char *method)
+{
+	calls = realloc(calls, (n_calls + 1) * sizeof(*calls));
+	if (!calls)
+		exit(1);
+
+	calls[n_calls].method = method;
+	calls[n_calls].msg = blob_memdup(b.head);
+	if (!calls[n_calls].msg)
+		exit(1);
+	n_calls++;
+}
+
+static void
+_bridge_name(char *buf, int br)
+{
+	snprintf(buf, BENCH_NAME_MAXLEN, "bench%d", br);
+}
+
+static void
+_port_name(char *buf, int br, int port)
+{
+	snprintf(buf, BENCH_NAME_MAXLEN, "bp%d_%d", br, port);
+}
+
+static void
+_add_bridge_calls(const char *method, const char *key)
+{
+	char name[BENCH_NAME_MAXLEN];
+
+	for (int i = 0; i < opts.bridges; i++) {
+		_bridge_name(name, i);
+		blob_buf_init(&b, 0);
+		blobmsg_add_string(&b, key, name);
+		_add_call(method);
+	}
+}
+
+static void
+_add_port_calls(const char *method)
+{
+	char name[BENCH_NAME_MAXLEN];
+
+	for (int i = 0; i < opts.bridges; i++) {
+		for (int p = 0; p < opts.ports; p++) {
+			blob_buf_init(&b, 0);
+			_bridge_name(name, i);
+			blobmsg_add_string(&b, "bridge", name);
+			_port_name(name, i, p);
+			blobmsg_add_string(&b, "member", name);
+			_add_call(method);
+		}
+	}
+}
+
+/* The requests of a workload, in the order they are sent */
+static void
+_build(int wl)
+{
+	switch (wl) {
+	case WL_BOOT:
+		_add_bridge_calls("create", "name");
+		_add_port_calls("add");
+		break;
+	case WL_FLAP:
+		for (int r = 0; r < opts.rounds; r++) {
+			_add_port_calls("remove");
+			_add_port_calls("add");
+		}
+		break;
+	case WL_RELOAD:
+		for (int r = 0; r < opts.rounds; r++)
+			_add_bridge_calls("reload", "name");
+		break;
+	case WL_POLL:
+		for (int r = 0; r < opts.rounds; r++) {
+			_add_bridge_calls("dump_info", "name");
+			blob_buf_init(&b, 0);
+			_add_call("dump_all");
+		}
+		break;
+	case WL_TEARDOWN:
+		_add_bridge_calls("free", "name");
+		break;
+	}
+}
+
+static int
+_cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t
+_percentile(struct bench_stats *st, unsigned int permille)
+{
+	unsigned int idx = (uint64_t) st->n * permille / 1000;
+
+	return st->lat_us[idx < st->n ? idx : st->n - 1];
+}
+
+static void
+_report(int wl, double seconds)
+{
+	struct bench_stats *st;
+
+	for (int i = 0; i < n_stats; i++) {
+		st = &stats[i];
+		if (!st->n)
+			continue;
+
+		qsort(st->lat_us, st->n, sizeof(*st->lat_us), _cmp_u32);
+		printf("{\"workload\":\"%s\",\"method\":\"%s\",\"calls\":%u,"
+			"\"errors\":%u,\"seconds\":%.3f,\"throughput\":%.1f,"
+			"\"p50_us\":%u,\"p99_us\":%u,\"p999_us\":%u,\"max_us\":%u}\n",
+			workload_names[wl], st->method, st->n, st->errors, seconds,
+			st->n / seconds, _percentile(st, 500), _percentile(st, 990),
+			_percentile(st, 999), st->lat_us[st->n - 1]);
+	}
+	fflush(stdout);
+}
+
+static void
+_run(int wl)
+{
+	uint64_t start;
+
+	_build(wl);
+
+	slots = calloc(opts.concurrency, sizeof(*slots));
+	if (!slots)
+		exit(1);
+
+	start = _now_us();
+	_issue();
+	if (in_flight)
+		uloop_run();
+	_report(wl, (_now_us() - start) / 1e6);
+
+	for (unsigned int i = 0; i < n_calls; i++)
+		free(calls[i].msg);
+	for (int i = 0; i < n_stats; i++)
+		free(stats[i].lat_us);
+	free(calls);
+	free(stats);
+	free(slots);
+	calls = NULL;
+	stats = NULL;
+	n_calls = next_call = 0;
+	n_stats = 0;
+}
+
+static pid_t
+_spawn(char * const *argv)
+{
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "ovsd-bench: cannot run %s: %s\n", argv[0],
+			strerror(errno));
+		_exit(127);
+	}
+
+	return pid;
+}
+
+/* ovsd probes the socket of the database when a call fails, a listening
+ * socket makes injected failures look like failed calls, not an outage.
+ */
+static int
+_listen_db(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	db_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (db_fd < 0)
+		return -1;
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", db_sock);
+	if (bind(db_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+			listen(db_fd, 128))
+		return -1;
+
+	return 0;
+}
+
+static int
+_start(void)
+{
+	char *ubusd_argv[] = { (char *) opts.ubusd, "-s", ubus_sock, NULL };
+	char *ovsd_argv[] = { (char *) opts.ovsd, "-S", "-l", "1",
+		"-s", ubus_sock, "-j", journal, "-i", "0", "-e", "0",
+		"-V", (char *) opts.stub, "-A", (char *) opts.stub,
+		"-D", db_sock, NULL };
+	uint64_t deadline;
+
+	if (!mkdtemp(tmpdir))
+		return -1;
+
+	snprintf(ubus_sock, sizeof(ubus_sock), "%s/ubus.sock", tmpdir);
+	snprintf(db_sock, sizeof(db_sock), "%s/db.sock", tmpdir);
+	snprintf(journal, sizeof(journal), "%s/journal", tmpdir);
+
+	if (_listen_db())
+		return -1;
+
+	ubusd_pid = _spawn(ubusd_argv);
+	deadline = _now_us() + BENCH_STARTUP_MS * 1000ULL;
+	while (!(ctx = ubus_connect(ubus_sock))) {
+		if (_now_us() > deadline)
+			return -1;
+		usleep(10000);
+	}
+
+	ovsd_pid = _spawn(ovsd_argv);
+	while (ubus_lookup_id(ctx, "ovs", &ovsd_id)) {
+		if (_now_us() > deadline)
+			return -1;
+		usleep(10000);
+	}
+
+	ubus_add_uloop(ctx);
+	return 0;
+}
+
+static void
+_stop(void)
+{
+	if (ovsd_pid > 0) {
+		kill(ovsd_pid, SIGTERM);
+		waitpid(ovsd_pid, NULL, 0);
+	}
+	if (ctx)
+		ubus_free(ctx);
+	if (ubusd_pid > 0) {
+		kill(ubusd_pid, SIGTERM);
+		waitpid(ubusd_pid, NULL, 0);
+	}
+	if (db_fd >= 0)
+		close(db_fd);
+
+	unlink(ubus_sock);
+	unlink(db_sock);
+	unlink(journal);
+	rmdir(tmpdir);
+}
+
+static int
+_parse_workloads(char *list)
+{
+	char *tok, *save;
+	int wl;
+
+	opts.workloads = 0;
+	for (tok = strtok_r(list, ",", &save); tok;
+			tok = strtok_r(NULL, ",", &save)) {
+		for (wl = 0; wl < __WL_MAX; wl++)
+			if (!strcmp(tok, workload_names[wl]))
+				break;
+		if (wl == __WL_MAX)
+			return -1;
+
+		opts.workloads |= 1 << wl;
+	}
+
+	return 0;
+}
+
+static int
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"Options:\n"
+		" -u <path>:		Path to ubusd (default: %s)\n"
+		" -d <path>:		Path to ovsd (default: %s)\n"
+		" -x <path>:		Path to ovsd-stub (default: %s)\n"
+		" -w <list>:		Workloads to run, out of boot, flap, reload,\n"
+		"			poll, teardown (default: all)\n"
+		" -n <count>:		Bridges (default: %d)\n"
+		" -p <count>:		Ports per bridge (default: %d)\n"
+		" -r <count>:		Rounds of flap, reload and poll (default: %d)\n"
+		" -c <count>:		Requests in flight (default: %d)\n"
+		" -L <us>:		Latency of a stub call\n"
+		" -J <us>:		Random extra latency of a stub call\n"
+		" -F <permille>:		Share of stub calls that fail\n"
+		" -T <s>:		Give up after this long (default: %d)\n"
+		"\n", progname, opts.ubusd, opts.ovsd, opts.stub, opts.bridges,
+		opts.ports, opts.rounds, opts.concurrency, opts.timeout_s);
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, ret = 0;
+
+	while ((ch = getopt(argc, argv, "u:d:x:w:n:p:r:c:L:J:F:T:")) != -1) {
+		switch (ch) {
+		case 'u':
+			opts.ubusd = optarg;
+			break;
+		case 'd':
+			opts.ovsd = optarg;
+			break;
+		case 'x':
+			opts.stub = optarg;
+			break;
+		case 'w':
+			if (_parse_workloads(optarg))
+				return usage(argv[0]);
+			break;
+		case 'n':
+			opts.bridges = atoi(optarg);
+			break;
+		case 'p':
+			opts.ports = atoi(optarg);
+			break;
+		case 'r':
+			opts.rounds = atoi(optarg);
+			break;
+		case 'c':
+			opts.concurrency = atoi(optarg);
+			break;
+		case 'L':
+			setenv("OVSD_STUB_LATENCY_US", optarg, 1);
+			break;
+		case 'J':
+			setenv("OVSD_STUB_JITTER_US", optarg, 1);
+			break;
+		case 'F':
+			setenv("OVSD_STUB_FAIL_PERMILLE", optarg, 1);
+			break;
+		case 'T':
+			opts.timeout_s = atoi(optarg);
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	if (opts.bridges <= 0 || opts.bridges > BENCH_BRIDGES_MAX ||
+			opts.ports < 0 || opts.ports > BENCH_PORTS_MAX || opts.rounds <= 0 ||
+			opts.concurrency <= 0 || opts.timeout_s <= 0)
+		return usage(argv[0]);
+
+	signal(SIGPIPE, SIG_IGN);
+	uloop_init();
+
+	if (_start()) {
+		fprintf(stderr, "ovsd-bench: could not start ubusd and ovsd\n");
+		ret = 1;
+		goto out;
+	}
+
+	uloop_timeout_set(&watchdog, opts.timeout_s * 1000);
+	for (int wl = 0; wl < __WL_MAX; wl++)
+		if (opts.workloads & (1 << wl))
+			_run(wl);
+
+out:
+	_stop();
+	uloop_done();
+	blob_buf_free(&b);
+	return ret;
+}
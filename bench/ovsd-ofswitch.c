@@ -0,0 +1,504 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/* Stand-in for the management socket of a bridge, to test the OpenFlow
+ * client of ovsd (openflow.c) without Open vSwitch. It speaks just enough
+ * OpenFlow 1.3/1.4 for that: hello, echo, bundles (built in or as the ONF
+ * extension), flow mods and table statistics. Flows are not kept, only
+ * counted per table, and every committed bundle is printed.
+ *
+ * ovsd looks up the management sockets next to its database socket, so with
+ * "ovsd -D /tmp/ovs/db.sock" the switch of bridge br0 is started as
+ *
+ *   ovsd-ofswitch /tmp/ovs/br0.mgmt
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#define OFP_VERSION_13 0x04
+#define OFP_VERSION_14 0x05
+#define OFP_HEADER_LEN 8
+#define OFP_MAXLEN 65535
+
+#define OFPT_HELLO 0
+#define OFPT_ERROR 1
+#define OFPT_ECHO_REQUEST 2
+#define OFPT_ECHO_REPLY 3
+#define OFPT_EXPERIMENTER 4
+#define OFPT_FLOW_MOD 14
+#define OFPT_MULTIPART_REQUEST 18
+#define OFPT_MULTIPART_REPLY 19
+#define OFPT_BUNDLE_CONTROL 33
+#define OFPT_BUNDLE_ADD_MESSAGE 34
+
+#define ONF_EXPERIMENTER_ID 0x4F4E4600
+#define ONFT_BUNDLE_CONTROL 2300
+#define ONFT_BUNDLE_ADD_MESSAGE 2301
+
+#define OFPBCT_OPEN_REQUEST 0
+#define OFPBCT_OPEN_REPLY 1
+#define OFPBCT_COMMIT_REQUEST 4
+#define OFPBCT_COMMIT_REPLY 5
+
+#define OFPET_BAD_REQUEST 1
+#define OFPBRC_BAD_TYPE 1
+#define OFPBRC_BAD_MULTIPART 2
+#define OFPET_FLOW_MOD_FAILED 5
+#define OFPET_BUNDLE_FAILED 17
+#define OFPBFC_EPERM 1
+#define OFPBFC_BAD_ID 2
+#define OFPBFC_BAD_TYPE 6
+#define OFPBFC_MSG_FAILED 13
+
+#define OFPFC_ADD 0
+#define OFPMP_TABLE_STATS 3
+#define OFPMPF_REPLY_MORE (1 << 0)
+#define OFP_TABLE_STATS_LEN 24
+#define OFPTT_MAX 255
+
+// table statistics per reply message, so that the client has to reassemble
+#define STATS_PER_REPLY 64
+
+// the first bytes of an offending request echoed in an error
+#define ERROR_DATA_LEN 64
+
+static const char *progname;
+static int max_version = OFP_VERSION_14;
+static int n_tables = OFPTT_MAX;
+static int fail_flow = -1;
+static int reject_open, stale_replies;
+
+static struct {
+	int fd;
+	uint8_t version;
+	uint32_t next_xid;
+
+	int open;
+	uint32_t bundle_id;
+	int n_msgs;
+	int failed;
+	uint32_t pending[OFPTT_MAX];
+} conn;
+
+static uint32_t active[OFPTT_MAX];
+
+static uint16_t
+_get_u16(const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohs(v);
+}
+
+static uint32_t
+_get_u32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static void
+_put_u16(uint8_t *p, uint16_t v)
+{
+	v = htons(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static void
+_put_u32(uint8_t *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static void
+_put_hdr(uint8_t *p, uint8_t type, uint16_t len, uint32_t xid)
+{
+	p[0] = conn.version;
+	p[1] = type;
+	_put_u16(p + 2, len);
+	_put_u32(p + 4, xid);
+}
+
+static int
+_send(const uint8_t *p, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(conn.fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int
+_recv(uint8_t *p)
+{
+	size_t len = OFP_HEADER_LEN, got = 0;
+	ssize_t n;
+
+	while (got < len) {
+		n = read(conn.fd, p + got, len - got);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		got += n;
+		if (got == OFP_HEADER_LEN) {
+			len = _get_u16(p + 2);
+			if (len < OFP_HEADER_LEN)
+				return -1;
+		}
+	}
+
+	return len;
+}
+
+static int
+_send_error(const uint8_t *req, int len, uint16_t type, uint16_t code)
+{
+	uint8_t msg[OFP_HEADER_LEN + 4 + ERROR_DATA_LEN];
+
+	if (len > ERROR_DATA_LEN)
+		len = ERROR_DATA_LEN;
+
+	_put_hdr(msg, OFPT_ERROR, OFP_HEADER_LEN + 4 + len, _get_u32(req + 4));
+	_put_u16(msg + 8, type);
+	_put_u16(msg + 10, code);
+	memcpy(msg + 12, req, len);
+	return _send(msg, OFP_HEADER_LEN + 4 + len);
+}
+
+/* An error for a request that was never sent, as left behind by an earlier
+ * exchange on the connection. Clients have to skip it.
+ */
+static int
+_send_stale(void)
+{
+	uint8_t msg[OFP_HEADER_LEN + 4];
+
+	_put_hdr(msg, OFPT_ERROR, sizeof(msg), conn.next_xid - 0x10000);
+	_put_u16(msg + 8, OFPET_BAD_REQUEST);
+	_put_u16(msg + 10, OFPBRC_BAD_TYPE);
+	return _send(msg, sizeof(msg));
+}
+
+static int
+_hello(void)
+{
+	uint8_t msg[16];
+	uint32_t bitmap = (1 << OFP_VERSION_13);
+
+	if (max_version >= OFP_VERSION_14)
+		bitmap |= (1 << OFP_VERSION_14);
+
+	conn.version = max_version;
+	_put_hdr(msg, OFPT_HELLO, sizeof(msg), 0);
+	_put_u16(msg + 8, 1);	// OFPHET_VERSIONBITMAP
+	_put_u16(msg + 10, 8);
+	_put_u32(msg + 12, bitmap);
+	return _send(msg, sizeof(msg));
+}
+
+static void
+_flow_mod(const uint8_t *msg, int len, uint32_t *count)
+{
+	if (len < 26 || msg[1] != OFPT_FLOW_MOD)
+		return;
+
+	// table_id and command follow cookie and cookie mask
+	if (msg[25] == OFPFC_ADD && msg[24] < OFPTT_MAX)
+		count[msg[24]]++;
+}
+
+static int
+_bundle_ctrl(uint8_t *msg, int len, int off)
+{
+	uint32_t bundle_id;
+	uint16_t type;
+	int i, n;
+
+	if (len < off + 8)
+		return _send_error(msg, len, OFPET_BAD_REQUEST, OFPBRC_BAD_TYPE);
+
+	bundle_id = _get_u32(msg + off);
+	type = _get_u16(msg + off + 4);
+
+	switch (type) {
+	case OFPBCT_OPEN_REQUEST:
+		if (reject_open || conn.open)
+			return _send_error(msg, len, OFPET_BUNDLE_FAILED, OFPBFC_EPERM);
+
+		memset(conn.pending, 0, sizeof(conn.pending));
+		conn.open = 1;
+		conn.bundle_id = bundle_id;
+		conn.n_msgs = 0;
+		conn.failed = 0;
+		_put_u16(msg + off + 4, OFPBCT_OPEN_REPLY);
+		return _send(msg, len);
+
+	case OFPBCT_COMMIT_REQUEST:
+		if (!conn.open || bundle_id != conn.bundle_id)
+			return _send_error(msg, len, OFPET_BUNDLE_FAILED, OFPBFC_BAD_ID);
+
+		conn.open = 0;
+		if (conn.failed) {
+			printf("bundle %u: discarded\n", bundle_id);
+			return _send_error(msg, len, OFPET_BUNDLE_FAILED,
+				OFPBFC_MSG_FAILED);
+		}
+
+		for (i = 0, n = 0; i < OFPTT_MAX; i++) {
+			active[i] += conn.pending[i];
+			n += conn.pending[i];
+		}
+		printf("bundle %u: %d messages, %d flows added\n", bundle_id,
+			conn.n_msgs, n);
+		_put_u16(msg + off + 4, OFPBCT_COMMIT_REPLY);
+		return _send(msg, len);
+
+	default:
+		return _send_error(msg, len, OFPET_BUNDLE_FAILED, OFPBFC_BAD_TYPE);
+	}
+}
+
+static int
+_bundle_add(uint8_t *msg, int len, int off)
+{
+	const uint8_t *inner = msg + off + 8;
+
+	if (len < off + 8 + OFP_HEADER_LEN)
+		return _send_error(msg, len, OFPET_BAD_REQUEST, OFPBRC_BAD_TYPE);
+
+	if (!conn.open || _get_u32(msg + off) != conn.bundle_id)
+		return _send_error(msg, len, OFPET_BUNDLE_FAILED, OFPBFC_BAD_ID);
+
+	if (conn.n_msgs++ == fail_flow) {
+		conn.failed = 1;
+		return _send_error(msg, len, OFPET_FLOW_MOD_FAILED, 0);
+	}
+
+	_flow_mod(inner, msg + len - inner, conn.pending);
+	return 0;
+}
+
+static int
+_table_stats(uint8_t *req, int len)
+{
+	uint8_t msg[16 + STATS_PER_REPLY * OFP_TABLE_STATS_LEN], *p;
+	uint32_t xid = _get_u32(req + 4);
+	int table = 0, n;
+
+	if (len < 16 || _get_u16(req + 8) != OFPMP_TABLE_STATS)
+		return _send_error(req, len, OFPET_BAD_REQUEST, OFPBRC_BAD_MULTIPART);
+
+	do {
+		n = n_tables - table;
+		if (n > STATS_PER_REPLY)
+			n = STATS_PER_REPLY;
+
+		memset(msg, 0, sizeof(msg));
+		_put_hdr(msg, OFPT_MULTIPART_REPLY, 16 + n * OFP_TABLE_STATS_LEN, xid);
+		_put_u16(msg + 8, OFPMP_TABLE_STATS);
+		_put_u16(msg + 10, table + n < n_tables ? OFPMPF_REPLY_MORE : 0);
+
+		for (p = msg + 16; n--; p += OFP_TABLE_STATS_LEN, table++) {
+			p[0] = table;
+			_put_u32(p + 4, active[table]);
+		}
+
+		if (_send(msg, p - msg))
+			return -1;
+	} while (table < n_tables);
+
+	return 0;
+}
+
+static int
+_handle(uint8_t *msg, int len)
+{
+	int off = OFP_HEADER_LEN;
+
+	conn.next_xid = _get_u32(msg + 4) + 1;
+
+	if (stale_replies && msg[1] != OFPT_HELLO && msg[1] != OFPT_ECHO_REQUEST &&
+			_send_stale())
+		return -1;
+
+	switch (msg[1]) {
+	case OFPT_HELLO:
+		// the client offers 1.4, answering in the lower version is enough
+		if (msg[0] < conn.version)
+			conn.version = msg[0];
+		return 0;
+
+	case OFPT_ECHO_REQUEST:
+		msg[1] = OFPT_ECHO_REPLY;
+		return _send(msg, len);
+
+	case OFPT_FLOW_MOD:
+		_flow_mod(msg, len, active);
+		return 0;
+
+	case OFPT_MULTIPART_REQUEST:
+		return _table_stats(msg, len);
+
+	case OFPT_EXPERIMENTER:
+		if (len < 16 || _get_u32(msg + 8) != ONF_EXPERIMENTER_ID)
+			break;
+
+		off += 8;
+		if (_get_u32(msg + 12) == ONFT_BUNDLE_CONTROL)
+			return _bundle_ctrl(msg, len, off);
+		if (_get_u32(msg + 12) == ONFT_BUNDLE_ADD_MESSAGE)
+			return _bundle_add(msg, len, off);
+		break;
+
+	case OFPT_BUNDLE_CONTROL:
+		if (conn.version >= OFP_VERSION_14)
+			return _bundle_ctrl(msg, len, off);
+		break;
+
+	case OFPT_BUNDLE_ADD_MESSAGE:
+		if (conn.version >= OFP_VERSION_14)
+			return _bundle_add(msg, len, off);
+		break;
+	}
+
+	return _send_error(msg, len, OFPET_BAD_REQUEST, OFPBRC_BAD_TYPE);
+}
+
+static void
+_serve(int fd)
+{
+	static uint8_t msg[OFP_MAXLEN];
+	int len;
+
+	memset(&conn, 0, sizeof(conn));
+	conn.fd = fd;
+
+	if (_hello())
+		goto out;
+
+	while ((len = _recv(msg)) > 0)
+		if (_handle(msg, len))
+			break;
+
+out:
+	close(fd);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: %s [options] <socket>\n"
+		"Options:\n"
+		" -v <version>:		Highest OpenFlow version, 4 (1.3) or 5 (1.4)\n"
+		"			(default: %d)\n"
+		" -t <n>:		Number of tables in the statistics (default: %d)\n"
+		" -f <n>:		Reject the n-th message (from 0) of every bundle\n"
+		" -o:			Reject every bundle open request\n"
+		" -s:			Send an error for an unrelated request before\n"
+		"			every answer\n"
+		"\n", progname, OFP_VERSION_14, OFPTT_MAX);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int ch, sock, fd;
+
+	progname = argv[0];
+
+	while ((ch = getopt(argc, argv, "v:t:f:os")) != -1) {
+		switch (ch) {
+		case 'v':
+			max_version = atoi(optarg);
+			if (max_version != OFP_VERSION_13 && max_version != OFP_VERSION_14)
+				usage();
+			break;
+		case 't':
+			n_tables = atoi(optarg);
+			if (n_tables < 0 || n_tables > OFPTT_MAX)
+				usage();
+			break;
+		case 'f':
+			fail_flow = atoi(optarg);
+			break;
+		case 'o':
+			reject_open = 1;
+			break;
+		case 's':
+			stale_replies = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1 ||
+			strlen(argv[optind]) >= sizeof(addr.sun_path))
+		usage();
+
+	strcpy(addr.sun_path, argv[optind]);
+	signal(SIGPIPE, SIG_IGN);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	unlink(addr.sun_path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) ||
+			listen(sock, 1)) {
+		fprintf(stderr, "%s: %s: %s\n", progname, addr.sun_path,
+			strerror(errno));
+		return 1;
+	}
+
+	// ovsd keeps one connection per bridge, serve them one after another
+	for (;;) {
+		fd = accept(sock, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			return 1;
+		}
+
+		_serve(fd);
+	}
+}
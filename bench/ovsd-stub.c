@@ -0,0 +1,80 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/* Stand-in for ovs-vsctl and ovs-appctl in load tests (see ovsd-bench.c).
+ * It keeps no database: every command succeeds and every bridge exists and
+ * is its own parent. Queries print nothing, which ovsd takes as no ports,
+ * controllers etc.; table listings print only the CSV headings. The environment sets the behaviour:
+ *
+ *   OVSD_STUB_LATENCY_US	time every call takes
+ *   OVSD_STUB_JITTER_US	random extra time, up to this much
+ *   OVSD_STUB_FAIL_PERMILLE	share of calls that fail
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static long
+_env(const char *name)
+{
+	const char *val = getenv(name);
+
+	return val ? strtol(val, NULL, 10) : 0;
+}
+
+int main(int argc, char **argv)
+{
+	long latency = _env("OVSD_STUB_LATENCY_US");
+	long jitter = _env("OVSD_STUB_JITTER_US");
+	long fail = _env("OVSD_STUB_FAIL_PERMILLE");
+	struct timespec ts;
+	const char *cmd = NULL;
+	int i, csv;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	srandom(ts.tv_nsec ^ getpid());
+
+	if (jitter > 0)
+		latency += random() % (jitter + 1);
+	if (latency > 0)
+		usleep(latency);
+
+	if (fail > 0 && random() % 1000 < fail) {
+		fprintf(stderr, "%s: injected failure\n", argv[0]);
+		return 1;
+	}
+
+	// skip global options like --timeout and --db
+	for (i = 1; i < argc && !strncmp(argv[i], "--", 2) && argv[i][2]; i++)
+		;
+	if (i < argc)
+		cmd = argv[i];
+	if (!cmd)
+		return 0;
+
+	if (!strcmp(cmd, "br-to-parent") && i + 1 < argc)
+		printf("%s\n", argv[i + 1]);
+	else if (!strcmp(cmd, "br-to-vlan"))
+		printf("0\n");
+
+	// empty tables, but listed as CSV they still have their headings
+	for (i = 1; i < argc && strcmp(argv[i], "--format=csv"); i++);
+	for (csv = i < argc, i = 1; csv && i + 1 < argc; i++)
+		if (!strncmp(argv[i], "--columns=", 10) &&
+				!strcmp(argv[i + 1], "list"))
+			printf("%s\n", argv[i] + 10);
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/if.h>
+
+#include "bond.h"
+#include "ovs-shell.h"
+
+#define BOND_OUTPUT_MAXSIZE 16384
+#define BOND_MEMBERS_MAX 32
+
+struct bond_member {
+	char name[IFNAMSIZ];
+	char state[16];
+	char lacp[64];
+	bool active;
+	bool may_enable;
+	unsigned long load_kb;
+};
+
+struct bond_state {
+	char mode[32];
+	char lacp_status[32];
+	char lacp[64];
+
+	struct bond_member members[BOND_MEMBERS_MAX];
+	int n_members;
+};
+
+static int
+_appctl(char *cmd, char *bond, char *out, size_t len)
+{
+	char * const argv[] = { OVS_APPCTL, cmd, bond, NULL };
+
+	return ovs_vsctl_output(argv, out, len);
+}
+
+static void
+_copy(char *dst, size_t len, const char *src)
+{
+	snprintf(dst, len, "%s", src);
+	dst[strcspn(dst, "\n")] = '\0';
+}
+
+/* Older releases of Open vSwitch call bond members slaves */
+static char *
+_member_line(char *line)
+{
+	if (!strncmp(line, "slave", 5))
+		return line + 5;
+	if (!strncmp(line, "member", 6))
+		return line + 6;
+	return NULL;
+}
+
+static struct bond_member *
+_find_member(struct bond_state *st, const char *name)
+{
+	for (int i = 0; i < st->n_members; i++)
+		if (!strcmp(st->members[i].name, name))
+			return &st->members[i];
+
+	return NULL;
+}
+
+/* Parse 'ovs-appctl bond/show', e.g.
+ *
+ *   bond_mode: balance-tcp
+ *   lacp_status: negotiated
+ *
+ *   slave eth1: enabled
+ *     active slave
+ *     may_enable: true
+ *     hash 12: 5 kB load
+ */
+static void
+_parse_bond_show(char *out, struct bond_state *st)
+{
+	struct bond_member *m = NULL;
+	char *line, *save, *rest, *val;
+	unsigned long kb;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (*line == '\t' || *line == ' ') {
+			line += strspn(line, "\t ");
+			if (!m)
+				continue;
+
+			if (!strncmp(line, "active ", 7))
+				m->active = true;
+			else if (!strncmp(line, "may_enable: ", 12))
+				m->may_enable = !strcmp(line + 12, "true");
+			else if (!strncmp(line, "hash ", 5) &&
+					(val = strchr(line, ':')) &&
+					sscanf(val + 1, "%lu kB", &kb) == 1)
+				m->load_kb += kb;
+			continue;
+		}
+
+		if ((rest = _member_line(line)) && *rest == ' ' &&
+				(val = strchr(rest, ':'))) {
+			m = NULL;
+			if (st->n_members == BOND_MEMBERS_MAX)
+				continue;
+
+			m = &st->members[st->n_members++];
+			memset(m, 0, sizeof(*m));
+			*val = '\0';
+			_copy(m->name, sizeof(m->name), rest + 1);
+			_copy(m->state, sizeof(m->state), val + 1 + strspn(val + 1, " "));
+			continue;
+		}
+
+		if (!strncmp(line, "bond_mode: ", 11))
+			_copy(st->mode, sizeof(st->mode), line + 11);
+		else if (!strncmp(line, "lacp_status: ", 13))
+			_copy(st->lacp_status, sizeof(st->lacp_status), line + 13);
+	}
+}
+
+/* Parse 'ovs-appctl lacp/show', e.g.
+ *
+ *   ---- bond0 ----
+ *     status: active negotiated
+ *
+ *   slave: eth1: current attached
+ */
+static void
+_parse_lacp_show(char *out, struct bond_state *st)
+{
+	struct bond_member *m;
+	char *line, *save, *rest, *val;
+	bool in_member = false;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if ((rest = _member_line(line)) && !strncmp(rest, ": ", 2) &&
+				(val = strchr(rest + 2, ':'))) {
+			in_member = true;
+			*val = '\0';
+			m = _find_member(st, rest + 2);
+			if (m)
+				_copy(m->lacp, sizeof(m->lacp), val + 1 + strspn(val + 1, " "));
+			continue;
+		}
+
+		line += strspn(line, "\t ");
+		if (!in_member && !strncmp(line, "status: ", 8))
+			_copy(st->lacp, sizeof(st->lacp), line + 8);
+	}
+}
+
+int
+ovs_bond_dump(char *bond, struct blob_buf *buf)
+{
+	struct bond_state st;
+	void *tbl, *members, *m;
+	char *out;
+	int ret;
+
+	out = malloc(BOND_OUTPUT_MAXSIZE);
+	if (!out)
+		return OVSD_EUNKNOWN;
+
+	memset(&st, 0, sizeof(st));
+
+	ret = _appctl("bond/show", bond, out, BOND_OUTPUT_MAXSIZE);
+	if (ret) {
+		free(out);
+		return OVSD_ENOEXIST;
+	}
+	_parse_bond_show(out, &st);
+
+	// fails if LACP is off, there is nothing more to report then
+	if (!_appctl("lacp/show", bond, out, BOND_OUTPUT_MAXSIZE))
+		_parse_lacp_show(out, &st);
+	free(out);
+
+	tbl = blobmsg_open_table(buf, "bond");
+	blobmsg_add_string(buf, "name", bond);
+	if (st.mode[0])
+		blobmsg_add_string(buf, "bond_mode", st.mode);
+	if (st.lacp_status[0])
+		blobmsg_add_string(buf, "lacp_status", st.lacp_status);
+	if (st.lacp[0])
+		blobmsg_add_string(buf, "lacp", st.lacp);
+
+	members = blobmsg_open_table(buf, "members");
+	for (int i = 0; i < st.n_members; i++) {
+		m = blobmsg_open_table(buf, st.members[i].name);
+		blobmsg_add_string(buf, "state", st.members[i].state);
+		blobmsg_add_u8(buf, "active", st.members[i].active);
+		blobmsg_add_u8(buf, "may_enable", st.members[i].may_enable);
+		blobmsg_add_u32(buf, "load_kb", st.members[i].load_kb);
+		if (st.members[i].lacp[0])
+			blobmsg_add_string(buf, "lacp", st.members[i].lacp);
+		blobmsg_close_table(buf, m);
+	}
+	blobmsg_close_table(buf, members);
+
+	blobmsg_close_table(buf, tbl);
+	return OVSD_OK;
+}
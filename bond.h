@@ -0,0 +1,24 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_BOND_H
+#define __OVSD_BOND_H
+
+#include "ovsd.h"
+
+/* Add a table with the state of a bond and the LACP and load distribution
+ * state of its members, as reported by ovs-vswitchd, to buf.
+ */
+int ovs_bond_dump(char *bond, struct blob_buf *buf);
+
+#endif
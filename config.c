@@ -0,0 +1,844 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "instance.h"
+
+const struct blobmsg_policy create_policy[__CREATPOL_MAX] = {
+	[CREATPOL_BRIDGE] = {
+		.name = "name",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_PARENT] = {
+		.name = "parent",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_VLAN] = {
+		.name = "vlan",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_OFCONTROLLERS] = {
+		.name = "ofcontrollers",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_FAILMODE] = {
+		.name = "controller_fail_mode",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_SSLPRIVKEY] = {
+		.name = "ssl_private_key",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_SSLCERT] = {
+		.name = "ssl_cert",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_SSLCACERT] = {
+		.name = "ssl_ca_cert",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_SSLBOOTSTRAP] = {
+		.name = "ssl_bootstrap",
+		.type =  BLOBMSG_TYPE_BOOL,
+	},
+	[CREATPOL_FLOW_LIMIT] = {
+		.name = "flow_limit",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_MAX_IDLE] = {
+		.name = "max_idle",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_N_HANDLERS] = {
+		.name = "n_handler_threads",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_N_REVALIDATORS] = {
+		.name = "n_revalidator_threads",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_DATAPATH_TYPE] = {
+		.name = "datapath_type",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_PMD_CPU_MASK] = {
+		.name = "pmd_cpu_mask",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_N_RXQ] = {
+		.name = "n_rxq",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_BOND] = {
+		.name = "bond",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_BOND_NAME] = {
+		.name = "bond_name",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_BOND_MODE] = {
+		.name = "bond_mode",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_LACP] = {
+		.name = "lacp",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_LACP_TIME] = {
+		.name = "lacp_time",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_BOND_REBALANCE] = {
+		.name = "bond_rebalance_interval",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_SFLOW_TARGETS] = {
+		.name = "sflow_targets",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_SFLOW_SAMPLING] = {
+		.name = "sflow_sampling",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_SFLOW_POLLING] = {
+		.name = "sflow_polling",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_SFLOW_HEADER] = {
+		.name = "sflow_header",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_SFLOW_AGENT] = {
+		.name = "sflow_agent",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_IPFIX_TARGETS] = {
+		.name = "ipfix_targets",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_IPFIX_SAMPLING] = {
+		.name = "ipfix_sampling",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_MIRRORS] = {
+		.name = "mirror",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_INSTANCE] = {
+		.name = "instance",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_PATCH_PEERS] = {
+		.name = "patch_peer",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_INACTIVITY_PROBE] = {
+		.name = "inactivity_probe",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_MAX_BACKOFF] = {
+		.name = "max_backoff",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_CTL_RATE_LIMIT] = {
+		.name = "controller_rate_limit",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_CTL_BURST_LIMIT] = {
+		.name = "controller_burst_limit",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_CONNECTION_MODE] = {
+		.name = "connection_mode",
+		.type = BLOBMSG_TYPE_STRING,
+	},
+	[CREATPOL_FLOW_TABLES] = {
+		.name = "flow_table",
+		.type = BLOBMSG_TYPE_ARRAY,
+	},
+	[CREATPOL_MAC_TABLE_SIZE] = {
+		.name = "mac_table_size",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+	[CREATPOL_MAC_AGING_TIME] = {
+		.name = "mac_aging_time",
+		.type = BLOBMSG_TYPE_INT32,
+	},
+};
+
+static const char * const bond_modes[] = {
+	"active-backup", "balance-slb", "balance-tcp",
+};
+
+static const char * const lacp_modes[] = {
+	"off", "active", "passive",
+};
+
+static const char * const lacp_times[] = {
+	"slow", "fast",
+};
+
+static const char * const connection_modes[] = {
+	"in-band", "out-of-band",
+};
+
+static const char * const overflow_policies[] = {
+	"refuse", "evict",
+};
+
+static char**
+_parse_strarray(struct blob_attr *head, size_t len, int *n_entries)
+{
+	struct blob_attr *cur;
+	int offset = 0;
+
+	char **arr = calloc(len, sizeof(char*));
+	if (!arr)
+		return NULL;
+
+	__blob_for_each_attr(cur, head, len) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+			continue;
+
+		arr[offset++] = blobmsg_get_string(cur);
+	}
+
+	*n_entries = offset;
+	return arr;
+}
+
+/* Like _parse_strarray(), but a list with other than string elements is
+ * rejected instead of shortened.
+ */
+static char **
+_parse_strlist(struct blob_attr *attr, int *n_entries)
+{
+	if (blobmsg_check_array(attr, BLOBMSG_TYPE_STRING) < 0)
+		return NULL;
+
+	return _parse_strarray(blobmsg_data(attr), blobmsg_data_len(attr),
+		n_entries);
+}
+
+static int
+_parse_ofcontroller_opts(struct blob_attr **tb,
+	struct ovswitch_br_config *ovs_cfg)
+{
+	if (!tb[CREATPOL_OFCONTROLLERS])
+		return 0;
+
+	ovs_cfg->ofcontrollers = _parse_strarray(
+		blobmsg_data(tb[CREATPOL_OFCONTROLLERS]),
+		blobmsg_data_len(tb[CREATPOL_OFCONTROLLERS]),
+		&ovs_cfg->n_ofcontrollers);
+
+	if (!ovs_cfg->n_ofcontrollers || !ovs_cfg->ofcontrollers)
+		return -1;
+
+	if (tb[CREATPOL_FAILMODE]) {
+		if (!strcmp(blobmsg_get_string(tb[CREATPOL_FAILMODE]), "standalone"))
+			ovs_cfg->fail_mode = OVS_FAIL_MODE_STANDALONE;
+		else if (!strcmp(blobmsg_get_string(tb[CREATPOL_FAILMODE]), "secure"))
+			ovs_cfg->fail_mode = OVS_FAIL_MODE_SECURE;
+		else
+			return -1;
+	} else {
+		ovs_cfg->fail_mode = OVS_FAIL_MODE_STANDALONE;
+	}
+
+	return 0;
+}
+
+static int
+_parse_ssl_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	if (!tb[CREATPOL_SSLPRIVKEY] || !tb[CREATPOL_SSLCERT] ||
+		!tb[CREATPOL_SSLCACERT])
+		return -1;
+
+	if (tb[CREATPOL_SSLBOOTSTRAP])
+		cfg->ssl_bootstrap = blobmsg_get_bool(tb[CREATPOL_SSLBOOTSTRAP]);
+
+	cfg->ssl_privkey_file = blobmsg_get_string(tb[CREATPOL_SSLPRIVKEY]);
+	cfg->ssl_cert_file = blobmsg_get_string(tb[CREATPOL_SSLCERT]);
+	cfg->ssl_cacert_file = blobmsg_get_string(tb[CREATPOL_SSLCACERT]);
+
+	return 0;
+}
+
+static int
+_parse_tuning_int(struct blob_attr *attr, int min)
+{
+	int val;
+
+	if (!attr)
+		return -1;
+
+	val = blobmsg_get_u32(attr);
+	return val >= min ? val : -2;
+}
+
+// datapath options, a fake bridge has the datapath of its parent
+static const int tuning_opts[] = {
+	CREATPOL_DATAPATH_TYPE, CREATPOL_N_RXQ, CREATPOL_FLOW_LIMIT,
+	CREATPOL_MAX_IDLE, CREATPOL_N_HANDLERS, CREATPOL_N_REVALIDATORS,
+	CREATPOL_PMD_CPU_MASK,
+};
+
+static enum ovsd_status
+_parse_tuning_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	const char *mask;
+
+	cfg->flow_limit = _parse_tuning_int(tb[CREATPOL_FLOW_LIMIT], 0);
+	cfg->max_idle = _parse_tuning_int(tb[CREATPOL_MAX_IDLE], 0);
+	cfg->n_handler_threads = _parse_tuning_int(tb[CREATPOL_N_HANDLERS], 1);
+	cfg->n_revalidator_threads = _parse_tuning_int(
+		tb[CREATPOL_N_REVALIDATORS], 1);
+	cfg->n_rxq = _parse_tuning_int(tb[CREATPOL_N_RXQ], 1);
+
+	if (cfg->flow_limit < -1 || cfg->max_idle < -1 ||
+			cfg->n_handler_threads < -1 || cfg->n_revalidator_threads < -1 ||
+			cfg->n_rxq < -1)
+		return OVSD_EINVALID_ARG;
+
+	if (tb[CREATPOL_DATAPATH_TYPE]) {
+		cfg->datapath_type = blobmsg_get_string(tb[CREATPOL_DATAPATH_TYPE]);
+		if (strcmp(cfg->datapath_type, "system") &&
+				strcmp(cfg->datapath_type, "netdev"))
+			return OVSD_EINVALID_ARG;
+	}
+
+	if (tb[CREATPOL_PMD_CPU_MASK]) {
+		mask = blobmsg_get_string(tb[CREATPOL_PMD_CPU_MASK]);
+		if (!strncmp(mask, "0x", 2))
+			mask += 2;
+		if (!*mask || strspn(mask, "0123456789abcdefABCDEF") != strlen(mask))
+			return OVSD_EINVALID_ARG;
+		cfg->pmd_cpu_mask = blobmsg_get_string(tb[CREATPOL_PMD_CPU_MASK]);
+	}
+
+	return OVSD_OK;
+}
+
+/* Take the value of a string option if it is one of the given choices, or the
+ * first choice as default if it is missing.
+ */
+static int
+_parse_choice(struct blob_attr *attr, const char * const *choices, int n,
+	const char **val)
+{
+	*val = choices[0];
+	if (!attr)
+		return 0;
+
+	for (int i = 0; i < n; i++) {
+		if (!strcmp(blobmsg_get_string(attr), choices[i])) {
+			*val = choices[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/* Connection settings of the controllers, they use the defaults of Open
+ * vSwitch if not given. Open vSwitch enforces the lower bounds of the rate
+ * and burst limits itself.
+ */
+static enum ovsd_status
+_parse_controller_tuning(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	// inactivity probes are off with 0
+	cfg->ctl_inactivity_probe = _parse_tuning_int(
+		tb[CREATPOL_INACTIVITY_PROBE], 0);
+	cfg->ctl_max_backoff = _parse_tuning_int(tb[CREATPOL_MAX_BACKOFF], 1000);
+	cfg->ctl_rate_limit = _parse_tuning_int(tb[CREATPOL_CTL_RATE_LIMIT], 1);
+	cfg->ctl_burst_limit = _parse_tuning_int(tb[CREATPOL_CTL_BURST_LIMIT], 1);
+
+	if (cfg->ctl_inactivity_probe < -1 || cfg->ctl_max_backoff < -1 ||
+			cfg->ctl_rate_limit < -1 || cfg->ctl_burst_limit < -1)
+		return OVSD_EINVALID_ARG;
+
+	// a burst limit alone has no effect
+	if (cfg->ctl_burst_limit >= 0 && cfg->ctl_rate_limit < 0)
+		return OVSD_EINVALID_ARG;
+
+	if (tb[CREATPOL_CONNECTION_MODE] && _parse_choice(
+			tb[CREATPOL_CONNECTION_MODE], connection_modes,
+			ARRAY_SIZE(connection_modes), &cfg->ctl_connection_mode))
+		return OVSD_EINVALID_ARG;
+
+	return OVSD_OK;
+}
+
+bool
+ovsd_config_has_controller_tuning(struct ovswitch_br_config *cfg)
+{
+	return cfg->ctl_inactivity_probe >= 0 || cfg->ctl_max_backoff >= 0 ||
+		cfg->ctl_rate_limit >= 0 || cfg->ctl_burst_limit >= 0 ||
+		cfg->ctl_connection_mode;
+}
+
+static enum ovsd_status
+_parse_bond_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	if (!tb[CREATPOL_BOND])
+		return OVSD_OK;
+
+	cfg->bond_members = _parse_strlist(tb[CREATPOL_BOND],
+		&cfg->n_bond_members);
+
+	// a bond with less than two members is just a port
+	if (!cfg->bond_members || cfg->n_bond_members < 2)
+		return OVSD_EINVALID_ARG;
+
+	if (tb[CREATPOL_BOND_NAME]) {
+		if (strlen(blobmsg_get_string(tb[CREATPOL_BOND_NAME])) >=
+				sizeof(cfg->bond_name))
+			return OVSD_EINVALID_ARG;
+		strcpy(cfg->bond_name, blobmsg_get_string(tb[CREATPOL_BOND_NAME]));
+	} else {
+		snprintf(cfg->bond_name, sizeof(cfg->bond_name), "%s-bond",
+			cfg->name);
+	}
+
+	if (_parse_choice(tb[CREATPOL_BOND_MODE], bond_modes,
+			ARRAY_SIZE(bond_modes), &cfg->bond_mode) ||
+			_parse_choice(tb[CREATPOL_LACP], lacp_modes,
+				ARRAY_SIZE(lacp_modes), &cfg->lacp) ||
+			_parse_choice(tb[CREATPOL_LACP_TIME], lacp_times,
+				ARRAY_SIZE(lacp_times), &cfg->lacp_time))
+		return OVSD_EINVALID_ARG;
+
+	if (tb[CREATPOL_BOND_REBALANCE])
+		cfg->bond_rebalance_interval =
+			blobmsg_get_u32(tb[CREATPOL_BOND_REBALANCE]);
+
+	return OVSD_OK;
+}
+
+static enum ovsd_status
+_parse_telemetry_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	if (tb[CREATPOL_SFLOW_TARGETS]) {
+		cfg->sflow_targets = _parse_strlist(tb[CREATPOL_SFLOW_TARGETS],
+			&cfg->n_sflow_targets);
+		if (!cfg->sflow_targets || !cfg->n_sflow_targets)
+			return OVSD_EINVALID_ARG;
+	}
+
+	if (tb[CREATPOL_IPFIX_TARGETS]) {
+		cfg->ipfix_targets = _parse_strlist(tb[CREATPOL_IPFIX_TARGETS],
+			&cfg->n_ipfix_targets);
+		if (!cfg->ipfix_targets || !cfg->n_ipfix_targets)
+			return OVSD_EINVALID_ARG;
+	}
+
+	cfg->sflow_sampling = _parse_tuning_int(tb[CREATPOL_SFLOW_SAMPLING], 1);
+	cfg->sflow_polling = _parse_tuning_int(tb[CREATPOL_SFLOW_POLLING], 0);
+	cfg->sflow_header = _parse_tuning_int(tb[CREATPOL_SFLOW_HEADER], 1);
+	cfg->ipfix_sampling = _parse_tuning_int(tb[CREATPOL_IPFIX_SAMPLING], 1);
+	if (cfg->sflow_sampling < -1 || cfg->sflow_polling < -1 ||
+			cfg->sflow_header < -1 || cfg->ipfix_sampling < -1)
+		return OVSD_EINVALID_ARG;
+
+	if (tb[CREATPOL_SFLOW_AGENT])
+		cfg->sflow_agent = blobmsg_get_string(tb[CREATPOL_SFLOW_AGENT]);
+
+	return OVSD_OK;
+}
+
+/* Parse a mirror given as "<name>:<ports>:<output>". Ports is a comma
+ * separated list of ports to mirror or '*' for all of them, output is the
+ * port receiving the copies (SPAN) or "vlan:<id>" for a remote VLAN (RSPAN).
+ */
+static enum ovsd_status
+_parse_mirror(const char *str, struct ovsd_mirror *m)
+{
+	char *ports, *output, *tok, *save, *end;
+	long vlan;
+
+	m->spec = strdup(str);
+	if (!m->spec)
+		return OVSD_EUNKNOWN;
+
+	m->name = m->spec;
+	ports = strchr(m->name, ':');
+	if (!ports)
+		return OVSD_EINVALID_ARG;
+	*ports++ = '\0';
+
+	output = strchr(ports, ':');
+	if (!output)
+		return OVSD_EINVALID_ARG;
+	*output++ = '\0';
+
+	if (!*m->name || !*ports || !*output)
+		return OVSD_EINVALID_ARG;
+
+	// a ':' cannot be part of the port name, "vlan10" is a port
+	if (!strncmp(output, "vlan:", 5)) {
+		vlan = strtol(output + 5, &end, 10);
+		if (!output[5] || *end || vlan < 1 || vlan > 4095)
+			return OVSD_EINVALID_VLAN;
+		m->output_vlan = vlan;
+	} else {
+		m->output_port = output;
+	}
+
+	if (!strcmp(ports, "*"))
+		return OVSD_OK;
+
+	m->select = calloc(strlen(ports) / 2 + 1, sizeof(char *));
+	if (!m->select)
+		return OVSD_EUNKNOWN;
+
+	for (tok = strtok_r(ports, ",", &save); tok;
+			tok = strtok_r(NULL, ",", &save))
+		m->select[m->n_select++] = tok;
+
+	return m->n_select ? OVSD_OK : OVSD_EINVALID_ARG;
+}
+
+/* Parse a flow table given as <table>:<flow_limit>[:<overflow_policy>
+ * [:<name>[:<groups>]]], e.g. 0:100000:evict:classifier:NXM_OF_IN_PORT[].
+ * Empty fields are left unset, groups are separated by commas.
+ */
+static enum ovsd_status
+_parse_flow_table(const char *str, struct ovsd_flow_table *t)
+{
+	char *fields[5] = { NULL }, *next, *end, *tok, *save;
+	int n = 0;
+
+	t->spec = strdup(str);
+	if (!t->spec)
+		return OVSD_EUNKNOWN;
+
+	next = t->spec;
+	while (next && n < ARRAY_SIZE(fields))
+		fields[n++] = strsep(&next, ":");
+	if (next || n < 2)
+		return OVSD_EINVALID_ARG;
+
+	t->table = strtol(fields[0], &end, 10);
+	if (!*fields[0] || *end || t->table < 0 || t->table > 253)
+		return OVSD_EINVALID_ARG;
+
+	t->flow_limit = -1;
+	if (*fields[1]) {
+		t->flow_limit = strtol(fields[1], &end, 10);
+		if (*end || t->flow_limit < 0)
+			return OVSD_EINVALID_ARG;
+	}
+
+	if (fields[2] && *fields[2]) {
+		for (int i = 0; i < ARRAY_SIZE(overflow_policies); i++)
+			if (!strcmp(fields[2], overflow_policies[i]))
+				t->overflow_policy = overflow_policies[i];
+		if (!t->overflow_policy)
+			return OVSD_EINVALID_ARG;
+	}
+
+	if (fields[3] && *fields[3])
+		t->name = fields[3];
+
+	if (fields[4] && *fields[4]) {
+		t->groups = calloc(strlen(fields[4]) / 2 + 1, sizeof(char *));
+		if (!t->groups)
+			return OVSD_EUNKNOWN;
+
+		for (tok = strtok_r(fields[4], ",", &save); tok;
+				tok = strtok_r(NULL, ",", &save))
+			t->groups[t->n_groups++] = tok;
+	}
+
+	if (t->flow_limit < 0 && !t->overflow_policy && !t->name)
+		return OVSD_EINVALID_ARG;
+
+	return OVSD_OK;
+}
+
+static enum ovsd_status
+_parse_flow_table_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	struct blob_attr *cur;
+	int n, rem, ret;
+
+	if (!tb[CREATPOL_FLOW_TABLES])
+		return OVSD_OK;
+
+	// every element has to be a string
+	n = blobmsg_check_array(tb[CREATPOL_FLOW_TABLES], BLOBMSG_TYPE_STRING);
+	if (n < 0)
+		return OVSD_EINVALID_ARG;
+
+	cfg->flow_tables = calloc(n + 1, sizeof(*cfg->flow_tables));
+	if (!cfg->flow_tables)
+		return OVSD_EUNKNOWN;
+
+	blobmsg_for_each_attr(cur, tb[CREATPOL_FLOW_TABLES], rem) {
+		ret = _parse_flow_table(blobmsg_get_string(cur),
+			&cfg->flow_tables[cfg->n_flow_tables++]);
+		if (ret)
+			return ret;
+	}
+
+	return OVSD_OK;
+}
+
+static enum ovsd_status
+_parse_mirror_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	struct blob_attr *cur;
+	int n, rem, ret;
+
+	if (!tb[CREATPOL_MIRRORS])
+		return OVSD_OK;
+
+	// every element has to be a string
+	n = blobmsg_check_array(tb[CREATPOL_MIRRORS], BLOBMSG_TYPE_STRING);
+	if (n < 0)
+		return OVSD_EINVALID_ARG;
+
+	cfg->mirrors = calloc(n + 1, sizeof(*cfg->mirrors));
+	if (!cfg->mirrors)
+		return OVSD_EUNKNOWN;
+
+	blobmsg_for_each_attr(cur, tb[CREATPOL_MIRRORS], rem) {
+		ret = _parse_mirror(blobmsg_get_string(cur),
+			&cfg->mirrors[cfg->n_mirrors++]);
+		if (ret)
+			return ret;
+	}
+
+	return OVSD_OK;
+}
+
+static enum ovsd_status
+_parse_create_msg(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+{
+	// parse name
+	if (!tb[CREATPOL_BRIDGE])
+		return OVSD_EINVALID_ARG;
+	cfg->name = blobmsg_get_string(tb[CREATPOL_BRIDGE]);
+
+	// parse the Open vSwitch instance the bridge lives in
+	if (tb[CREATPOL_INSTANCE]) {
+		cfg->instance = blobmsg_get_string(tb[CREATPOL_INSTANCE]);
+		if (!ovsd_instance_find(cfg->instance))
+			return OVSD_EINVALID_ARG;
+	}
+
+	// parse fake bridge options
+	if (tb[CREATPOL_PARENT] && tb[CREATPOL_VLAN]) {
+		cfg->parent = blobmsg_get_string(tb[CREATPOL_PARENT]);
+		cfg->vlan_tag = blobmsg_get_u32(tb[CREATPOL_VLAN]);
+	}
+
+	// parse SSL options
+	_parse_ssl_opts(tb, cfg);
+
+	// parse list of OF-controllers
+	_parse_ofcontroller_opts(tb, cfg);
+
+	// fake bridges share the controller settings, MAC table, bond,
+	// telemetry, mirrors, patch ports and flow tables of their parent
+	if (cfg->parent) {
+		// the datapath as well, its tuning would be dropped silently
+		for (int i = 0; i < ARRAY_SIZE(tuning_opts); i++)
+			if (tb[tuning_opts[i]])
+				return OVSD_EINVALID_ARG;
+
+		return OVSD_OK;
+	}
+
+	// parse datapath tuning options
+	if (_parse_tuning_opts(tb, cfg))
+		return OVSD_EINVALID_ARG;
+
+	// parse controller connection settings
+	if (_parse_controller_tuning(tb, cfg))
+		return OVSD_EINVALID_ARG;
+
+	// parse MAC learning options
+	cfg->mac_table_size = _parse_tuning_int(tb[CREATPOL_MAC_TABLE_SIZE], 1);
+	cfg->mac_aging_time = _parse_tuning_int(tb[CREATPOL_MAC_AGING_TIME], 1);
+	if (cfg->mac_table_size < -1 || cfg->mac_aging_time < -1)
+		return OVSD_EINVALID_ARG;
+
+	// parse link aggregation options
+	if (_parse_bond_opts(tb, cfg))
+		return OVSD_EINVALID_ARG;
+
+	// parse sFlow, IPFIX and mirror options
+	if (_parse_telemetry_opts(tb, cfg))
+		return OVSD_EINVALID_ARG;
+
+	// parse bridges to link with patch ports
+	if (tb[CREATPOL_PATCH_PEERS]) {
+		cfg->patch_peers = _parse_strlist(tb[CREATPOL_PATCH_PEERS],
+			&cfg->n_patch_peers);
+		if (!cfg->patch_peers)
+			return OVSD_EINVALID_ARG;
+	}
+
+	// parse OpenFlow table capacity
+	if (_parse_flow_table_opts(tb, cfg))
+		return OVSD_EINVALID_ARG;
+
+	return _parse_mirror_opts(tb, cfg);
+}
+
+const struct blobmsg_policy vlan_policy[__VLANPOL_MAX] = {
+	[VLANPOL_TAG] = { .name = "tag", .type = BLOBMSG_TYPE_INT32 },
+	[VLANPOL_TRUNKS] = { .name = "trunks", .type = BLOBMSG_TYPE_ARRAY },
+	[VLANPOL_MODE] = { .name = "vlan_mode", .type = BLOBMSG_TYPE_STRING },
+};
+
+static const char * const vlan_modes[] = {
+	"access", "trunk", "native-tagged", "native-untagged",
+};
+
+/* Parse and validate the 802.1Q options of a port from a list of blobmsg
+ * attributes, e.g. an 'add' message or an entry of 'configure'.
+ */
+enum ovsd_status
+ovsd_config_parse_vlan(void *data, size_t len, struct ovsd_port_vlan *vlan)
+{
+	struct blob_attr *tb[__VLANPOL_MAX], *cur;
+	int rem;
+
+	blobmsg_parse(vlan_policy, __VLANPOL_MAX, tb, data, len);
+
+	if (tb[VLANPOL_TAG]) {
+		vlan->tag = blobmsg_get_u32(tb[VLANPOL_TAG]);
+		if (vlan->tag < 0 || vlan->tag > 4095)
+			return OVSD_EINVALID_VLAN;
+	}
+
+	if (tb[VLANPOL_TRUNKS]) {
+		blobmsg_for_each_attr(cur, tb[VLANPOL_TRUNKS], rem) {
+			if (blobmsg_type(cur) != BLOBMSG_TYPE_INT32 ||
+					blobmsg_get_u32(cur) > 4095)
+				return OVSD_EINVALID_VLAN;
+		}
+		vlan->trunks = tb[VLANPOL_TRUNKS];
+	}
+
+	if (tb[VLANPOL_MODE]) {
+		vlan->mode = blobmsg_get_string(tb[VLANPOL_MODE]);
+		for (int i = 0; i < ARRAY_SIZE(vlan_modes); i++)
+			if (!strcmp(vlan->mode, vlan_modes[i]))
+				return OVSD_OK;
+
+		return OVSD_EINVALID_ARG;
+	}
+
+	return OVSD_OK;
+}
+
+bool
+ovsd_config_has_vlan(struct ovsd_port_vlan *vlan)
+{
+	return vlan->tag >= 0 || vlan->trunks || vlan->mode;
+}
+
+/* Parse a bridge configuration message as sent by netifd with 'create' and
+ * 'reload'. String members of cfg point into msg.
+ */
+enum ovsd_status
+ovsd_config_parse(struct blob_attr *msg, struct ovswitch_br_config *cfg)
+{
+	struct blob_attr *tb[__CREATPOL_MAX];
+
+	blobmsg_parse(create_policy, __CREATPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	return _parse_create_msg(tb, cfg);
+}
+
+void
+ovsd_config_free(struct ovswitch_br_config *cfg)
+{
+	// free string array
+	if (cfg->ofcontrollers)
+		free(cfg->ofcontrollers);
+	cfg->ofcontrollers = NULL;
+
+	free(cfg->bond_members);
+	cfg->bond_members = NULL;
+	cfg->n_bond_members = 0;
+
+	free(cfg->sflow_targets);
+	cfg->sflow_targets = NULL;
+	cfg->n_sflow_targets = 0;
+
+	free(cfg->ipfix_targets);
+	cfg->ipfix_targets = NULL;
+	cfg->n_ipfix_targets = 0;
+
+	free(cfg->patch_peers);
+	cfg->patch_peers = NULL;
+	cfg->n_patch_peers = 0;
+
+	for (int i = 0; cfg->mirrors && i < cfg->n_mirrors; i++) {
+		free(cfg->mirrors[i].select);
+		free(cfg->mirrors[i].spec);
+	}
+	free(cfg->mirrors);
+	cfg->mirrors = NULL;
+	cfg->n_mirrors = 0;
+
+	for (int i = 0; cfg->flow_tables && i < cfg->n_flow_tables; i++) {
+		free(cfg->flow_tables[i].groups);
+		free(cfg->flow_tables[i].spec);
+	}
+	free(cfg->flow_tables);
+	cfg->flow_tables = NULL;
+	cfg->n_flow_tables = 0;
+}
+
+/* Whether one of the mirrors of a bridge selects or outputs to a port */
+bool
+ovsd_config_mirrors_port(struct ovswitch_br_config *cfg, const char *port)
+{
+	struct ovsd_mirror *m;
+
+	for (int i = 0; i < cfg->n_mirrors; i++) {
+		m = &cfg->mirrors[i];
+		if (m->output_port && !strcmp(m->output_port, port))
+			return true;
+
+		for (int j = 0; j < m->n_select; j++)
+			if (!strcmp(m->select[j], port))
+				return true;
+	}
+
+	return false;
+}
+
+bool
+ovsd_config_is_bond_member(struct ovswitch_br_config *cfg, const char *iface)
+{
+	for (int i = 0; i < cfg->n_bond_members; i++)
+		if (!strcmp(cfg->bond_members[i], iface))
+			return true;
+
+	return false;
+}
@@ -0,0 +1,88 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_CONFIG_H
+#define __OVSD_CONFIG_H
+
+#include "ovsd.h"
+
+enum {
+	CREATPOL_BRIDGE,
+	CREATPOL_PARENT,
+	CREATPOL_VLAN,
+	CREATPOL_OFCONTROLLERS,
+	CREATPOL_FAILMODE,
+	CREATPOL_SSLPRIVKEY,
+	CREATPOL_SSLCERT,
+	CREATPOL_SSLCACERT,
+	CREATPOL_SSLBOOTSTRAP,
+	CREATPOL_FLOW_LIMIT,
+	CREATPOL_MAX_IDLE,
+	CREATPOL_N_HANDLERS,
+	CREATPOL_N_REVALIDATORS,
+	CREATPOL_DATAPATH_TYPE,
+	CREATPOL_PMD_CPU_MASK,
+	CREATPOL_N_RXQ,
+	CREATPOL_BOND,
+	CREATPOL_BOND_NAME,
+	CREATPOL_BOND_MODE,
+	CREATPOL_LACP,
+	CREATPOL_LACP_TIME,
+	CREATPOL_BOND_REBALANCE,
+	CREATPOL_SFLOW_TARGETS,
+	CREATPOL_SFLOW_SAMPLING,
+	CREATPOL_SFLOW_POLLING,
+	CREATPOL_SFLOW_HEADER,
+	CREATPOL_SFLOW_AGENT,
+	CREATPOL_IPFIX_TARGETS,
+	CREATPOL_IPFIX_SAMPLING,
+	CREATPOL_MIRRORS,
+	CREATPOL_INSTANCE,
+	CREATPOL_PATCH_PEERS,
+	CREATPOL_INACTIVITY_PROBE,
+	CREATPOL_MAX_BACKOFF,
+	CREATPOL_CTL_RATE_LIMIT,
+	CREATPOL_CTL_BURST_LIMIT,
+	CREATPOL_CONNECTION_MODE,
+	CREATPOL_FLOW_TABLES,
+	CREATPOL_MAC_TABLE_SIZE,
+	CREATPOL_MAC_AGING_TIME,
+	__CREATPOL_MAX
+};
+extern const struct blobmsg_policy create_policy[__CREATPOL_MAX];
+
+enum {
+	VLANPOL_TAG,
+	VLANPOL_TRUNKS,
+	VLANPOL_MODE,
+	__VLANPOL_MAX
+};
+extern const struct blobmsg_policy vlan_policy[__VLANPOL_MAX];
+
+enum ovsd_status ovsd_config_parse_vlan(void *data, size_t len,
+	struct ovsd_port_vlan *vlan);
+bool ovsd_config_has_vlan(struct ovsd_port_vlan *vlan);
+
+// true if any controller connection setting is given
+bool ovsd_config_has_controller_tuning(struct ovswitch_br_config *cfg);
+
+enum ovsd_status ovsd_config_parse(struct blob_attr *msg,
+	struct ovswitch_br_config *cfg);
+void ovsd_config_free(struct ovswitch_br_config *cfg);
+
+bool ovsd_config_is_bond_member(struct ovswitch_br_config *cfg,
+	const char *iface);
+bool ovsd_config_mirrors_port(struct ovswitch_br_config *cfg,
+	const char *port);
+
+#endif
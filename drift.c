@@ -0,0 +1,505 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "drift.h"
+#include "config.h"
+#include "info.h"
+#include "instance.h"
+#include "ovs.h"
+#include "ovs-shell.h"
+#include "patch.h"
+#include "sched.h"
+#include "state.h"
+
+// a round that finds requests queued is retried after this long
+#define DRIFT_BUSY_RETRY_MS 1000
+
+static unsigned int interval_s, budget_ms;
+static int next_instance;
+
+// statistics
+static uint64_t n_rounds;
+static uint64_t n_deferred;
+static uint64_t n_checked;
+static uint64_t n_drifted;
+static uint64_t n_repaired;
+static uint64_t n_failed;
+static uint64_t last_round_us;
+
+// actual state of one instance
+struct drift_actual {
+	struct ovs_tables tables;
+
+	// managed names: 0 unknown, 1 port, 2 fake bridge
+	uint8_t *managed;
+
+	// managed names found on the bridge at hand: 0 not found, else tag + 1
+	int *seen;
+	ovsd_name_t n_names;
+};
+
+#define DRIFT_MANAGED_PORT 1
+#define DRIFT_MANAGED_FAKE 2
+
+/* Sorted list of the items a digest is computed over */
+struct drift_items {
+	char **items;
+	int n;
+	int alloc;
+};
+
+static void
+_items_add(struct drift_items *l, const char *format, ...)
+{
+	char **items, *item;
+	va_list ap;
+	int len;
+
+	if (l->n == l->alloc) {
+		int alloc = l->alloc ? l->alloc * 2 : 16;
+
+		items = realloc(l->items, alloc * sizeof(*items));
+		if (!items)
+			return;
+
+		l->items = items;
+		l->alloc = alloc;
+	}
+
+	va_start(ap, format);
+	len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	if (len < 0 || !(item = malloc(len + 1)))
+		return;
+
+	va_start(ap, format);
+	vsnprintf(item, len + 1, format, ap);
+	va_end(ap);
+
+	l->items[l->n++] = item;
+}
+
+static void
+_items_free(struct drift_items *l)
+{
+	for (int i = 0; i < l->n; i++)
+		free(l->items[i]);
+	free(l->items);
+	memset(l, 0, sizeof(*l));
+}
+
+static int
+_cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// FNV-1a over the sorted items, like the tunnel configuration hash
+static uint32_t
+_items_digest(struct drift_items *l)
+{
+	uint32_t hash = 2166136261u;
+
+	qsort(l->items, l->n, sizeof(*l->items), _cmp_str);
+	for (int i = 0; i < l->n; i++) {
+		for (const char *c = l->items[i]; *c; c++)
+			hash = (hash ^ (uint8_t) *c) * 16777619u;
+		hash = (hash ^ 0xff) * 16777619u;
+	}
+
+	return hash;
+}
+
+static void
+_actual_free(struct drift_actual *a)
+{
+	ovs_tables_free(&a->tables);
+	free(a->managed);
+	free(a->seen);
+}
+
+static int
+_actual_load(struct drift_actual *a, struct ovsd_instance *inst)
+{
+	struct ovsd_bridge *br;
+	ovsd_name_t i;
+
+	memset(a, 0, sizeof(*a));
+
+	a->n_names = ovsd_name_max();
+	a->managed = calloc(a->n_names, sizeof(*a->managed));
+	a->seen = calloc(a->n_names, sizeof(*a->seen));
+	if (!a->managed || !a->seen)
+		return OVSD_EUNKNOWN;
+
+	ovsd_state_for_each_bridge(br, i) {
+		if (ovsd_instance_of(i) != inst)
+			continue;
+
+		if (br->parent)
+			a->managed[br->name] = DRIFT_MANAGED_FAKE;
+		for (unsigned int p = 0; p < br->n_ports; p++)
+			a->managed[br->ports[p]] = DRIFT_MANAGED_PORT;
+	}
+
+	return ovs_tables_load(&a->tables);
+}
+
+static void
+_desired_ports(struct ovsd_bridge *br, struct drift_items *l)
+{
+	for (unsigned int p = 0; p < br->n_ports; p++) {
+		if (ovsd_config_is_bond_member(&br->cfg,
+				ovsd_name_str(br->ports[p])))
+			continue;
+
+		_items_add(l, "p=%s", ovsd_name_str(br->ports[p]));
+	}
+}
+
+/* Items of what netifd asked for. Fake bridges and their ports live on the
+ * parent in the database, so they are part of the digest of the parent.
+ */
+static uint32_t
+_desired_digest(struct ovsd_bridge *br)
+{
+	struct drift_items l = { 0 };
+	struct ovsd_bridge *fake;
+	uint32_t digest;
+	ovsd_name_t i;
+
+	_desired_ports(br, &l);
+	if (br->cfg.n_bond_members)
+		_items_add(&l, "p=%s", br->cfg.bond_name);
+
+	ovsd_state_for_each_bridge(fake, i) {
+		if (fake->parent != br->name)
+			continue;
+
+		_items_add(&l, "p=%s:%u", fake->cfg.name, fake->cfg.vlan_tag);
+		_desired_ports(fake, &l);
+	}
+
+	for (int c = 0; c < br->cfg.n_ofcontrollers; c++)
+		_items_add(&l, "c=%s", br->cfg.ofcontrollers[c]);
+
+	if (br->cfg.n_ofcontrollers)
+		_items_add(&l, "f=%s", br->cfg.fail_mode == OVS_FAIL_MODE_SECURE ?
+			"secure" : "standalone");
+
+	digest = _items_digest(&l);
+	_items_free(&l);
+	return digest;
+}
+
+/* Items of what Open vSwitch has, limited to the ports ovsd manages. Marks
+ * the managed ports found on the bridge in seen.
+ */
+static uint32_t
+_actual_digest(struct drift_actual *a, const char *bridge)
+{
+	struct ovsd_bridge *br = ovsd_state_bridge(ovsd_name_lookup(bridge));
+	struct ovs_tables *t = &a->tables;
+	struct drift_items l = { 0 };
+	char *uuids, *tok, *save, *mode, *port;
+	ovsd_name_t name;
+	uint32_t digest;
+	int row, r;
+
+	memset(a->seen, 0, a->n_names * sizeof(*a->seen));
+
+	row = ovs_table_find(t, OVS_TABLE_BRIDGES, bridge);
+	if (row < 0) {
+		_items_add(&l, "missing");
+		goto out;
+	}
+
+	// tokenize copies, a bridge may be looked at again for its repair
+	uuids = strdup(ovs_table_col(t, OVS_TABLE_BRIDGES, row, BRCOL_PORTS));
+	for (tok = uuids ? strtok_r(uuids, " ", &save) : NULL; tok;
+			tok = strtok_r(NULL, " ", &save)) {
+		r = ovs_table_find(t, OVS_TABLE_PORTS, tok);
+		if (r < 0)
+			continue;
+
+		// the bond of the bridge is no port netifd knows by name
+		port = ovs_table_col(t, OVS_TABLE_PORTS, r, PORTCOL_NAME);
+		if (br && br->cfg.n_bond_members &&
+				!strcmp(port, br->cfg.bond_name)) {
+			_items_add(&l, "p=%s", port);
+			continue;
+		}
+
+		name = ovsd_name_lookup(port);
+		if (!name || name >= a->n_names || !a->managed[name])
+			continue;
+
+		a->seen[name] = 1 + atoi(ovs_table_col(t, OVS_TABLE_PORTS, r,
+			PORTCOL_TAG));
+		if (a->managed[name] == DRIFT_MANAGED_FAKE)
+			_items_add(&l, "p=%s:%d", ovsd_name_str(name),
+				a->seen[name] - 1);
+		else
+			_items_add(&l, "p=%s", ovsd_name_str(name));
+	}
+	free(uuids);
+
+	uuids = strdup(ovs_table_col(t, OVS_TABLE_BRIDGES, row,
+		BRCOL_CONTROLLER));
+	for (tok = uuids ? strtok_r(uuids, " ", &save) : NULL; tok;
+			tok = strtok_r(NULL, " ", &save)) {
+		r = ovs_table_find(t, OVS_TABLE_CONTROLLERS, tok);
+		if (r >= 0)
+			_items_add(&l, "c=%s", ovs_table_col(t,
+				OVS_TABLE_CONTROLLERS, r, CTLCOL_TARGET));
+	}
+	free(uuids);
+
+	mode = ovs_table_col(t, OVS_TABLE_BRIDGES, row, BRCOL_FAIL_MODE);
+	if (*mode)
+		_items_add(&l, "f=%s", mode);
+
+out:
+	digest = _items_digest(&l);
+	_items_free(&l);
+	return digest;
+}
+
+static void
+_repair_ports(struct ovs_txn *txn, struct drift_actual *a,
+	struct ovsd_bridge *br)
+{
+	const char *port;
+
+	for (unsigned int p = 0; p < br->n_ports; p++) {
+		port = ovsd_name_str(br->ports[p]);
+		if (a->seen[br->ports[p]] ||
+				ovsd_config_is_bond_member(&br->cfg, port))
+			continue;
+
+		// the port may have been moved to another bridge
+		ovs_txn_cmd(txn, ovs_cmd(MODIFIER_IF_EXISTS), ovs_cmd(CMD_DEL_PORT),
+			port, NULL);
+		ovs_shell_txn_add_port(txn, br->cfg.name, port, NULL);
+		ovs_shell_txn_set_rxq(txn, port, br->cfg.n_rxq, false);
+	}
+}
+
+/* Bring a drifted bridge and its fake bridges back in line. Only missing
+ * pieces are added, ports that are in place are not touched.
+ */
+static void
+_repair(struct ovs_txn *txn, struct drift_actual *a, struct ovsd_bridge *br)
+{
+	struct ovsd_bridge *fake;
+	ovsd_name_t i;
+
+	ovs_shell_txn_add_bridge(txn, &br->cfg);
+	if (!br->cfg.ofcontrollers) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_DEL_OFCTL), br->cfg.name, NULL);
+		ovs_txn_cmd(txn, ovs_cmd(CMD_DEL_FAIL_MODE), br->cfg.name, NULL);
+	}
+	_repair_ports(txn, a, br);
+
+	ovsd_state_for_each_bridge(fake, i) {
+		if (fake->parent != br->name)
+			continue;
+
+		if (!a->seen[fake->name])
+			ovs_shell_txn_add_bridge(txn, &fake->cfg);
+		else if (a->seen[fake->name] - 1 != fake->cfg.vlan_tag) {
+			ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Port", fake->cfg.name, NULL);
+			ovs_txn_argf(txn, "tag=%u", fake->cfg.vlan_tag);
+		}
+		_repair_ports(txn, a, fake);
+	}
+
+	if (br->cfg.n_mirrors && br->n_ports)
+		ovs_shell_txn_set_mirrors(txn, &br->cfg, br->ports, br->n_ports,
+			true);
+}
+
+/* Repair a single bridge, if repairing all drifted bridges at once failed.
+ * The drifted bridges in missing that were not repaired (yet) may be gone,
+ * so they are not linked with.
+ */
+static int
+_repair_one(struct drift_actual *a, struct ovsd_bridge *br,
+	ovsd_name_t *missing, int n)
+{
+	struct ovs_txn txn;
+	int ret;
+
+	_actual_digest(a, br->cfg.name);
+
+	ovs_txn_init(&txn);
+	_repair(&txn, a, br);
+	ovs_patch_txn_link_except(&txn, &br->cfg, missing, n);
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	if (ret) {
+		ovsd_log_msg(L_WARNING, "%s: repair failed: %s\n", br->cfg.name,
+			ovs_strerror(ret));
+		n_failed++;
+	} else {
+		n_repaired++;
+	}
+
+	return ret;
+}
+
+static int
+_drift_check_instance(struct ovsd_instance *inst)
+{
+	struct drift_actual a;
+	struct ovsd_bridge *br;
+	struct ovs_txn txn;
+	ovsd_name_t i, *drifted = NULL;
+	int ret, n = 0;
+
+	ret = _actual_load(&a, inst);
+	if (ret)
+		goto out;
+
+	drifted = calloc(a.n_names, sizeof(*drifted));
+	if (!drifted) {
+		ret = OVSD_EUNKNOWN;
+		goto out;
+	}
+
+	ovs_txn_init(&txn);
+	ovsd_state_for_each_bridge(br, i) {
+		if (br->parent || ovsd_instance_of(i) != inst)
+			continue;
+
+		n_checked++;
+		if (_desired_digest(br) == _actual_digest(&a, br->cfg.name))
+			continue;
+
+		ovsd_log_msg(L_NOTICE, "%s: drifted from the configuration, "
+			"repairing\n", br->cfg.name);
+		n_drifted++;
+		drifted[n++] = i;
+		_repair(&txn, &a, br);
+		ovsd_info_changed(i);
+	}
+
+	// patch ports are not part of the digest, re-added bridges need them.
+	// They are linked once all drifted bridges are back.
+	for (int d = 0; d < n; d++)
+		ovs_patch_txn_link(&txn, &ovsd_state_bridge(drifted[d])->cfg);
+
+	if (n) {
+		ret = ovs_txn_commit(&txn);
+		if (!ret) {
+			n_repaired += n;
+		} else if (!ovs_shell_timed_out()) {
+			// repaired bridges drop out of the missing ones
+			for (int d = 0; d < n; d++) {
+				br = ovsd_state_bridge(drifted[d]);
+				if (!_repair_one(&a, br, drifted, n))
+					drifted[d] = OVSD_NAME_NONE;
+			}
+		} else {
+			n_failed += n;
+		}
+	}
+	ovs_txn_free(&txn);
+
+out:
+	free(drifted);
+	_actual_free(&a);
+	return ret;
+}
+
+static void
+drift_round_cb(struct uloop_timeout *t)
+{
+	struct ovsd_instance *inst;
+	uint64_t start = ovsd_now_us();
+
+	// low priority: requests go first
+	if (!ovsd_sched_idle()) {
+		n_deferred++;
+		uloop_timeout_set(t, DRIFT_BUSY_RETRY_MS);
+		return;
+	}
+
+	n_rounds++;
+	ovs_shell_set_deadline(start + budget_ms * 1000ULL);
+
+	// an instance left over by a round that ran out of time goes first
+	while ((inst = ovsd_instance_get(next_instance))) {
+		if (ovsd_instance_available(inst)) {
+			ovsd_instance_select(inst);
+			_drift_check_instance(inst);
+			ovsd_instance_select(NULL);
+		}
+
+		if (ovs_shell_timed_out())
+			break;
+		next_instance++;
+	}
+
+	if (!inst)
+		next_instance = 0;
+
+	ovs_shell_set_deadline(0);
+	last_round_us = ovsd_now_us() - start;
+
+	uloop_timeout_set(t, interval_s * 1000);
+}
+
+static struct uloop_timeout drift_timer = {
+	.cb = drift_round_cb,
+};
+
+void
+ovsd_drift_init(unsigned int interval, unsigned int budget)
+{
+	interval_s = interval;
+	budget_ms = budget;
+	if (interval_s)
+		uloop_timeout_set(&drift_timer, interval_s * 1000);
+}
+
+void
+ovsd_drift_done(void)
+{
+	uloop_timeout_cancel(&drift_timer);
+}
+
+void
+ovsd_drift_dump(struct blob_buf *buf)
+{
+	void *tbl;
+
+	tbl = blobmsg_open_table(buf, "drift");
+	blobmsg_add_u32(buf, "interval", interval_s);
+	blobmsg_add_u32(buf, "budget_ms", budget_ms);
+	blobmsg_add_u64(buf, "rounds", n_rounds);
+	blobmsg_add_u64(buf, "deferred", n_deferred);
+	blobmsg_add_u64(buf, "checked", n_checked);
+	blobmsg_add_u64(buf, "drifted", n_drifted);
+	blobmsg_add_u64(buf, "repaired", n_repaired);
+	blobmsg_add_u64(buf, "failed", n_failed);
+	blobmsg_add_u64(buf, "last_round_us", last_round_us);
+	blobmsg_close_table(buf, tbl);
+}
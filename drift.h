@@ -0,0 +1,32 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_DRIFT_H
+#define __OVSD_DRIFT_H
+
+#include "ovsd.h"
+
+#define OVSD_DRIFT_INTERVAL_S 60
+#define OVSD_DRIFT_BUDGET_MS 500
+
+/* Periodically compare a digest of the ports, controllers, fail mode and
+ * fake bridge VLANs of every bridge with what Open vSwitch actually has, and
+ * repair the bridges that drifted. A round runs when no requests are queued
+ * and may take budget_ms at most. An interval of 0 disables it.
+ */
+void ovsd_drift_init(unsigned int interval_s, unsigned int budget_ms);
+void ovsd_drift_done(void);
+
+void ovsd_drift_dump(struct blob_buf *buf);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dump.h"
+#include "instance.h"
+#include "ovs.h"
+#include "ovs-shell.h"
+#include "state.h"
+
+// state of a dump across instances and chunks
+struct dump_ctx {
+	struct blob_buf *buf;
+	ovsd_dump_flush_cb flush;
+	void *priv;
+
+	void *bridges;
+	unsigned int chunk;
+};
+
+/* Call cb for every port of the bridge in the given row with its name and
+ * tag, -1 if it has none. Stops at the first non-zero return.
+ */
+static int
+_dump_for_each_port(struct ovs_tables *tables, int row,
+	int (*cb)(const char *name, int tag, void *priv), void *priv)
+{
+	char *uuids, *tok, *save, *tag;
+	int r, ret = 0;
+
+	uuids = strdup(ovs_table_col(tables, OVS_TABLE_BRIDGES, row,
+		BRCOL_PORTS));
+	for (tok = uuids ? strtok_r(uuids, " ", &save) : NULL; tok && !ret;
+			tok = strtok_r(NULL, " ", &save)) {
+		r = ovs_table_find(tables, OVS_TABLE_PORTS, tok);
+		if (r < 0)
+			continue;
+
+		tag = ovs_table_col(tables, OVS_TABLE_PORTS, r, PORTCOL_TAG);
+		ret = cb(ovs_table_col(tables, OVS_TABLE_PORTS, r,
+			PORTCOL_NAME), *tag ? atoi(tag) : -1, priv);
+	}
+	free(uuids);
+
+	return ret;
+}
+
+struct dump_ports {
+	struct ovsd_bridge *br;
+	struct ovsd_bridge *parent;
+	int vlan;
+
+	// fake bridges of a real bridge, their ports are not its own
+	struct ovsd_bridge **fakes;
+	int n_fakes;
+
+	struct blob_buf *buf;
+};
+
+static int
+_dump_port(const char *name, int tag, void *priv)
+{
+	struct dump_ports *p = priv;
+
+	// the local port carries the name of the bridge
+	if (!strcmp(name, p->parent->cfg.name) || !strcmp(name, p->br->cfg.name))
+		return 0;
+
+	if (p->br != p->parent && tag != p->vlan)
+		return 0;
+
+	for (int i = 0; i < p->n_fakes; i++)
+		if (!strcmp(name, p->fakes[i]->cfg.name) ||
+				tag == p->fakes[i]->cfg.vlan_tag)
+			return 0;
+
+	blobmsg_add_string(p->buf, NULL, name);
+	return 0;
+}
+
+/* Add the ports of a bridge. The ports of a fake bridge are the ports of its
+ * parent with its VLAN, like 'ovs-vsctl list-ports' has it.
+ */
+static void
+_dump_ports(struct ovs_tables *tables, int row, struct ovsd_bridge *br,
+	struct ovsd_bridge *parent, int vlan, struct blob_buf *buf)
+{
+	struct ovsd_bridge *fakes[ovsd_state_max()], *fake;
+	struct dump_ports p = {
+		.br = br,
+		.parent = parent,
+		.vlan = vlan,
+		.fakes = fakes,
+		.buf = buf,
+	};
+	ovsd_name_t i;
+	void *arr;
+
+	if (br == parent)
+		ovsd_state_for_each_bridge(fake, i)
+			if (fake->parent == br->name)
+				fakes[p.n_fakes++] = fake;
+
+	arr = blobmsg_open_array(buf, "ports");
+	_dump_for_each_port(tables, row, _dump_port, &p);
+	blobmsg_close_array(buf, arr);
+}
+
+struct dump_fake {
+	const char *name;
+	int tag;
+};
+
+static int
+_dump_find_fake(const char *name, int tag, void *priv)
+{
+	struct dump_fake *f = priv;
+
+	if (strcmp(name, f->name))
+		return 0;
+
+	f->tag = tag;
+	return 1;
+}
+
+static void
+_dump_bridge(struct ovs_tables *tables, struct ovsd_bridge *br,
+	struct blob_buf *buf)
+{
+	struct ovsd_bridge *parent = br;
+	char *uuids, *tok, *save, *fail_mode;
+	int row, r, vlan = -1;
+	void *tbl, *arr;
+
+	tbl = blobmsg_open_table(buf, br->cfg.name);
+	if (!ovsd_instance_is_local())
+		blobmsg_add_string(buf, "instance", ovsd_instance_current()->name);
+
+	if (br->parent) {
+		parent = ovsd_state_bridge(br->parent);
+		blobmsg_add_string(buf, "parent", ovsd_name_str(br->parent));
+	}
+
+	row = parent ? ovs_table_find(tables, OVS_TABLE_BRIDGES,
+		parent->cfg.name) : -1;
+
+	// a fake bridge is a port with its VLAN on the parent
+	if (row >= 0 && br != parent) {
+		struct dump_fake f = { .name = br->cfg.name };
+
+		if (_dump_for_each_port(tables, row, _dump_find_fake, &f))
+			vlan = f.tag;
+		else
+			row = -1;
+	}
+
+	if (row < 0) {
+		blobmsg_add_u8(buf, "missing", true);
+		blobmsg_close_table(buf, tbl);
+		return;
+	}
+
+	if (vlan > 0)
+		blobmsg_add_u32(buf, "vlan", vlan);
+
+	arr = blobmsg_open_array(buf, "ofcontrollers");
+	uuids = strdup(ovs_table_col(tables, OVS_TABLE_BRIDGES, row,
+		BRCOL_CONTROLLER));
+	for (tok = uuids ? strtok_r(uuids, " ", &save) : NULL; tok;
+			tok = strtok_r(NULL, " ", &save)) {
+		r = ovs_table_find(tables, OVS_TABLE_CONTROLLERS, tok);
+		if (r >= 0)
+			blobmsg_add_string(buf, NULL, ovs_table_col(tables,
+				OVS_TABLE_CONTROLLERS, r, CTLCOL_TARGET));
+	}
+	free(uuids);
+	blobmsg_close_array(buf, arr);
+
+	fail_mode = ovs_table_col(tables, OVS_TABLE_BRIDGES, row,
+		BRCOL_FAIL_MODE);
+	if (*fail_mode)
+		blobmsg_add_string(buf, "fail_mode", fail_mode);
+
+	_dump_ports(tables, row, br, parent, vlan, buf);
+
+	blobmsg_close_table(buf, tbl);
+}
+
+static void
+_dump_flush(struct dump_ctx *d, bool last)
+{
+	blobmsg_close_table(d->buf, d->bridges);
+	blobmsg_add_u32(d->buf, "chunk", d->chunk++);
+	blobmsg_add_u8(d->buf, "last", last);
+	d->flush(d->buf, d->priv);
+	if (last)
+		return;
+
+	blob_buf_init(d->buf, 0);
+	d->bridges = blobmsg_open_table(d->buf, "bridges");
+}
+
+static void
+_dump_instance(struct dump_ctx *d, struct ovsd_instance *inst)
+{
+	struct ovs_tables tables;
+	struct ovsd_bridge *br;
+	ovsd_name_t i;
+	void *tbl;
+	int ret;
+
+	ovsd_instance_select(inst);
+	ret = ovs_tables_load(&tables);
+
+	// parents before their fake bridges
+	for (int fake = 0; fake < 2; fake++) {
+		ovsd_state_for_each_bridge(br, i) {
+			if (!br->parent != !fake || ovsd_instance_of(i) != inst)
+				continue;
+
+			if (ret) {
+				tbl = blobmsg_open_table(d->buf, br->cfg.name);
+				blobmsg_add_string(d->buf, "error", ovs_strerror(ret));
+				blobmsg_close_table(d->buf, tbl);
+			} else {
+				_dump_bridge(&tables, br, d->buf);
+			}
+
+			if (blob_len(d->buf->head) >= OVSD_DUMP_CHUNK_SIZE)
+				_dump_flush(d, false);
+		}
+	}
+
+	ovs_tables_free(&tables);
+	ovsd_instance_select(NULL);
+}
+
+int
+ovsd_dump_all(struct blob_buf *buf, ovsd_dump_flush_cb flush, void *priv)
+{
+	struct dump_ctx d = {
+		.buf = buf,
+		.flush = flush,
+		.priv = priv,
+	};
+	struct ovsd_instance *inst;
+
+	blob_buf_init(buf, 0);
+	d.bridges = blobmsg_open_table(buf, "bridges");
+
+	for (int i = 0; (inst = ovsd_instance_get(i)); i++)
+		_dump_instance(&d, inst);
+
+	_dump_flush(&d, true);
+	return OVSD_OK;
+}
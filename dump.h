@@ -0,0 +1,32 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_DUMP_H
+#define __OVSD_DUMP_H
+
+#include "ovsd.h"
+
+// a reply chunk is sent once it grows beyond this many bytes
+#define OVSD_DUMP_CHUNK_SIZE (64 * 1024)
+
+/* Called with every chunk of a dump, buf is re-initialized afterwards */
+typedef void (*ovsd_dump_flush_cb)(struct blob_buf *buf, void *priv);
+
+/* Dump ports, parent and VLAN, controllers and fail mode of every bridge
+ * ovsd manages. Each instance is read with a single ovs-vsctl call. The
+ * bridges are added to buf and handed to flush in chunks of about
+ * OVSD_DUMP_CHUNK_SIZE bytes, the last chunk has "last" set.
+ */
+int ovsd_dump_all(struct blob_buf *buf, ovsd_dump_flush_cb flush, void *priv);
+
+#endif
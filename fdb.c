@@ -0,0 +1,458 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/if.h>
+
+#include "fdb.h"
+#include "names.h"
+#include "ovs-shell.h"
+
+// fdb/show prints about 40 bytes per entry, enough for 100k entries
+#define FDB_OUTPUT_MAXSIZE (4 * 1024 * 1024)
+#define FDB_STATS_MAXSIZE 1024
+#define FDB_IFACES_MAXSIZE (64 * 1024)
+
+struct fdb_entry {
+	char mac[18];
+	uint16_t vlan;
+	char port[IFNAMSIZ];
+
+	// seconds since the MAC was last seen, -1 for static entries
+	int age;
+};
+
+/* Counters of 'ovs-appctl fdb/stats-show', -1 if not reported (Open vSwitch
+ * before 2.10). The counters cover the whole table of the parent of a fake
+ * bridge.
+ */
+enum {
+	FDB_STAT_CURRENT,
+	FDB_STAT_MAX,
+	FDB_STAT_STATIC,
+	FDB_STAT_LEARNED,
+	FDB_STAT_EXPIRED,
+	FDB_STAT_EVICTED,
+	FDB_STAT_MOVED,
+	__FDB_STAT_MAX
+};
+
+static const struct {
+	const char *label;
+	const char *name;
+} fdb_stats[__FDB_STAT_MAX] = {
+	[FDB_STAT_CURRENT] = { "Current/maximum MAC entries", "current" },
+	[FDB_STAT_MAX] = { NULL, "max" },
+	[FDB_STAT_STATIC] = { "Current static MAC entries", "static" },
+	[FDB_STAT_LEARNED] = { "Total number of learned", "learned" },
+	[FDB_STAT_EXPIRED] = { "Total number of expired", "expired" },
+	[FDB_STAT_EVICTED] = { "Total number of evicted", "evicted" },
+	[FDB_STAT_MOVED] = { "Total number of port moved", "moved" },
+};
+
+struct fdb_snapshot {
+	uint32_t id;
+	ovsd_name_t bridge;
+	uint64_t taken_us;
+	uint64_t used_us;
+	bool truncated;
+
+	struct fdb_entry *entries;
+	unsigned int n_entries;
+	unsigned int alloc;
+
+	long long stats[__FDB_STAT_MAX];
+};
+
+static struct fdb_snapshot *snapshots[OVSD_FDB_SNAPSHOTS_MAX];
+static uint32_t last_id;
+
+static void _fdb_sweep_cb(struct uloop_timeout *t);
+static struct uloop_timeout fdb_sweep = { .cb = _fdb_sweep_cb };
+
+static void
+_fdb_free(int slot)
+{
+	ovsd_name_put(snapshots[slot]->bridge);
+	free(snapshots[slot]->entries);
+	free(snapshots[slot]);
+	snapshots[slot] = NULL;
+}
+
+/* Drop the snapshots that were not used for a while */
+static void
+_fdb_sweep_cb(struct uloop_timeout *t)
+{
+	uint64_t now = ovsd_now_us();
+	bool left = false;
+
+	for (int i = 0; i < OVSD_FDB_SNAPSHOTS_MAX; i++) {
+		if (!snapshots[i])
+			continue;
+
+		if (now - snapshots[i]->used_us >= OVSD_FDB_SNAPSHOT_TTL_MS * 1000ULL)
+			_fdb_free(i);
+		else
+			left = true;
+	}
+
+	if (left)
+		uloop_timeout_set(&fdb_sweep, OVSD_FDB_SNAPSHOT_TTL_MS);
+}
+
+static int
+_appctl(char *cmd, char *bridge, char *out, size_t len)
+{
+	char * const argv[] = { OVS_APPCTL, cmd, bridge, NULL };
+
+	return ovs_vsctl_output(argv, out, len);
+}
+
+/* fdb/show prints OpenFlow port numbers, which are only unique within a
+ * bridge. Look up the names of the interfaces of the bridge the table belongs
+ * to and their numbers, then map the entries. Ports not found keep their
+ * number, e.g. LOCAL.
+ */
+static void
+_fdb_port_names(struct fdb_snapshot *s, char *bridge)
+{
+	char * const argv[] = { OVS_VSCTL, ovs_cmd(CMD_LIST_IFACES), bridge,
+		NULL };
+	char *names, *ofports = NULL, *line, *save, *end;
+	const char **by_ofport = NULL, **iface = NULL;
+	int n = 0, max = 0, *ofport = NULL;
+	struct ovs_txn txn;
+	long port;
+
+	names = malloc(FDB_IFACES_MAXSIZE);
+	if (!names)
+		return;
+
+	if (ovs_vsctl_output(argv, names, FDB_IFACES_MAXSIZE))
+		goto out;
+
+	for (line = names; (line = strchr(line, '\n')); line++)
+		n++;
+	iface = calloc(n + 1, sizeof(*iface));
+	ofport = calloc(n + 1, sizeof(*ofport));
+	ofports = malloc(FDB_IFACES_MAXSIZE);
+	if (!iface || !ofport || !ofports)
+		goto out;
+
+	// one get per interface, each prints a line in the same order
+	n = 0;
+	ovs_txn_init(&txn);
+	for (line = strtok_r(names, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		ovs_txn_cmd(&txn, ovs_cmd(CMD_GET), "Interface", line, "ofport",
+			NULL);
+		iface[n++] = line;
+	}
+
+	if (!n || txn.error ||
+			ovs_vsctl_output(txn.argv, ofports, FDB_IFACES_MAXSIZE)) {
+		ovs_txn_free(&txn);
+		goto out;
+	}
+	ovs_txn_free(&txn);
+
+	line = strtok_r(ofports, "\n", &save);
+	for (int i = 0; i < n && line; i++) {
+		ofport[i] = atoi(line);
+		if (ofport[i] > max)
+			max = ofport[i];
+		line = strtok_r(NULL, "\n", &save);
+	}
+
+	by_ofport = calloc(max + 1, sizeof(*by_ofport));
+	if (!by_ofport)
+		goto out;
+
+	for (int i = 0; i < n; i++)
+		if (ofport[i] > 0)
+			by_ofport[ofport[i]] = iface[i];
+
+	for (unsigned int i = 0; i < s->n_entries; i++) {
+		port = strtol(s->entries[i].port, &end, 10);
+		if (*end || port <= 0 || port > max || !by_ofport[port])
+			continue;
+
+		snprintf(s->entries[i].port, IFNAMSIZ, "%s", by_ofport[port]);
+	}
+
+out:
+	free(by_ofport);
+	free(iface);
+	free(ofport);
+	free(ofports);
+	free(names);
+}
+
+/* Parse 'ovs-appctl fdb/show', e.g.
+ *
+ *    port  VLAN  MAC                Age
+ *       1     0  52:54:00:12:34:56    3
+ *   LOCAL    10  52:54:00:ab:cd:ef  static
+ *
+ * Only entries of the given VLAN are kept if it is not negative.
+ */
+static int
+_fdb_parse_show(struct fdb_snapshot *s, char *out, int vlan)
+{
+	struct fdb_entry e, *entries;
+	char *line, *save, age[16];
+	unsigned int alloc;
+	int v;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (sscanf(line, "%15s %d %17s %15s", e.port, &v, e.mac, age) != 4)
+			continue;
+
+		if (vlan >= 0 && v != vlan)
+			continue;
+
+		e.vlan = v;
+		e.age = strcmp(age, "static") ? atoi(age) : -1;
+
+		if (s->n_entries == s->alloc) {
+			alloc = s->alloc ? s->alloc * 2 : 256;
+			entries = realloc(s->entries, alloc * sizeof(*entries));
+			if (!entries)
+				return OVSD_EUNKNOWN;
+
+			s->entries = entries;
+			s->alloc = alloc;
+		}
+
+		s->entries[s->n_entries++] = e;
+	}
+
+	return OVSD_OK;
+}
+
+/* Parse 'ovs-appctl fdb/stats-show', e.g.
+ *
+ *   Current/maximum MAC entries in the table: 4/8192
+ *   Total number of evicted MAC entries     : 0
+ */
+static void
+_fdb_parse_stats(struct fdb_snapshot *s, char *out)
+{
+	char *line, *save, *val;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		line += strspn(line, "\t ");
+		val = strchr(line, ':');
+		if (!val)
+			continue;
+
+		for (int i = 0; i < __FDB_STAT_MAX; i++) {
+			if (!fdb_stats[i].label || strncmp(line, fdb_stats[i].label,
+					strlen(fdb_stats[i].label)))
+				continue;
+
+			if (i == FDB_STAT_CURRENT)
+				sscanf(val + 1, "%lld/%lld", &s->stats[FDB_STAT_CURRENT],
+					&s->stats[FDB_STAT_MAX]);
+			else
+				sscanf(val + 1, "%lld", &s->stats[i]);
+		}
+	}
+}
+
+/* Read the table of a bridge, of the parent and filtered by VLAN for a fake
+ * bridge, into a new snapshot. The least recently used one is replaced if
+ * all slots are taken.
+ */
+static int
+_fdb_take(char *bridge, struct fdb_snapshot **snapshot)
+{
+	struct fdb_snapshot *s;
+	ovsd_name_t name, parent;
+	char *out, *table, *cut;
+	int slot = 0, vlan = -1, ret;
+
+	if (!ovs_shell_br_exists(bridge))
+		return OVSD_ENOEXIST;
+
+	name = ovsd_name_get(bridge);
+	parent = ovs_shell_br_to_parent(bridge);
+	table = bridge;
+	if (parent && parent != name) {
+		table = (char *) ovsd_name_str(parent);
+		vlan = ovs_shell_br_to_vlan(bridge);
+	}
+
+	s = calloc(1, sizeof(*s));
+	out = malloc(FDB_OUTPUT_MAXSIZE);
+	if (!s || !out) {
+		ret = OVSD_EUNKNOWN;
+		goto error;
+	}
+
+	for (int i = 0; i < __FDB_STAT_MAX; i++)
+		s->stats[i] = -1;
+
+	if (_appctl("fdb/show", table, out, FDB_OUTPUT_MAXSIZE)) {
+		ret = OVSD_ENOEXIST;
+		goto error;
+	}
+
+	// the last line may be cut off, everything before it is complete
+	s->truncated = strlen(out) == FDB_OUTPUT_MAXSIZE - 1;
+	if (s->truncated) {
+		ovsd_log_msg(L_WARNING, "%s: MAC table too large, snapshot "
+			"truncated\n", bridge);
+		if ((cut = strrchr(out, '\n')))
+			*cut = '\0';
+	}
+
+	if ((ret = _fdb_parse_show(s, out, vlan)))
+		goto error;
+
+	// only Open vSwitch 2.10 and later keep these counters
+	if (!_appctl("fdb/stats-show", table, out, FDB_STATS_MAXSIZE))
+		_fdb_parse_stats(s, out);
+	free(out);
+
+	_fdb_port_names(s, table);
+
+	for (int i = 0; i < OVSD_FDB_SNAPSHOTS_MAX; i++) {
+		if (!snapshots[i]) {
+			slot = i;
+			break;
+		}
+		if (snapshots[i]->used_us < snapshots[slot]->used_us)
+			slot = i;
+	}
+	if (snapshots[slot])
+		_fdb_free(slot);
+
+	s->id = ++last_id;
+	s->bridge = name;
+	s->taken_us = ovsd_now_us();
+	snapshots[slot] = s;
+	*snapshot = s;
+
+	ovsd_name_put(parent);
+	return OVSD_OK;
+
+error:
+	if (s)
+		free(s->entries);
+	free(s);
+	free(out);
+	ovsd_name_put(parent);
+	ovsd_name_put(name);
+	return ret;
+}
+
+static struct fdb_snapshot *
+_fdb_find(char *bridge, uint32_t id)
+{
+	for (int i = 0; i < OVSD_FDB_SNAPSHOTS_MAX; i++)
+		if (snapshots[i] && snapshots[i]->id == id &&
+				snapshots[i]->bridge == ovsd_name_lookup(bridge))
+			return snapshots[i];
+
+	return NULL;
+}
+
+int
+ovsd_fdb_dump(char *bridge, const char *cursor, unsigned int limit,
+	struct blob_buf *buf)
+{
+	struct fdb_snapshot *s;
+	struct fdb_entry *e;
+	unsigned int offset = 0, end;
+	uint32_t id;
+	void *arr, *tbl;
+	int n, ret;
+
+	if (!bridge)
+		return OVSD_EINVALID_ARG;
+
+	if (!limit || limit > OVSD_FDB_PAGE_MAX)
+		limit = limit ? OVSD_FDB_PAGE_MAX : OVSD_FDB_PAGE_DEFAULT;
+
+	if (cursor) {
+		if (sscanf(cursor, "%u:%u%n", &id, &offset, &n) != 2 || cursor[n])
+			return OVSD_EINVALID_ARG;
+
+		s = _fdb_find(bridge, id);
+		if (!s)
+			return OVSD_ENOEXIST;
+	} else if ((ret = _fdb_take(bridge, &s))) {
+		return ret;
+	}
+
+	s->used_us = ovsd_now_us();
+	uloop_timeout_set(&fdb_sweep, OVSD_FDB_SNAPSHOT_TTL_MS);
+
+	if (offset > s->n_entries)
+		offset = s->n_entries;
+	end = s->n_entries - offset > limit ? offset + limit : s->n_entries;
+
+	blobmsg_add_u32(buf, "total", s->n_entries);
+	blobmsg_add_u32(buf, "snapshot_age",
+		(s->used_us - s->taken_us) / 1000000);
+	if (s->truncated)
+		blobmsg_add_u8(buf, "truncated", true);
+
+	tbl = blobmsg_open_table(buf, "stats");
+	for (int i = 0; i < __FDB_STAT_MAX; i++)
+		if (s->stats[i] >= 0)
+			blobmsg_add_u64(buf, fdb_stats[i].name, s->stats[i]);
+	if (s->stats[FDB_STAT_MAX] > 0)
+		blobmsg_add_u32(buf, "usage",
+			s->stats[FDB_STAT_CURRENT] * 100 / s->stats[FDB_STAT_MAX]);
+	blobmsg_close_table(buf, tbl);
+
+	arr = blobmsg_open_array(buf, "entries");
+	for (unsigned int i = offset; i < end; i++) {
+		e = &s->entries[i];
+		tbl = blobmsg_open_table(buf, NULL);
+		blobmsg_add_string(buf, "mac", e->mac);
+		blobmsg_add_u32(buf, "vlan", e->vlan);
+		blobmsg_add_string(buf, "port", e->port);
+		if (e->age < 0)
+			blobmsg_add_u8(buf, "static", true);
+		else
+			blobmsg_add_u32(buf, "age", e->age);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_array(buf, arr);
+
+	if (end < s->n_entries) {
+		char next[24];
+
+		snprintf(next, sizeof(next), "%u:%u", s->id, end);
+		blobmsg_add_string(buf, "cursor", next);
+	}
+
+	return OVSD_OK;
+}
+
+void
+ovsd_fdb_done(void)
+{
+	uloop_timeout_cancel(&fdb_sweep);
+
+	for (int i = 0; i < OVSD_FDB_SNAPSHOTS_MAX; i++)
+		if (snapshots[i])
+			_fdb_free(i);
+}
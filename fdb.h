@@ -0,0 +1,38 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_FDB_H
+#define __OVSD_FDB_H
+
+#include "ovsd.h"
+
+// a snapshot not paged through for this long is dropped
+#define OVSD_FDB_SNAPSHOT_TTL_MS 30000
+#define OVSD_FDB_SNAPSHOTS_MAX 4
+
+// entries per page if the caller does not ask for fewer, and the most
+#define OVSD_FDB_PAGE_DEFAULT 256
+#define OVSD_FDB_PAGE_MAX 1024
+
+/* Add a page of up to limit entries of the MAC learning table of a bridge
+ * (MAC, VLAN, port, age) and its occupancy, eviction and move counters to
+ * buf. Without a cursor, a new snapshot of the table is taken. The cursor
+ * added to buf pages through the same snapshot, it is missing on the last
+ * page. A cursor of a dropped snapshot is ENOEXIST.
+ */
+int ovsd_fdb_dump(char *bridge, const char *cursor, unsigned int limit,
+	struct blob_buf *buf);
+
+void ovsd_fdb_done(void);
+
+#endif
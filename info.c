@@ -0,0 +1,174 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "info.h"
+#include "ovs.h"
+
+/* Cached dump_info reply of a bridge. A generation is only ever handed out
+ * once, so a caller holding the generation of a dropped reply can never be
+ * told it is unchanged.
+ */
+struct info_cache {
+	ovsd_name_t name;
+	uint32_t generation;
+	uint64_t built_us;
+	struct blob_attr *reply;
+};
+
+// cache entries indexed by name handle
+static struct info_cache **cache;
+static ovsd_name_t n_cache;
+
+static uint32_t last_generation;
+static struct blob_buf ibuf;
+
+static void
+_cache_free(struct info_cache *c)
+{
+	ovsd_name_put(c->name);
+	free(c->reply);
+	free(c);
+}
+
+static struct info_cache *
+_cache_get(const char *bridge)
+{
+	struct info_cache **p;
+	ovsd_name_t name = ovsd_name_lookup(bridge), n;
+
+	if (name && name < n_cache && cache[name])
+		return cache[name];
+
+	name = ovsd_name_get(bridge);
+	n = ovsd_name_max();
+	if (name >= n_cache) {
+		p = realloc(cache, n * sizeof(*p));
+		if (!p)
+			goto error;
+
+		memset(p + n_cache, 0, (n - n_cache) * sizeof(*p));
+		cache = p;
+		n_cache = n;
+	}
+
+	cache[name] = calloc(1, sizeof(**cache));
+	if (!cache[name])
+		goto error;
+
+	cache[name]->name = name;
+	return cache[name];
+
+error:
+	ovsd_name_put(name);
+	return NULL;
+}
+
+/* Rebuild the reply of a bridge. The generation only moves if the reply is
+ * different from the cached one.
+ */
+static int
+_cache_refresh(struct info_cache *c, char *bridge, uint64_t now)
+{
+	struct blob_attr *reply;
+	int ret;
+
+	blob_buf_init(&ibuf, 0);
+	ret = ovs_dump_info(&ibuf, bridge);
+	if (ret)
+		return ret;
+
+	c->built_us = now;
+	if (c->reply && blob_attr_equal(c->reply, ibuf.head))
+		return OVSD_OK;
+
+	reply = blob_memdup(ibuf.head);
+	if (!reply)
+		return OVSD_EUNKNOWN;
+
+	free(c->reply);
+	c->reply = reply;
+	c->generation = ++last_generation;
+	return OVSD_OK;
+}
+
+int
+ovsd_info_dump(char *bridge, uint32_t known, struct blob_buf *buf)
+{
+	struct info_cache *c;
+	uint64_t now = ovsd_now_us();
+	int ret;
+
+	if (!bridge)
+		return ovs_dump_info(buf, NULL);
+
+	c = _cache_get(bridge);
+	if (!c)
+		return ovs_dump_info(buf, bridge);
+
+	if (!c->reply || now - c->built_us >= OVSD_INFO_MAX_AGE_MS * 1000ULL) {
+		ret = _cache_refresh(c, bridge, now);
+		if (ret) {
+			// nothing worth keeping for a bridge that is gone
+			ovsd_info_changed(c->name);
+			blob_put_raw(buf, blob_data(ibuf.head), blob_len(ibuf.head));
+			return ret;
+		}
+	}
+
+	if (known && known == c->generation)
+		blobmsg_add_u8(buf, "unchanged", true);
+	else
+		blob_put_raw(buf, blob_data(c->reply), blob_len(c->reply));
+
+	blobmsg_add_u32(buf, "generation", c->generation);
+	return OVSD_OK;
+}
+
+void
+ovsd_info_changed(ovsd_name_t bridge)
+{
+	if (bridge >= n_cache || !cache[bridge])
+		return;
+
+	_cache_free(cache[bridge]);
+	cache[bridge] = NULL;
+}
+
+void
+ovsd_info_done(void)
+{
+	for (ovsd_name_t i = 0; i < n_cache; i++)
+		if (cache[i])
+			_cache_free(cache[i]);
+
+	free(cache);
+	cache = NULL;
+	n_cache = 0;
+	blob_buf_free(&ibuf);
+}
+
+uint32_t
+ovsd_info_generation(void)
+{
+	return last_generation;
+}
+
+void
+ovsd_info_resume(uint32_t generation)
+{
+	if (generation > last_generation)
+		last_generation = generation;
+}
@@ -0,0 +1,40 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_INFO_H
+#define __OVSD_INFO_H
+
+#include "ovsd.h"
+#include "names.h"
+
+// cached replies are rebuilt at most this often to notice outside changes
+#define OVSD_INFO_MAX_AGE_MS 10000
+
+/* Add the dump_info reply for bridge and its generation to buf. If the
+ * caller already holds the current generation in known, only the generation
+ * and "unchanged" are added.
+ */
+int ovsd_info_dump(char *bridge, uint32_t known, struct blob_buf *buf);
+
+/* Drop the cached reply of a bridge after ovsd changed it. */
+void ovsd_info_changed(ovsd_name_t bridge);
+
+void ovsd_info_done(void);
+
+/* The last generation handed out, and how a restarted ovsd continues after
+ * it so that generations are not reused.
+ */
+uint32_t ovsd_info_generation(void);
+void ovsd_info_resume(uint32_t generation);
+
+#endif
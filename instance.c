@@ -0,0 +1,184 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "instance.h"
+#include "state.h"
+
+#define INSTANCE_BACKOFF_MIN_MS 1000
+
+static struct ovsd_instance instances[OVSD_INSTANCE_MAX] = {
+	{ .name = OVSD_INSTANCE_LOCAL },
+};
+static int n_instances = 1;
+
+static struct ovsd_instance *current = &instances[0];
+
+int
+ovsd_instance_add(char *spec)
+{
+	struct ovsd_instance *inst;
+	char *db = strchr(spec, '=');
+	size_t len;
+
+	if (!db || db == spec || n_instances == OVSD_INSTANCE_MAX)
+		return OVSD_EINVALID_ARG;
+	*db++ = '\0';
+
+	if (strncmp(db, "tcp:", 4) && strncmp(db, "ssl:", 4) &&
+			strncmp(db, "unix:", 5))
+		return OVSD_EINVALID_ARG;
+
+	if (ovsd_instance_find(spec))
+		return OVSD_EINVALID_ARG;
+
+	len = strlen(db) + sizeof("--db=");
+	inst = &instances[n_instances];
+	inst->db_arg = malloc(len);
+	if (!inst->db_arg)
+		return OVSD_EUNKNOWN;
+
+	snprintf(inst->db_arg, len, "--db=%s", db);
+	inst->name = spec;
+	inst->db = db;
+	n_instances++;
+
+	return OVSD_OK;
+}
+
+struct ovsd_instance *
+ovsd_instance_get(int idx)
+{
+	return idx < n_instances ? &instances[idx] : NULL;
+}
+
+struct ovsd_instance *
+ovsd_instance_find(const char *name)
+{
+	if (!name)
+		return &instances[0];
+
+	for (int i = 0; i < n_instances; i++)
+		if (!strcmp(instances[i].name, name))
+			return &instances[i];
+
+	return NULL;
+}
+
+struct ovsd_instance *
+ovsd_instance_of(ovsd_name_t bridge)
+{
+	struct ovsd_bridge *br = ovsd_state_bridge(bridge);
+	struct ovsd_instance *inst;
+
+	if (!br)
+		return &instances[0];
+
+	inst = ovsd_instance_find(br->cfg.instance);
+	return inst ? inst : &instances[0];
+}
+
+void
+ovsd_instance_select(struct ovsd_instance *inst)
+{
+	current = inst ? inst : &instances[0];
+}
+
+struct ovsd_instance *
+ovsd_instance_current(void)
+{
+	return current;
+}
+
+bool
+ovsd_instance_is_local(void)
+{
+	return current == &instances[0];
+}
+
+bool
+ovsd_instance_available(struct ovsd_instance *inst)
+{
+	return !inst->down_until_us || ovsd_now_us() >= inst->down_until_us;
+}
+
+/* Calls that could not reach the database open the breaker of a remote
+ * instance with exponential backoff. The first call after the backoff is a
+ * probe: if it succeeds, the breaker closes again.
+ */
+void
+ovsd_instance_account(struct ovsd_instance *inst, int ret,
+	uint64_t latency_us)
+{
+	inst->n_calls++;
+	inst->latency_total_us += latency_us;
+	if (latency_us > inst->latency_max_us)
+		inst->latency_max_us = latency_us;
+
+	if (ret == OVSD_ETIMEOUT)
+		inst->n_timeouts++;
+	else if (ret < 0 || ret == OVS_VSCTL_STATUS_ERROR)
+		inst->n_errors++;
+
+	if (!inst->db_arg)
+		return;
+
+	if (ret != OVSD_ETIMEOUT && ret >= 0) {
+		if (inst->down_until_us)
+			ovsd_log_msg(L_NOTICE, "instance %s: reachable again\n",
+				inst->name);
+		inst->down_until_us = 0;
+		inst->backoff_ms = 0;
+		inst->n_failed = 0;
+		return;
+	}
+
+	inst->n_failed++;
+	inst->backoff_ms = inst->backoff_ms ? inst->backoff_ms * 2 :
+		INSTANCE_BACKOFF_MIN_MS;
+	if (inst->backoff_ms > OVSD_INSTANCE_BACKOFF_MAX_MS)
+		inst->backoff_ms = OVSD_INSTANCE_BACKOFF_MAX_MS;
+	inst->down_until_us = ovsd_now_us() + inst->backoff_ms * 1000ULL;
+
+	ovsd_log_msg(L_WARNING, "instance %s: unreachable, retrying in %u ms\n",
+		inst->name, inst->backoff_ms);
+}
+
+void
+ovsd_instance_dump(struct blob_buf *buf)
+{
+	struct ovsd_instance *inst;
+	void *list, *tbl;
+
+	list = blobmsg_open_table(buf, "instances");
+	for (int i = 0; i < n_instances; i++) {
+		inst = &instances[i];
+
+		tbl = blobmsg_open_table(buf, inst->name);
+		if (inst->db)
+			blobmsg_add_string(buf, "db", inst->db);
+		blobmsg_add_u8(buf, "available", ovsd_instance_available(inst));
+		blobmsg_add_u32(buf, "failed", inst->n_failed);
+		blobmsg_add_u64(buf, "calls", inst->n_calls);
+		blobmsg_add_u64(buf, "errors", inst->n_errors);
+		blobmsg_add_u64(buf, "timeouts", inst->n_timeouts);
+		blobmsg_add_u64(buf, "latency_avg_us", inst->n_calls ?
+			inst->latency_total_us / inst->n_calls : 0);
+		blobmsg_add_u64(buf, "latency_max_us", inst->latency_max_us);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_table(buf, list);
+}
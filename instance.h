@@ -0,0 +1,79 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_INSTANCE_H
+#define __OVSD_INSTANCE_H
+
+#include "ovsd.h"
+#include "names.h"
+
+#define OVSD_INSTANCE_MAX 16
+#define OVSD_INSTANCE_LOCAL "local"
+
+// an unreachable remote instance is retried after at most this long
+#define OVSD_INSTANCE_BACKOFF_MAX_MS 16000
+
+/* An Open vSwitch database ovsd manages bridges in. The local instance is
+ * the default database of ovs-vsctl, its availability is tracked by the
+ * offline module. Remote instances are reached with --db and have a circuit
+ * breaker of their own, so that an unreachable one fails fast instead of
+ * eating up the deadlines of requests for other instances.
+ */
+struct ovsd_instance {
+	const char *name;
+	const char *db;
+
+	// "--db=<db>" for ovs-vsctl, NULL for the local instance
+	char *db_arg;
+
+	unsigned int backoff_ms;
+	uint64_t down_until_us;
+	unsigned int n_failed;
+
+	// statistics
+	uint64_t n_calls;
+	uint64_t n_errors;
+	uint64_t n_timeouts;
+	uint64_t latency_total_us;
+	uint64_t latency_max_us;
+};
+
+/* Add a remote instance given as <name>=<db>, e.g. sat1=tcp:192.0.2.5:6640 */
+int ovsd_instance_add(char *spec);
+
+/* Instance by index, NULL past the last one */
+struct ovsd_instance *ovsd_instance_get(int idx);
+
+/* Find an instance by name, NULL (or "local") is the local instance */
+struct ovsd_instance *ovsd_instance_find(const char *name);
+
+/* Instance of a bridge known to ovsd, the local one for other bridges */
+struct ovsd_instance *ovsd_instance_of(ovsd_name_t bridge);
+
+/* Select the instance that ovs-vsctl calls of the current operation go to.
+ * NULL selects the local instance.
+ */
+void ovsd_instance_select(struct ovsd_instance *inst);
+struct ovsd_instance *ovsd_instance_current(void);
+bool ovsd_instance_is_local(void);
+
+/* False while the breaker of a remote instance is open */
+bool ovsd_instance_available(struct ovsd_instance *inst);
+
+/* Record the outcome of an ovs-vsctl call, see _ovs_shell_exec() */
+void ovsd_instance_account(struct ovsd_instance *inst, int ret,
+	uint64_t latency_us);
+
+void ovsd_instance_dump(struct blob_buf *buf);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "journal.h"
+
+#define JOURNAL_MAGIC 0x4f56534a	// "OVSJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HDR_LEN 8
+#define JOURNAL_MIN_SIZE (64 * 1024)
+
+#define JOURNAL_COMPACT_INTERVAL (60 * 1000)
+
+struct journal_file {
+	int fd;
+	uint8_t *map;
+	size_t size;
+
+	// end of the last complete record
+	size_t tail;
+};
+
+static struct journal_file journal = { .fd = -1 };
+static char *journal_path;
+static ovsd_journal_dump_cb journal_dump;
+
+// journal length right after the last compaction
+static size_t compacted_len;
+
+static void journal_compact_cb(struct uloop_timeout *t);
+static struct uloop_timeout compact_timer = {
+	.cb = journal_compact_cb,
+};
+
+static int
+_journal_map(struct journal_file *j, size_t size)
+{
+	uint8_t *map;
+
+	if (ftruncate(j->fd, size))
+		return -errno;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	if (j->map)
+		munmap(j->map, j->size);
+
+	j->map = map;
+	j->size = size;
+	return 0;
+}
+
+static void
+_journal_unmap(struct journal_file *j)
+{
+	if (j->map)
+		munmap(j->map, j->size);
+	if (j->fd >= 0)
+		close(j->fd);
+
+	j->map = NULL;
+	j->fd = -1;
+}
+
+static bool
+_journal_rec_valid(struct journal_file *j, struct blob_attr *rec)
+{
+	size_t avail = j->size - ((uint8_t *) rec - j->map);
+
+	if (avail < sizeof(struct blob_attr))
+		return false;
+
+	if (blob_id(rec) == 0 || blob_id(rec) >= __JOURNAL_MAX)
+		return false;
+
+	return blob_raw_len(rec) >= sizeof(struct blob_attr) &&
+		blob_pad_len(rec) <= avail;
+}
+
+static void
+_journal_init_hdr(struct journal_file *j)
+{
+	uint32_t hdr[2] = { htonl(JOURNAL_MAGIC), htonl(JOURNAL_VERSION) };
+
+	memcpy(j->map, hdr, JOURNAL_HDR_LEN);
+	j->tail = JOURNAL_HDR_LEN;
+}
+
+/* Walk the records once and hand them to the replay callback. Anything after
+ * the last complete record is the remainder of an interrupted append and is
+ * cleared.
+ */
+static void
+_journal_scan(struct journal_file *j, ovsd_journal_replay_cb replay)
+{
+	uint32_t hdr[2];
+	struct blob_attr *rec;
+
+	memcpy(hdr, j->map, JOURNAL_HDR_LEN);
+	if (ntohl(hdr[0]) != JOURNAL_MAGIC || ntohl(hdr[1]) != JOURNAL_VERSION) {
+		memset(j->map, 0, j->size);
+		_journal_init_hdr(j);
+		return;
+	}
+
+	j->tail = JOURNAL_HDR_LEN;
+	for (;;) {
+		rec = (struct blob_attr *) (j->map + j->tail);
+		if (!_journal_rec_valid(j, rec))
+			break;
+
+		if (replay)
+			replay(rec);
+		j->tail += blob_pad_len(rec);
+	}
+
+	memset(j->map + j->tail, 0, j->size - j->tail);
+}
+
+static int
+_journal_create(struct journal_file *j, const char *path, bool truncate)
+{
+	struct stat st;
+	size_t size;
+	int ret;
+
+	j->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0),
+		0600);
+	if (j->fd < 0)
+		return -errno;
+
+	if (fstat(j->fd, &st)) {
+		ret = -errno;
+		goto error;
+	}
+
+	size = st.st_size;
+	if (size < JOURNAL_MIN_SIZE)
+		size = JOURNAL_MIN_SIZE;
+
+	if ((ret = _journal_map(j, size)))
+		goto error;
+
+	if (truncate)
+		_journal_init_hdr(j);
+
+	return 0;
+
+error:
+	_journal_unmap(j);
+	return ret;
+}
+
+int
+ovsd_journal_append(struct blob_attr *rec)
+{
+	struct journal_file *j = &journal;
+	size_t len = blob_pad_len(rec), size = j->size;
+
+	if (!j->map)
+		return -EBADF;
+
+	// keep a zero header after the last record
+	while (j->tail + len + sizeof(struct blob_attr) > size)
+		size *= 2;
+
+	if (size != j->size && _journal_map(j, size))
+		return -ENOSPC;
+
+	// the header goes in last, an interrupted append is not a valid record
+	memcpy(j->map + j->tail + sizeof(struct blob_attr), blob_data(rec),
+		blob_raw_len(rec) - sizeof(struct blob_attr));
+	memcpy(j->map + j->tail, rec, sizeof(struct blob_attr));
+	j->tail += len;
+
+	return 0;
+}
+
+/* Rewrite the journal from the current state and atomically replace the old
+ * file with it.
+ */
+int
+ovsd_journal_compact(void)
+{
+	struct journal_file old = journal;
+	char tmp_path[strlen(journal_path) + 5];
+	int ret;
+
+	if (!old.map || !journal_dump)
+		return -EBADF;
+
+	sprintf(tmp_path, "%s.tmp", journal_path);
+
+	memset(&journal, 0, sizeof(journal));
+	if ((ret = _journal_create(&journal, tmp_path, true))) {
+		journal = old;
+		return ret;
+	}
+
+	journal_dump();
+
+	if (rename(tmp_path, journal_path)) {
+		ret = -errno;
+		_journal_unmap(&journal);
+		unlink(tmp_path);
+		journal = old;
+		return ret;
+	}
+
+	_journal_unmap(&old);
+	compacted_len = journal.tail;
+
+	ovsd_log_msg(L_INFO, "journal compacted to %zu bytes\n", journal.tail);
+	return 0;
+}
+
+static void
+journal_compact_cb(struct uloop_timeout *t)
+{
+	// only rewrite once most of the journal is superseded records
+	if (journal.tail > 2 * compacted_len + JOURNAL_MIN_SIZE / 2)
+		ovsd_journal_compact();
+
+	uloop_timeout_set(t, JOURNAL_COMPACT_INTERVAL);
+}
+
+int
+ovsd_journal_open(const char *path, ovsd_journal_replay_cb replay,
+	ovsd_journal_dump_cb dump)
+{
+	int ret;
+
+	journal_path = strdup(path);
+	if (!journal_path)
+		return -ENOMEM;
+
+	journal_dump = dump;
+
+	if ((ret = _journal_create(&journal, path, false))) {
+		ovsd_log_msg(L_WARNING, "cannot open journal %s: %s\n", path,
+			strerror(-ret));
+		return ret;
+	}
+
+	_journal_scan(&journal, replay);
+	compacted_len = journal.tail;
+
+	uloop_timeout_set(&compact_timer, JOURNAL_COMPACT_INTERVAL);
+	return 0;
+}
+
+void
+ovsd_journal_close(void)
+{
+	uloop_timeout_cancel(&compact_timer);
+	_journal_unmap(&journal);
+}
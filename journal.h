@@ -0,0 +1,47 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_JOURNAL_H
+#define __OVSD_JOURNAL_H
+
+#include "ovsd.h"
+
+#define OVSD_JOURNAL_PATH "/var/run/ovsd.journal"
+
+/* The journal is an append-only sequence of blob attributes. The attribute id
+ * is the record type, the payload is a list of blobmsg attributes.
+ */
+enum ovsd_journal_record {
+	JOURNAL_BRIDGE_SET = 1,
+	JOURNAL_BRIDGE_DEL,
+	JOURNAL_PORT_ADD,
+	JOURNAL_PORT_DEL,
+
+	// like JOURNAL_BRIDGE_SET, but the member ports of the bridge are dropped
+	JOURNAL_BRIDGE_REPLACE,
+	__JOURNAL_MAX
+};
+
+typedef void (*ovsd_journal_replay_cb)(struct blob_attr *rec);
+
+/* Writes the complete current state through ovsd_journal_append() */
+typedef void (*ovsd_journal_dump_cb)(void);
+
+int ovsd_journal_open(const char *path, ovsd_journal_replay_cb replay,
+	ovsd_journal_dump_cb dump);
+void ovsd_journal_close(void);
+
+int ovsd_journal_append(struct blob_attr *rec);
+int ovsd_journal_compact(void);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <syslog.h>
+
+#include "log.h"
+
+/* Messages are formatted into a ring buffer on the request path and written
+ * out from the main loop. ovsd is single threaded, the ring has exactly one
+ * producer and one consumer and needs no locking.
+ */
+#define LOG_RING_SIZE 256
+#define LOG_MSG_MAX 256
+
+// identical messages within this window are counted instead of written
+#define LOG_REPEAT_WINDOW_MS 10000
+
+// token bucket: sustained messages per second and burst size
+#define LOG_RATE 20
+#define LOG_BURST 100
+
+struct log_entry {
+	int level;
+	char msg[LOG_MSG_MAX];
+};
+
+static struct log_entry ring[LOG_RING_SIZE];
+static unsigned int ring_head;
+static unsigned int ring_tail;
+
+static bool use_syslog = true;
+static int log_level = OVSD_LOG_DEFAULT_LVL;
+
+static const int log_class[] = {
+	[L_CRIT] = LOG_CRIT,
+	[L_WARNING] = LOG_WARNING,
+	[L_NOTICE] = LOG_NOTICE,
+	[L_INFO] = LOG_INFO,
+	[L_DEBUG] = LOG_DEBUG
+};
+
+// last message accepted into the ring and how often it was repeated since
+static struct {
+	uint32_t hash;
+	int level;
+	unsigned int repeat;
+	uint64_t since_us;
+} last;
+
+static unsigned int tokens = LOG_BURST;
+static uint64_t tokens_at;
+
+// statistics
+static uint64_t n_written;
+static uint64_t n_repeated;
+static uint64_t n_limited;
+static uint64_t n_overflow;
+static unsigned int n_limited_pending;
+
+static void log_drain(struct uloop_timeout *t);
+static struct uloop_timeout drain_timer = {
+	.cb = log_drain,
+};
+
+static void log_repeat_cb(struct uloop_timeout *t);
+static struct uloop_timeout repeat_timer = {
+	.cb = log_repeat_cb,
+};
+
+static uint32_t
+_log_hash(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*str)
+		hash = (hash ^ (uint8_t) *str++) * 16777619u;
+
+	return hash;
+}
+
+static void
+_log_write(int level, const char *msg)
+{
+	if (use_syslog)
+		syslog(log_class[level], "%s", msg);
+	else
+		fputs(msg, stderr);
+
+	n_written++;
+}
+
+static void
+_log_push(int level, const char *format, ...)
+{
+	struct log_entry *e;
+	va_list vl;
+
+	if (ring_head - ring_tail >= LOG_RING_SIZE) {
+		n_overflow++;
+		return;
+	}
+
+	e = &ring[ring_head % LOG_RING_SIZE];
+	e->level = level;
+
+	va_start(vl, format);
+	vsnprintf(e->msg, sizeof(e->msg), format, vl);
+	va_end(vl);
+
+	ring_head++;
+
+	if (!drain_timer.pending)
+		uloop_timeout_set(&drain_timer, 0);
+}
+
+static void
+_log_push_repeats(void)
+{
+	if (!last.repeat)
+		return;
+
+	_log_push(last.level, "last message repeated %u times\n", last.repeat);
+	last.repeat = 0;
+}
+
+static bool
+_log_take_token(void)
+{
+	uint64_t now = ovsd_now_us(), refill;
+
+	refill = (now - tokens_at) * LOG_RATE / 1000000;
+	if (refill) {
+		tokens = (tokens + refill > LOG_BURST) ? LOG_BURST : tokens + refill;
+		tokens_at = now;
+	}
+
+	if (!tokens)
+		return false;
+
+	tokens--;
+	return true;
+}
+
+static void
+_log_write_ring(void)
+{
+	struct log_entry *e;
+
+	while (ring_tail != ring_head) {
+		e = &ring[ring_tail % LOG_RING_SIZE];
+		_log_write(e->level, e->msg);
+		ring_tail++;
+	}
+}
+
+void
+ovsd_log_flush(void)
+{
+	_log_push_repeats();
+	if (n_limited_pending) {
+		_log_push(L_WARNING, "%u log messages suppressed\n",
+			n_limited_pending);
+		n_limited_pending = 0;
+	}
+
+	_log_write_ring();
+}
+
+static void
+log_drain(struct uloop_timeout *t)
+{
+	_log_write_ring();
+}
+
+static void
+log_repeat_cb(struct uloop_timeout *t)
+{
+	_log_push_repeats();
+	last.hash = 0;
+}
+
+void
+ovsd_log_msg(int log_lvl, const char *format, ...)
+{
+	char msg[LOG_MSG_MAX];
+	uint64_t now;
+	uint32_t hash;
+	va_list vl;
+
+	if (log_lvl > log_level)
+		return;
+
+	va_start(vl, format);
+	vsnprintf(msg, sizeof(msg), format, vl);
+	va_end(vl);
+
+	now = ovsd_now_us();
+	hash = _log_hash(msg);
+	if (hash == last.hash && log_lvl == last.level &&
+			now - last.since_us < LOG_REPEAT_WINDOW_MS * 1000ULL) {
+		last.repeat++;
+		n_repeated++;
+		return;
+	}
+
+	if (!_log_take_token()) {
+		n_limited++;
+		n_limited_pending++;
+		return;
+	}
+
+	_log_push_repeats();
+	if (n_limited_pending) {
+		_log_push(L_WARNING, "%u log messages suppressed\n",
+			n_limited_pending);
+		n_limited_pending = 0;
+	}
+
+	last.hash = hash;
+	last.level = log_lvl;
+	last.since_us = now;
+	uloop_timeout_set(&repeat_timer, LOG_REPEAT_WINDOW_MS);
+
+	_log_push(log_lvl, "%s", msg);
+
+	// don't lose the last words
+	if (log_lvl == L_CRIT)
+		_log_write_ring();
+}
+
+int
+ovsd_log_set_level(int level)
+{
+	if (level < 0 || level >= ARRAY_SIZE(log_class))
+		return -1;
+
+	log_level = level;
+	return 0;
+}
+
+int
+ovsd_log_get_level(void)
+{
+	return log_level;
+}
+
+void
+ovsd_log_dump(struct blob_buf *buf)
+{
+	void *tbl = blobmsg_open_table(buf, "log");
+
+	blobmsg_add_u32(buf, "level", log_level);
+	blobmsg_add_u32(buf, "buffered", ring_head - ring_tail);
+	blobmsg_add_u64(buf, "written", n_written);
+	blobmsg_add_u64(buf, "repeated", n_repeated);
+	blobmsg_add_u64(buf, "rate_limited", n_limited);
+	blobmsg_add_u64(buf, "overflow", n_overflow);
+	blobmsg_close_table(buf, tbl);
+}
+
+void
+ovsd_log_init(int level, bool syslog)
+{
+	use_syslog = syslog;
+	if (ovsd_log_set_level(level))
+		log_level = ARRAY_SIZE(log_class) - 1;
+
+	tokens_at = ovsd_now_us();
+
+	if (use_syslog)
+		openlog("ovsd", 0, LOG_DAEMON);
+}
+
+void
+ovsd_log_done(void)
+{
+	uloop_timeout_cancel(&repeat_timer);
+	uloop_timeout_cancel(&drain_timer);
+
+	ovsd_log_flush();
+
+	if (use_syslog)
+		closelog();
+}
@@ -0,0 +1,34 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_LOG_H
+#define __OVSD_LOG_H
+
+#include "ovsd.h"
+
+#define OVSD_LOG_DEFAULT_LVL L_NOTICE
+
+void ovsd_log_init(int level, bool use_syslog);
+void ovsd_log_done(void);
+
+/* Write out all buffered messages right away, including the count of
+ * repeated and suppressed ones
+ */
+void ovsd_log_flush(void);
+
+int ovsd_log_set_level(int level);
+int ovsd_log_get_level(void);
+
+void ovsd_log_dump(struct blob_buf *buf);
+
+#endif
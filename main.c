@@ -11,41 +11,26 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
  */
+#include <errno.h>
 #include <getopt.h>
-#include <syslog.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdlib.h>
 
 #include "ovsd.h"
 #include "ubus.h"
-
-#define DEFAULT_LOG_LVL LOG_NOTICE
-
-static bool use_syslog = true;
-
-static int log_level = DEFAULT_LOG_LVL;
-static const int log_class[] = {
-	[L_CRIT] = LOG_CRIT,
-	[L_WARNING] = LOG_WARNING,
-	[L_NOTICE] = LOG_NOTICE,
-	[L_INFO] = LOG_INFO,
-	[L_DEBUG] = LOG_DEBUG
-};
-
-void
-ovsd_log_msg(int log_lvl, const char *format, ...)
-{
-	va_list vl;
-
-	if (log_lvl > log_level)
-		return;
-
-	va_start(vl, format);
-	if (use_syslog)
-		vsyslog(log_class[log_lvl], format, vl);
-	else
-		vfprintf(stderr, format, vl);
-	va_end(vl);
-}
+#include "sched.h"
+#include "state.h"
+#include "journal.h"
+#include "drift.h"
+#include "ovs-shell.h"
+#include "log.h"
+#include "slowlog.h"
+#include "info.h"
+#include "fdb.h"
+#include "instance.h"
+#include "stats.h"
+#include "restart.h"
 
 static int
 usage(const char *progname)
@@ -55,19 +40,41 @@ usage(const char *progname)
 		" -s <path>:		Path to the ubus socket\n"
 		" -l <level>:		Log output level (default: %d)\n"
 		" -S:			Use stderr instead of syslog for log messages\n"
-		"\n", progname, DEFAULT_LOG_LVL);
+		" -j <path>:		Path to the state journal (default: %s)\n"
+		" -t <class>=<ms>:	Deadline of a request class (read, hotplug,\n"
+		"			lifecycle, reload)\n"
+		" -i <ms>:		Port counter sampling interval, 0 to disable\n"
+		"			(default: %d)\n"
+		" -o <name>=<db>:	Manage bridges in the Open vSwitch instance at\n"
+		"			<db> (tcp:, ssl: or unix: address) as <name>\n"
+		" -w <ms>:		Log ovs-vsctl calls taking longer than this\n"
+		"			(default: %d)\n"
+		" -V <path>:		Path to ovs-vsctl (default: %s)\n"
+		" -A <path>:		Path to ovs-appctl (default: %s)\n"
+		" -D <path>:		Socket of the local Open vSwitch database, probed\n"
+		"			when calls fail, the bridge management sockets\n"
+		"			are looked up next to it (default: %s)\n"
+		" -e <s>:		Interval of drift checks, 0 to disable\n"
+		"			(default: %d)\n"
+		" -b <ms>:		Time budget of a drift check (default: %d)\n"
+		"\n", progname, OVSD_LOG_DEFAULT_LVL, OVSD_JOURNAL_PATH,
+		OVSD_STATS_INTERVAL_MS, OVSD_SLOWLOG_THRESHOLD_MS, OVS_VSCTL,
+		OVS_APPCTL, OVS_DB_SOCK, OVSD_DRIFT_INTERVAL_S, OVSD_DRIFT_BUDGET_MS);
 
 	return 1;
 }
 
+static volatile sig_atomic_t exit_signal;
+
+/* Only note the signal, logging is not async-signal-safe */
 static void
 ovsd_handle_signal(int signo)
 {
-	ovsd_log_msg(L_NOTICE, "signal %d caught, shutting down...\n", signo);
+	exit_signal = signo;
 	uloop_end();
 }
 
-/* exit on signals SIGINT, SIGTERM, SIGUSR1, SIGUSR2 */
+/* exit on signals SIGINT, SIGTERM, SIGUSR1, SIGUSR2, hot restart on SIGHUP */
 static void
 ovsd_setup_signals(void)
 {
@@ -81,6 +88,9 @@ ovsd_setup_signals(void)
 	sigaction(SIGUSR1, &s, NULL);
 	sigaction(SIGUSR2, &s, NULL);
 
+	s.sa_handler = ovsd_restart_signal;
+	sigaction(SIGHUP, &s, NULL);
+
 	s.sa_handler = SIG_IGN;
 	sigaction(SIGPIPE, &s, NULL);
 }
@@ -88,42 +98,119 @@ ovsd_setup_signals(void)
 int main(int argc, char **argv)
 {
 	const char *socket = NULL;
+	const char *journal = OVSD_JOURNAL_PATH;
+	int log_level = OVSD_LOG_DEFAULT_LVL;
+	int stats_interval = OVSD_STATS_INTERVAL_MS;
+	int drift_interval = OVSD_DRIFT_INTERVAL_S;
+	int drift_budget = OVSD_DRIFT_BUDGET_MS;
+	long ms;
+	char *end;
+	bool use_syslog = true;
+	char *timeout;
 	int ch;
 
-	//global_argv = argv;
+	ovsd_restart_init(argc, argv);
 
-	while ((ch = getopt(argc, argv, "d:s:p:c:h:r:l:S")) != -1) {
+	while ((ch = getopt(argc, argv, "d:s:p:c:h:r:l:Sj:t:i:o:w:V:A:D:e:b:")) != -1) {
 		switch(ch) {
 		case 's':
 			socket = optarg;
 			break;
 		case 'l':
 			log_level = atoi(optarg);
-			if (log_level >= ARRAY_SIZE(log_class))
-				log_level = ARRAY_SIZE(log_class) -1;
 			break;
 		case 'S':
 			use_syslog = false;
 			break;
+		case 'j':
+			journal = optarg;
+			break;
+		case 't':
+			timeout = strchr(optarg, '=');
+			if (!timeout)
+				return usage(argv[0]);
+
+			*timeout++ = '\0';
+			errno = 0;
+			ms = strtol(timeout, &end, 10);
+			if (errno || end == timeout || *end || ms <= 0 || ms > INT_MAX ||
+					ovsd_sched_set_timeout(optarg, ms))
+				return usage(argv[0]);
+			break;
+		case 'i':
+			stats_interval = atoi(optarg);
+			if (stats_interval < 0)
+				return usage(argv[0]);
+			break;
+		case 'o':
+			if (ovsd_instance_add(optarg))
+				return usage(argv[0]);
+			break;
+		case 'w':
+			errno = 0;
+			ms = strtol(optarg, &end, 10);
+			if (errno || end == optarg || *end || ms <= 0 || ms > INT_MAX)
+				return usage(argv[0]);
+			ovsd_slowlog_set_threshold(ms);
+			break;
+		case 'V':
+			ovs_vsctl_path = optarg;
+			break;
+		case 'A':
+			ovs_appctl_path = optarg;
+			break;
+		case 'D':
+			ovs_db_sock_path = optarg;
+			break;
+		case 'e':
+			drift_interval = atoi(optarg);
+			if (drift_interval < 0)
+				return usage(argv[0]);
+			break;
+		case 'b':
+			drift_budget = atoi(optarg);
+			if (drift_budget <= 0)
+				return usage(argv[0]);
+			break;
 		default:
 			return usage(argv[0]);
 		}
 	}
 
-	if (use_syslog)
-		openlog("ovsd", 0, LOG_DAEMON);
+	ovsd_log_init(log_level, use_syslog);
 
 	ovsd_setup_signals();
 
+	// without a journal ovsd still works, but forgets its state on restart
+	ovsd_state_init(journal, ovsd_restart_handover(RESTART_STATE));
+
 	if (ovsd_ubus_init(socket) < 0) {
-		fprintf(stderr, "Failed to connect to ubus\n");
+		ovsd_log_msg(L_CRIT, "Failed to connect to ubus\n");
+		ovsd_log_done();
 		return 1;
 	}
 
-	uloop_run();
+	ovsd_restart_resume();
+
+	ovsd_stats_init(stats_interval);
+	ovsd_drift_init(drift_interval, drift_budget);
+
+	do {
+		uloop_run();
+	} while (!exit_signal && ovsd_restart_pending());
+
+	if (exit_signal)
+		ovsd_log_msg(L_NOTICE, "signal %d caught, shutting down...\n",
+			(int) exit_signal);
+
+	ovsd_drift_done();
+	ovsd_stats_done();
+	ovsd_info_done();
+	ovsd_fdb_done();
+	ovsd_state_done();
+	ovsd_ubus_done();
 
-	if (use_syslog)
-		closelog();
+	ovsd_log_done();
 
 	return 0;
 }
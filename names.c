@@ -0,0 +1,213 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "names.h"
+
+struct name_entry {
+	char *str;
+	uint32_t hash;
+	uint32_t refcount;
+
+	// next entry in the same hash bucket or, if unused, on the free list
+	ovsd_name_t next;
+};
+
+// entry 0 is reserved for OVSD_NAME_NONE
+static struct name_entry *entries;
+static uint32_t n_entries = 1;
+static uint32_t n_alloc;
+static ovsd_name_t free_list;
+
+static ovsd_name_t *buckets;
+static uint32_t n_buckets;
+static uint32_t n_used;
+
+static uint32_t
+_hash(const char *str)
+{
+	uint32_t h = 2166136261U;
+
+	while (*str) {
+		h ^= (uint8_t) *str++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static int
+_rehash(uint32_t size)
+{
+	ovsd_name_t *b = calloc(size, sizeof(*b));
+	ovsd_name_t cur, next;
+
+	if (!b)
+		return -1;
+
+	for (uint32_t i = 0; i < n_buckets; i++) {
+		for (cur = buckets[i]; cur; cur = next) {
+			next = entries[cur].next;
+			entries[cur].next = b[entries[cur].hash & (size - 1)];
+			b[entries[cur].hash & (size - 1)] = cur;
+		}
+	}
+
+	free(buckets);
+	buckets = b;
+	n_buckets = size;
+	return 0;
+}
+
+static ovsd_name_t
+_find(const char *str, uint32_t hash)
+{
+	ovsd_name_t cur;
+
+	if (!n_buckets)
+		return OVSD_NAME_NONE;
+
+	for (cur = buckets[hash & (n_buckets - 1)]; cur; cur = entries[cur].next)
+		if (entries[cur].hash == hash && !strcmp(entries[cur].str, str))
+			return cur;
+
+	return OVSD_NAME_NONE;
+}
+
+static ovsd_name_t
+_alloc_entry(void)
+{
+	struct name_entry *e;
+	ovsd_name_t name;
+
+	if (free_list) {
+		name = free_list;
+		free_list = entries[name].next;
+		return name;
+	}
+
+	if (n_entries >= n_alloc) {
+		uint32_t alloc = n_alloc ? n_alloc * 2 : 64;
+
+		e = realloc(entries, alloc * sizeof(*e));
+		if (!e)
+			return OVSD_NAME_NONE;
+
+		entries = e;
+		n_alloc = alloc;
+	}
+
+	return n_entries++;
+}
+
+ovsd_name_t
+ovsd_name_get(const char *str)
+{
+	uint32_t hash;
+	ovsd_name_t name;
+	char *copy;
+
+	if (!str)
+		return OVSD_NAME_NONE;
+
+	hash = _hash(str);
+	name = _find(str, hash);
+	if (name)
+		return ovsd_name_ref(name);
+
+	// keep the load factor below 1
+	if (n_used >= n_buckets && _rehash(n_buckets ? n_buckets * 2 : 64))
+		return OVSD_NAME_NONE;
+
+	copy = strdup(str);
+	if (!copy)
+		return OVSD_NAME_NONE;
+
+	name = _alloc_entry();
+	if (!name) {
+		free(copy);
+		return OVSD_NAME_NONE;
+	}
+
+	entries[name].str = copy;
+	entries[name].hash = hash;
+	entries[name].refcount = 1;
+	entries[name].next = buckets[hash & (n_buckets - 1)];
+	buckets[hash & (n_buckets - 1)] = name;
+	n_used++;
+
+	return name;
+}
+
+ovsd_name_t
+ovsd_name_lookup(const char *str)
+{
+	if (!str)
+		return OVSD_NAME_NONE;
+
+	return _find(str, _hash(str));
+}
+
+ovsd_name_t
+ovsd_name_ref(ovsd_name_t name)
+{
+	if (name)
+		entries[name].refcount++;
+
+	return name;
+}
+
+void
+ovsd_name_put(ovsd_name_t name)
+{
+	struct name_entry *e;
+	ovsd_name_t *link;
+
+	if (!name)
+		return;
+
+	e = &entries[name];
+	if (--e->refcount)
+		return;
+
+	link = &buckets[e->hash & (n_buckets - 1)];
+	while (*link != name)
+		link = &entries[*link].next;
+	*link = e->next;
+
+	free(e->str);
+	e->str = NULL;
+	e->next = free_list;
+	free_list = name;
+	n_used--;
+}
+
+const char *
+ovsd_name_str(ovsd_name_t name)
+{
+	return name ? entries[name].str : NULL;
+}
+
+uint32_t
+ovsd_name_hash(ovsd_name_t name)
+{
+	return name ? entries[name].hash : 0;
+}
+
+ovsd_name_t
+ovsd_name_max(void)
+{
+	return n_entries;
+}
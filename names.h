@@ -0,0 +1,42 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_NAMES_H
+#define __OVSD_NAMES_H
+
+#include <stdint.h>
+
+/* Bridge and port names are interned: every distinct name is stored once and
+ * referred to by a small integer handle. Two handles are equal if and only if
+ * the names are equal. Handle 0 never refers to a name.
+ */
+typedef uint32_t ovsd_name_t;
+
+#define OVSD_NAME_NONE 0
+
+/* Intern a name and take a reference to it. */
+ovsd_name_t ovsd_name_get(const char *str);
+
+/* Find an interned name without taking a reference. */
+ovsd_name_t ovsd_name_lookup(const char *str);
+
+ovsd_name_t ovsd_name_ref(ovsd_name_t name);
+void ovsd_name_put(ovsd_name_t name);
+
+const char *ovsd_name_str(ovsd_name_t name);
+uint32_t ovsd_name_hash(ovsd_name_t name);
+
+/* Upper bound for handles currently in use, for tables indexed by handle */
+ovsd_name_t ovsd_name_max(void);
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "offline.h"
+#include "instance.h"
+#include "config.h"
+#include "names.h"
+#include "ovs.h"
+#include "ovs-shell.h"
+#include "patch.h"
+#include "state.h"
+
+#define OFFLINE_PROBE_MIN_MS 1000
+#define OFFLINE_PROBE_MAX_MS 16000
+
+struct offline_op {
+	struct list_head list;
+
+	enum ovsd_offline_op op;
+	ovsd_name_t bridge;
+	ovsd_name_t port;
+
+	// private copy of the request, all strings point into it
+	struct blob_attr *msg;
+	char *bridge_str;
+	char *port_str;
+
+	// bridge configuration of create and reload
+	struct ovswitch_br_config cfg;
+
+	// VLAN settings of an added port
+	struct ovsd_port_vlan vlan;
+
+	// the bridge is deleted before it is created
+	bool recreate;
+};
+
+static const char *offline_op_name[__OFFLINE_MAX] = {
+	[OFFLINE_CREATE] = "create",
+	[OFFLINE_RELOAD] = "reload",
+	[OFFLINE_FREE] = "free",
+	[OFFLINE_PORT_ADD] = "add",
+	[OFFLINE_PORT_REMOVE] = "remove",
+};
+
+static LIST_HEAD(offline_ops);
+static unsigned int n_offline_ops;
+static ovsd_offline_done_cb offline_done;
+
+static bool breaker_open;
+static unsigned int probe_interval;
+static uint64_t opened_at;
+
+// statistics
+static uint64_t n_trips;
+static uint64_t n_collapsed;
+static uint64_t n_replayed;
+
+static void offline_probe_cb(struct uloop_timeout *t);
+static struct uloop_timeout probe_timer = {
+	.cb = offline_probe_cb,
+};
+
+enum {
+	OFFPOL_NAME,
+	OFFPOL_BRIDGE,
+	OFFPOL_MEMBER,
+	__OFFPOL_MAX
+};
+static const struct blobmsg_policy offline_policy[__OFFPOL_MAX] = {
+	[OFFPOL_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[OFFPOL_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[OFFPOL_MEMBER] = { .name = "member", .type = BLOBMSG_TYPE_STRING },
+};
+
+static bool
+_is_bridge_op(enum ovsd_offline_op op)
+{
+	return op == OFFLINE_CREATE || op == OFFLINE_RELOAD || op == OFFLINE_FREE;
+}
+
+/* The database is considered reachable if its socket accepts connections */
+static bool
+_offline_probe(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd, ret;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	strncpy(addr.sun_path, OVS_DB_SOCK, sizeof(addr.sun_path) - 1);
+	ret = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+	if (ret && errno == EAGAIN)
+		ret = 0;
+
+	close(fd);
+	return !ret;
+}
+
+static void
+_offline_open(void)
+{
+	if (breaker_open)
+		return;
+
+	breaker_open = true;
+	opened_at = ovsd_now_us();
+	n_trips++;
+	probe_interval = OFFLINE_PROBE_MIN_MS;
+	uloop_timeout_set(&probe_timer, probe_interval);
+
+	ovsd_log_msg(L_WARNING, "Open vSwitch database unavailable, queueing "
+		"changes until it is back\n");
+}
+
+bool
+ovsd_offline_active(void)
+{
+	return breaker_open && ovsd_instance_is_local();
+}
+
+void
+ovsd_offline_failed(int ret)
+{
+	if (breaker_open)
+		return;
+
+	// a stuck database may still accept connections
+	if (ret == OVSD_ETIMEOUT || !_offline_probe())
+		_offline_open();
+}
+
+static void
+_op_free(struct offline_op *op)
+{
+	list_del(&op->list);
+	n_offline_ops--;
+
+	ovsd_config_free(&op->cfg);
+	ovsd_name_put(op->bridge);
+	ovsd_name_put(op->port);
+	free(op->msg);
+	free(op);
+}
+
+/* Drop queued operations that the new one supersedes. There is at most one
+ * bridge operation per bridge and one port operation per port in the queue.
+ */
+static void
+_offline_collapse(struct offline_op *new)
+{
+	struct offline_op *cur, *tmp;
+
+	list_for_each_entry_safe(cur, tmp, &offline_ops, list) {
+		if (cur->bridge != new->bridge)
+			continue;
+
+		if (_is_bridge_op(new->op)) {
+			if (_is_bridge_op(cur->op)) {
+				// create after free: the old bridge has to go first
+				if (new->op == OFFLINE_CREATE)
+					new->recreate = cur->recreate ||
+						cur->op != OFFLINE_CREATE;
+			} else if (new->op == OFFLINE_CREATE) {
+				continue;
+			}
+		} else if (_is_bridge_op(cur->op) || cur->port != new->port) {
+			continue;
+		}
+
+		n_collapsed++;
+		_op_free(cur);
+	}
+}
+
+int
+ovsd_offline_queue(enum ovsd_offline_op op, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__OFFPOL_MAX];
+	struct offline_op *new;
+
+	new = calloc(1, sizeof(*new));
+	if (!new)
+		return OVSD_EUNKNOWN;
+
+	new->op = op;
+	new->recreate = (op == OFFLINE_RELOAD);
+	new->cfg = (struct ovswitch_br_config) OVSWITCH_CONFIG_INIT;
+	new->vlan = (struct ovsd_port_vlan) OVSD_PORT_VLAN_INIT;
+	new->msg = blob_memdup(msg);
+	if (!new->msg) {
+		free(new);
+		return OVSD_EUNKNOWN;
+	}
+
+	blobmsg_parse(offline_policy, __OFFPOL_MAX, tb, blob_data(new->msg),
+		blob_len(new->msg));
+
+	if (_is_bridge_op(op)) {
+		new->bridge_str = blobmsg_get_string(tb[OFFPOL_NAME]);
+	} else {
+		new->bridge_str = blobmsg_get_string(tb[OFFPOL_BRIDGE]);
+		new->port_str = blobmsg_get_string(tb[OFFPOL_MEMBER]);
+		if (!new->port_str)
+			goto invalid;
+	}
+
+	if (!new->bridge_str)
+		goto invalid;
+
+	if ((op == OFFLINE_CREATE || op == OFFLINE_RELOAD) &&
+			ovsd_config_parse(new->msg, &new->cfg))
+		goto invalid;
+
+	if (op == OFFLINE_PORT_ADD && ovsd_config_parse_vlan(blob_data(new->msg),
+			blob_len(new->msg), &new->vlan))
+		goto invalid;
+
+	new->bridge = ovsd_name_get(new->bridge_str);
+	new->port = ovsd_name_get(new->port_str);
+
+	_offline_collapse(new);
+
+	if (n_offline_ops >= OFFLINE_QUEUE_MAX) {
+		ovsd_name_put(new->bridge);
+		ovsd_name_put(new->port);
+		ovsd_config_free(&new->cfg);
+		free(new->msg);
+		free(new);
+		return OVSD_EBUSY;
+	}
+
+	list_add_tail(&new->list, &offline_ops);
+	n_offline_ops++;
+	return OVSD_OK;
+
+invalid:
+	ovsd_config_free(&new->cfg);
+	free(new->msg);
+	free(new);
+	return OVSD_EINVALID_ARG;
+}
+
+static void
+_offline_connect(struct offline_op *op)
+{
+	if (op->op != OFFLINE_PORT_ADD && op->op != OFFLINE_PORT_REMOVE)
+		ovs_openflow_disconnect(op->bridge);
+
+	if (op->op != OFFLINE_FREE && _is_bridge_op(op->op) && !op->cfg.parent)
+		ovs_openflow_connect(op->bridge);
+}
+
+/* Apply a single operation, used if the consolidated transaction fails */
+static int
+_offline_apply(struct offline_op *op)
+{
+	switch (op->op) {
+	case OFFLINE_CREATE:
+		if (op->recreate)
+			ovs_delete(op->bridge_str);
+		return ovs_create(&op->cfg);
+	case OFFLINE_RELOAD:
+		ovs_delete(op->bridge_str);
+		return ovs_create(&op->cfg);
+	case OFFLINE_FREE:
+		return ovs_delete(op->bridge_str);
+	case OFFLINE_PORT_ADD:
+		return ovs_add_port(op->bridge_str, op->port_str, &op->vlan);
+	case OFFLINE_PORT_REMOVE:
+		return ovs_remove_port(op->bridge_str, op->port_str);
+	default:
+		return OVSD_EUNKNOWN;
+	}
+}
+
+static void
+_offline_done(struct offline_op *op, int ret)
+{
+	n_replayed++;
+	if (offline_done)
+		offline_done(op->op, op->msg, ret);
+	_op_free(op);
+}
+
+/* Build the whole queue into one transaction: deletions first, then bridges
+ * before their fake bridges, and port changes last.
+ */
+static void
+_offline_build(struct ovs_txn *txn)
+{
+	struct ovsd_bridge *br;
+	struct offline_op *op, *peer;
+	bool member, after;
+
+	list_for_each_entry(op, &offline_ops, list) {
+		if (op->op == OFFLINE_FREE || op->recreate)
+			ovs_txn_cmd(txn, ovs_cmd(MODIFIER_IF_EXISTS),
+				ovs_cmd(CMD_DEL_BR), op->bridge_str, NULL);
+		if (op->op == OFFLINE_FREE)
+			ovs_patch_txn_unlink(txn, op->bridge_str);
+	}
+
+	for (int fake = 0; fake < 2; fake++)
+		list_for_each_entry(op, &offline_ops, list)
+			if ((op->op == OFFLINE_CREATE || op->op == OFFLINE_RELOAD) &&
+					!op->cfg.parent == !fake)
+				ovs_shell_txn_add_bridge(txn, &op->cfg);
+
+	// link each pair of peers once, bridges created in the queue are not
+	// known to the state yet
+	list_for_each_entry(op, &offline_ops, list) {
+		if (op->op != OFFLINE_CREATE && op->op != OFFLINE_RELOAD)
+			continue;
+
+		ovs_patch_txn_link(txn, &op->cfg);
+		after = false;
+		list_for_each_entry(peer, &offline_ops, list) {
+			if (after && (peer->op == OFFLINE_CREATE ||
+					peer->op == OFFLINE_RELOAD))
+				ovs_patch_txn_link_pair(txn, &op->cfg, &peer->cfg);
+			after |= peer == op;
+		}
+	}
+
+	list_for_each_entry(op, &offline_ops, list) {
+		if (op->op != OFFLINE_PORT_ADD && op->op != OFFLINE_PORT_REMOVE)
+			continue;
+
+		// members of a bond join or leave the bond instead of the bridge
+		br = ovsd_state_bridge(op->bridge);
+		member = br && ovsd_config_is_bond_member(&br->cfg, op->port_str);
+
+		if (op->op == OFFLINE_PORT_ADD && member) {
+			ovs_txn_cmd(txn, ovs_cmd(MODIFIER_MAY_EXIST),
+				ovs_cmd(CMD_ADD_BOND_IFACE), br->cfg.bond_name, op->port_str,
+				NULL);
+		} else if (op->op == OFFLINE_PORT_ADD) {
+			ovs_shell_txn_add_port(txn, op->bridge_str, op->port_str,
+				&op->vlan);
+			ovs_shell_txn_set_rxq(txn, op->port_str,
+				br ? br->cfg.n_rxq : -1, false);
+		} else if (member) {
+			ovs_txn_cmd(txn, ovs_cmd(MODIFIER_IF_EXISTS),
+				ovs_cmd(CMD_DEL_BOND_IFACE), br->cfg.bond_name, op->port_str,
+				NULL);
+		} else {
+			ovs_txn_cmd(txn, ovs_cmd(MODIFIER_IF_EXISTS),
+				ovs_cmd(CMD_DEL_PORT), op->bridge_str, op->port_str, NULL);
+		}
+	}
+}
+
+static void
+_offline_replay(void)
+{
+	struct offline_op *op, *tmp;
+	struct ovs_txn txn;
+	int ret;
+
+	if (list_empty(&offline_ops))
+		return;
+
+	ovsd_log_msg(L_NOTICE, "replaying %u queued changes\n", n_offline_ops);
+
+	ovs_txn_init(&txn);
+	_offline_build(&txn);
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	// gone again, keep everything for the next attempt
+	if (breaker_open)
+		return;
+
+	if (!ret) {
+		list_for_each_entry_safe(op, tmp, &offline_ops, list) {
+			_offline_connect(op);
+			_offline_done(op, OVSD_OK);
+		}
+		return;
+	}
+
+	list_for_each_entry_safe(op, tmp, &offline_ops, list) {
+		ret = _offline_apply(op);
+		if (breaker_open)
+			return;
+
+		_offline_done(op, ret);
+	}
+}
+
+static void
+offline_probe_cb(struct uloop_timeout *t)
+{
+	if (!_offline_probe()) {
+		if (probe_interval < OFFLINE_PROBE_MAX_MS)
+			probe_interval *= 2;
+		uloop_timeout_set(t, probe_interval);
+		return;
+	}
+
+	breaker_open = false;
+	ovsd_log_msg(L_NOTICE, "Open vSwitch database is back after %llu s\n",
+		(unsigned long long) ((ovsd_now_us() - opened_at) / 1000000));
+
+	_offline_replay();
+}
+
+void
+ovsd_offline_dump(struct blob_buf *buf)
+{
+	struct offline_op *op;
+	void *tbl, *list;
+
+	tbl = blobmsg_open_table(buf, "offline");
+	blobmsg_add_u8(buf, "active", breaker_open);
+	blobmsg_add_u32(buf, "queued", n_offline_ops);
+	blobmsg_add_u64(buf, "trips", n_trips);
+	blobmsg_add_u64(buf, "collapsed", n_collapsed);
+	blobmsg_add_u64(buf, "replayed", n_replayed);
+
+	list = blobmsg_open_array(buf, "ops");
+	list_for_each_entry(op, &offline_ops, list) {
+		void *e = blobmsg_open_table(buf, NULL);
+
+		blobmsg_add_string(buf, "op", offline_op_name[op->op]);
+		blobmsg_add_string(buf, "bridge", op->bridge_str);
+		if (op->port_str)
+			blobmsg_add_string(buf, "member", op->port_str);
+		blobmsg_close_table(buf, e);
+	}
+	blobmsg_close_array(buf, list);
+	blobmsg_close_table(buf, tbl);
+}
+
+void
+ovsd_offline_init(ovsd_offline_done_cb done)
+{
+	offline_done = done;
+}
+
+void
+ovsd_offline_snapshot(struct blob_buf *buf)
+{
+	struct offline_op *op;
+
+	list_for_each_entry(op, &offline_ops, list)
+		blob_put(buf, op->op, op->msg, blob_pad_len(op->msg));
+}
+
+void
+ovsd_offline_adopt(struct blob_attr *ops, bool open)
+{
+	struct blob_attr *cur;
+	int rem;
+
+	blob_for_each_attr(cur, ops, rem) {
+		if (blob_id(cur) >= __OFFLINE_MAX ||
+				ovsd_offline_queue(blob_id(cur), blob_data(cur)))
+			ovsd_log_msg(L_WARNING, "Dropped queued operation from previous "
+				"ovsd\n");
+	}
+
+	if (open)
+		_offline_open();
+}
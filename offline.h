@@ -0,0 +1,63 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_OFFLINE_H
+#define __OVSD_OFFLINE_H
+
+#include "ovsd.h"
+
+// maximum number of operations kept while Open vSwitch is unavailable
+#define OFFLINE_QUEUE_MAX 1024
+
+enum ovsd_offline_op {
+	OFFLINE_CREATE,
+	OFFLINE_RELOAD,
+	OFFLINE_FREE,
+	OFFLINE_PORT_ADD,
+	OFFLINE_PORT_REMOVE,
+	__OFFLINE_MAX
+};
+
+/* Called for every queued operation once it has been replayed, with the
+ * original request message and the result.
+ */
+typedef void (*ovsd_offline_done_cb)(enum ovsd_offline_op op,
+	struct blob_attr *msg, int ret);
+
+void ovsd_offline_init(ovsd_offline_done_cb done);
+
+/* True while the circuit breaker is open, i.e. the local Open vSwitch is
+ * considered unavailable and no ovs-vsctl calls are made, and the local
+ * instance is selected.
+ */
+bool ovsd_offline_active(void);
+
+/* Report a failed ovs-vsctl call. Opens the breaker if the database turns out
+ * to be unreachable.
+ */
+void ovsd_offline_failed(int ret);
+
+int ovsd_offline_queue(enum ovsd_offline_op op, struct blob_attr *msg);
+void ovsd_offline_dump(struct blob_buf *buf);
+
+/* Add the queued operations to buf, one attribute per operation with the
+ * operation as id and the request message as payload.
+ */
+void ovsd_offline_snapshot(struct blob_buf *buf);
+
+/* Queue the operations of a snapshot taken by a previous ovsd and open the
+ * breaker again if it was open.
+ */
+void ovsd_offline_adopt(struct blob_attr *ops, bool open);
+
+#endif
@@ -0,0 +1,1198 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "openflow.h"
+#include "ovs-shell.h"
+
+/* Minimal OpenFlow 1.3/1.4 client for the bridge management socket. Only
+ * what is needed to push flow modifications inside a bundle is implemented.
+ * OpenFlow 1.4 has bundles built in, for 1.3 the equivalent ONF extension
+ * (EXT-230) is used.
+ */
+#define OFP_VERSION_13 0x04
+#define OFP_VERSION_14 0x05
+#define OFP_HEADER_LEN 8
+
+enum ofp_type {
+	OFPT_HELLO = 0,
+	OFPT_ERROR = 1,
+	OFPT_ECHO_REQUEST = 2,
+	OFPT_ECHO_REPLY = 3,
+	OFPT_EXPERIMENTER = 4,
+	OFPT_FLOW_MOD = 14,
+	OFPT_MULTIPART_REQUEST = 18,
+	OFPT_MULTIPART_REPLY = 19,
+	OFPT_BUNDLE_CONTROL = 33,
+	OFPT_BUNDLE_ADD_MESSAGE = 34,
+};
+
+#define ONF_EXPERIMENTER_ID 0x4F4E4600
+#define ONFT_BUNDLE_CONTROL 2300
+#define ONFT_BUNDLE_ADD_MESSAGE 2301
+
+enum ofp_bundle_ctrl_type {
+	OFPBCT_OPEN_REQUEST = 0,
+	OFPBCT_OPEN_REPLY = 1,
+	OFPBCT_COMMIT_REQUEST = 4,
+	OFPBCT_COMMIT_REPLY = 5,
+};
+
+#define OFPBF_ATOMIC (1 << 0)
+#define OFPBF_ORDERED (1 << 1)
+
+enum ofp_flow_mod_command {
+	OFPFC_ADD = 0,
+	OFPFC_MODIFY = 1,
+	OFPFC_MODIFY_STRICT = 2,
+	OFPFC_DELETE = 3,
+	OFPFC_DELETE_STRICT = 4,
+};
+
+#define OFPP_IN_PORT 0xfffffff8
+#define OFPP_NORMAL 0xfffffffa
+#define OFPP_FLOOD 0xfffffffb
+#define OFPP_ALL 0xfffffffc
+#define OFPP_CONTROLLER 0xfffffffd
+#define OFPP_LOCAL 0xfffffffe
+#define OFPP_ANY 0xffffffff
+#define OFPG_ANY 0xffffffff
+#define OFP_NO_BUFFER 0xffffffff
+#define OFPCML_NO_BUFFER 0xffff
+
+#define OFPIT_GOTO_TABLE 1
+#define OFPIT_APPLY_ACTIONS 4
+
+#define OFPAT_OUTPUT 0
+#define OFPAT_PUSH_VLAN 17
+#define OFPAT_POP_VLAN 18
+#define OFPAT_SET_FIELD 25
+
+#define OFPMP_TABLE_STATS 3
+#define OFPMPF_REPLY_MORE (1 << 0)
+#define OFP_TABLE_STATS_LEN 24
+
+#define OFPMT_OXM 1
+#define OFPXMC_OPENFLOW_BASIC 0x8000
+#define OFPVID_PRESENT 0x1000
+
+enum oxm_field {
+	OXM_IN_PORT = 0,
+	OXM_ETH_DST = 3,
+	OXM_ETH_SRC = 4,
+	OXM_ETH_TYPE = 5,
+	OXM_VLAN_VID = 6,
+	OXM_IP_PROTO = 10,
+	OXM_IPV4_SRC = 11,
+	OXM_IPV4_DST = 12,
+	OXM_TCP_SRC = 13,
+	OXM_TCP_DST = 14,
+	OXM_UDP_SRC = 15,
+	OXM_UDP_DST = 16,
+};
+
+struct of_conn {
+	ovsd_name_t name;
+	int fd;
+	uint8_t version;
+	uint32_t xid;
+};
+
+struct of_buf {
+	uint8_t *data;
+	size_t len;
+	size_t alloc;
+	bool error;
+};
+
+/* Interface names resolved to OpenFlow port numbers during one request */
+#define OF_PORT_CACHE_SIZE 32
+struct of_port_cache {
+	const char *name[OF_PORT_CACHE_SIZE];
+	uint32_t ofport[OF_PORT_CACHE_SIZE];
+	int n;
+};
+
+// open connections, indexed by bridge name handle
+static struct of_conn **of_conns;
+static ovsd_name_t n_of_conns;
+
+static const uint8_t flow_mod_cmd[__OVS_FLOW_CMD_MAX][2] = {
+	[OVS_FLOW_ADD] = { OFPFC_ADD, OFPFC_ADD },
+	[OVS_FLOW_MODIFY] = { OFPFC_MODIFY, OFPFC_MODIFY_STRICT },
+	[OVS_FLOW_DELETE] = { OFPFC_DELETE, OFPFC_DELETE_STRICT },
+};
+
+static uint8_t *
+_of_reserve(struct of_buf *b, size_t n)
+{
+	uint8_t *p;
+
+	if (b->len + n > b->alloc) {
+		size_t alloc = b->alloc ? b->alloc : 1024;
+
+		while (alloc < b->len + n)
+			alloc *= 2;
+
+		p = realloc(b->data, alloc);
+		if (!p) {
+			b->error = true;
+			return NULL;
+		}
+		b->data = p;
+		b->alloc = alloc;
+	}
+
+	p = b->data + b->len;
+	memset(p, 0, n);
+	b->len += n;
+	return p;
+}
+
+static void
+_of_put(struct of_buf *b, const void *data, size_t n)
+{
+	uint8_t *p = _of_reserve(b, n);
+
+	if (p)
+		memcpy(p, data, n);
+}
+
+static void
+_of_put_u8(struct of_buf *b, uint8_t v)
+{
+	_of_put(b, &v, 1);
+}
+
+static void
+_of_put_u16(struct of_buf *b, uint16_t v)
+{
+	v = htons(v);
+	_of_put(b, &v, 2);
+}
+
+static void
+_of_put_u32(struct of_buf *b, uint32_t v)
+{
+	v = htonl(v);
+	_of_put(b, &v, 4);
+}
+
+static void
+_of_put_u64(struct of_buf *b, uint64_t v)
+{
+	_of_put_u32(b, v >> 32);
+	_of_put_u32(b, v & 0xffffffff);
+}
+
+static void
+_of_pad(struct of_buf *b, size_t start, size_t align)
+{
+	size_t len = b->len - start;
+
+	if (len % align)
+		_of_reserve(b, align - len % align);
+}
+
+static void
+_of_set_u16(struct of_buf *b, size_t offset, uint16_t v)
+{
+	if (b->error)
+		return;
+
+	v = htons(v);
+	memcpy(b->data + offset, &v, 2);
+}
+
+static uint16_t
+_of_get_u16(const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, 2);
+	return ntohs(v);
+}
+
+static uint32_t
+_of_get_u32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+static uint64_t
+_of_get_u64(const uint8_t *p)
+{
+	return (uint64_t) _of_get_u32(p) << 32 | _of_get_u32(p + 4);
+}
+
+/* Start a message, the length is filled in by _of_end_msg() */
+static size_t
+_of_start_msg(struct of_buf *b, uint8_t version, uint8_t type, uint32_t xid)
+{
+	size_t start = b->len;
+
+	_of_put_u8(b, version);
+	_of_put_u8(b, type);
+	_of_put_u16(b, 0);
+	_of_put_u32(b, xid);
+	return start;
+}
+
+static void
+_of_end_msg(struct of_buf *b, size_t start)
+{
+	_of_set_u16(b, start + 2, b->len - start);
+}
+
+static int
+_of_wait(int fd, short events, uint64_t deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	uint64_t now;
+	int ret;
+
+	do {
+		now = ovsd_now_us();
+		if (now >= deadline)
+			return -ETIMEDOUT;
+
+		ret = poll(&pfd, 1, (deadline - now + 999) / 1000);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return -errno;
+	if (!ret)
+		return -ETIMEDOUT;
+	return 0;
+}
+
+static int
+_of_write(int fd, const uint8_t *data, size_t len, uint64_t deadline)
+{
+	ssize_t n;
+	int ret;
+
+	while (len) {
+		if ((ret = _of_wait(fd, POLLOUT, deadline)))
+			return ret;
+
+		n = send(fd, data, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int
+_of_read(int fd, uint8_t *data, size_t len, uint64_t deadline)
+{
+	ssize_t n;
+	int ret;
+
+	while (len) {
+		if ((ret = _of_wait(fd, POLLIN, deadline)))
+			return ret;
+
+		n = read(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		if (!n)
+			return -ECONNRESET;
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Receive one message into b. Echo requests are answered transparently.
+ */
+static int
+_of_recv(struct of_conn *c, struct of_buf *b, uint64_t deadline)
+{
+	uint16_t len;
+	int ret;
+
+	for (;;) {
+		b->len = 0;
+		if (!_of_reserve(b, OFP_HEADER_LEN))
+			return -ENOMEM;
+
+		if ((ret = _of_read(c->fd, b->data, OFP_HEADER_LEN, deadline)))
+			return ret;
+
+		len = _of_get_u16(b->data + 2);
+		if (len < OFP_HEADER_LEN)
+			return -EPROTO;
+
+		if (!_of_reserve(b, len - OFP_HEADER_LEN))
+			return -ENOMEM;
+
+		ret = _of_read(c->fd, b->data + OFP_HEADER_LEN, len - OFP_HEADER_LEN,
+			deadline);
+		if (ret)
+			return ret;
+
+		if (b->data[1] != OFPT_ECHO_REQUEST)
+			return 0;
+
+		b->data[1] = OFPT_ECHO_REPLY;
+		if ((ret = _of_write(c->fd, b->data, len, deadline)))
+			return ret;
+	}
+}
+
+static struct of_conn *
+_of_conn_find(ovsd_name_t bridge)
+{
+	return bridge < n_of_conns ? of_conns[bridge] : NULL;
+}
+
+static int
+_of_conn_insert(struct of_conn *c)
+{
+	struct of_conn **conns;
+	ovsd_name_t n = ovsd_name_max();
+
+	if (c->name >= n_of_conns) {
+		conns = realloc(of_conns, n * sizeof(*conns));
+		if (!conns)
+			return -1;
+
+		memset(conns + n_of_conns, 0, (n - n_of_conns) * sizeof(*conns));
+		of_conns = conns;
+		n_of_conns = n;
+	}
+
+	of_conns[c->name] = c;
+	return 0;
+}
+
+static void
+_of_conn_close(struct of_conn *c)
+{
+	of_conns[c->name] = NULL;
+	ovsd_name_put(c->name);
+	close(c->fd);
+	free(c);
+}
+
+static int
+_of_hello(struct of_conn *c, uint64_t deadline)
+{
+	struct of_buf b = { 0 };
+	uint32_t bitmap = (1 << OFP_VERSION_13) | (1 << OFP_VERSION_14);
+	size_t start;
+	int ret;
+
+	start = _of_start_msg(&b, OFP_VERSION_14, OFPT_HELLO, c->xid++);
+	_of_put_u16(&b, 1);	// OFPHET_VERSIONBITMAP
+	_of_put_u16(&b, 8);
+	_of_put_u32(&b, bitmap);
+	_of_end_msg(&b, start);
+
+	if (b.error) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if ((ret = _of_write(c->fd, b.data, b.len, deadline)))
+		goto out;
+
+	if ((ret = _of_recv(c, &b, deadline)))
+		goto out;
+
+	if (b.data[1] != OFPT_HELLO) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	// prefer the version bitmap, fall back to the header version
+	if (b.len >= 16 && _of_get_u16(b.data + 8) == 1)
+		bitmap &= _of_get_u32(b.data + 12);
+	else if (b.data[0] < OFP_VERSION_14)
+		bitmap &= (1 << (b.data[0] + 1)) - 1;
+
+	if (bitmap & (1 << OFP_VERSION_14))
+		c->version = OFP_VERSION_14;
+	else if (bitmap & (1 << OFP_VERSION_13))
+		c->version = OFP_VERSION_13;
+	else
+		ret = -EPROTONOSUPPORT;
+
+out:
+	free(b.data);
+	return ret;
+}
+
+static struct of_conn *
+_of_conn_open(ovsd_name_t bridge)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *name = ovsd_name_str(bridge);
+	const char *dir = strrchr(OVS_DB_SOCK, '/');
+	struct of_conn *c;
+	int ret;
+
+	// the management sockets live next to the database socket
+	if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%.*s%s.mgmt",
+			dir ? (int) (dir - OVS_DB_SOCK + 1) : 0, OVS_DB_SOCK, name) >=
+			sizeof(addr.sun_path))
+		return NULL;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->xid = 1;
+
+	c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (c->fd < 0) {
+		free(c);
+		return NULL;
+	}
+
+	if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		ovsd_log_msg(L_WARNING, "%s: cannot connect to %s: %s\n", name,
+			addr.sun_path, strerror(errno));
+		goto error;
+	}
+
+	ret = _of_hello(c, ovsd_now_us() + OPENFLOW_TIMEOUT_MS * 1000);
+	if (ret) {
+		ovsd_log_msg(L_WARNING, "%s: OpenFlow handshake failed: %s\n", name,
+			strerror(-ret));
+		goto error;
+	}
+
+	c->name = ovsd_name_ref(bridge);
+	if (_of_conn_insert(c)) {
+		ovsd_name_put(c->name);
+		goto error;
+	}
+
+	return c;
+
+error:
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static struct of_conn *
+_of_conn_get(ovsd_name_t bridge)
+{
+	struct of_conn *c = _of_conn_find(bridge);
+
+	if (c)
+		return c;
+
+	return _of_conn_open(bridge);
+}
+
+static size_t
+_of_put_bundle_hdr(struct of_buf *b, struct of_conn *c, bool add_msg,
+	uint32_t xid)
+{
+	size_t start;
+
+	if (c->version >= OFP_VERSION_14)
+		return _of_start_msg(b, c->version,
+			add_msg ? OFPT_BUNDLE_ADD_MESSAGE : OFPT_BUNDLE_CONTROL, xid);
+
+	start = _of_start_msg(b, c->version, OFPT_EXPERIMENTER, xid);
+	_of_put_u32(b, ONF_EXPERIMENTER_ID);
+	_of_put_u32(b, add_msg ? ONFT_BUNDLE_ADD_MESSAGE : ONFT_BUNDLE_CONTROL);
+	return start;
+}
+
+static void
+_of_put_bundle_ctrl(struct of_buf *b, struct of_conn *c, uint32_t xid,
+	uint32_t bundle_id, uint16_t type)
+{
+	size_t start = _of_put_bundle_hdr(b, c, false, xid);
+
+	_of_put_u32(b, bundle_id);
+	_of_put_u16(b, type);
+	_of_put_u16(b, OFPBF_ATOMIC | OFPBF_ORDERED);
+	_of_end_msg(b, start);
+}
+
+static void
+_of_put_oxm(struct of_buf *b, uint8_t field, bool masked, const void *value,
+	const void *mask, uint8_t len)
+{
+	_of_put_u32(b, (OFPXMC_OPENFLOW_BASIC << 16) | (field << 9) |
+		(masked << 8) | (masked ? 2 * len : len));
+	_of_put(b, value, len);
+	if (masked)
+		_of_put(b, mask, len);
+}
+
+static void
+_of_put_oxm_u8(struct of_buf *b, uint8_t field, uint8_t v)
+{
+	_of_put_oxm(b, field, false, &v, NULL, 1);
+}
+
+static void
+_of_put_oxm_u16(struct of_buf *b, uint8_t field, uint16_t v)
+{
+	v = htons(v);
+	_of_put_oxm(b, field, false, &v, NULL, 2);
+}
+
+static void
+_of_put_oxm_u32(struct of_buf *b, uint8_t field, uint32_t v)
+{
+	v = htonl(v);
+	_of_put_oxm(b, field, false, &v, NULL, 4);
+}
+
+static int
+_of_put_oxm_mac(struct of_buf *b, uint8_t field, const char *str)
+{
+	uint8_t mac[6];
+
+	if (sscanf(str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1],
+			&mac[2], &mac[3], &mac[4], &mac[5]) != 6)
+		return -1;
+
+	_of_put_oxm(b, field, false, mac, NULL, 6);
+	return 0;
+}
+
+/* IPv4 address with optional prefix length, e.g. 10.0.0.0/8 */
+static int
+_of_put_oxm_ipv4(struct of_buf *b, uint8_t field, const char *str)
+{
+	char addr_str[INET_ADDRSTRLEN];
+	const char *slash = strchr(str, '/');
+	struct in_addr addr;
+	uint32_t mask;
+	int plen = 32;
+
+	if (slash) {
+		if (slash - str >= sizeof(addr_str))
+			return -1;
+		memcpy(addr_str, str, slash - str);
+		addr_str[slash - str] = '\0';
+		plen = atoi(slash + 1);
+	} else {
+		snprintf(addr_str, sizeof(addr_str), "%s", str);
+	}
+
+	if (plen < 0 || plen > 32 || inet_pton(AF_INET, addr_str, &addr) != 1)
+		return -1;
+
+	if (plen == 32) {
+		_of_put_oxm(b, field, false, &addr, NULL, 4);
+	} else {
+		mask = htonl(plen ? ~0U << (32 - plen) : 0);
+		addr.s_addr &= mask;
+		_of_put_oxm(b, field, true, &addr, &mask, 4);
+	}
+
+	return 0;
+}
+
+static int
+_of_resolve_port(struct of_port_cache *pc, const char *name, uint32_t *port)
+{
+	static const struct {
+		const char *name;
+		uint32_t port;
+	} reserved[] = {
+		{ "in_port", OFPP_IN_PORT },
+		{ "normal", OFPP_NORMAL },
+		{ "flood", OFPP_FLOOD },
+		{ "all", OFPP_ALL },
+		{ "controller", OFPP_CONTROLLER },
+		{ "local", OFPP_LOCAL },
+	};
+	char *end;
+	int ofport;
+
+	*port = strtoul(name, &end, 0);
+	if (*name && !*end)
+		return 0;
+
+	for (int i = 0; i < ARRAY_SIZE(reserved); i++) {
+		if (!strcmp(reserved[i].name, name)) {
+			*port = reserved[i].port;
+			return 0;
+		}
+	}
+
+	for (int i = 0; i < pc->n; i++) {
+		if (!strcmp(pc->name[i], name)) {
+			*port = pc->ofport[i];
+			return 0;
+		}
+	}
+
+	ofport = ovs_shell_get_ofport(name);
+	if (ofport <= 0)
+		return -1;
+
+	if (pc->n < OF_PORT_CACHE_SIZE) {
+		pc->name[pc->n] = name;
+		pc->ofport[pc->n++] = ofport;
+	}
+
+	*port = ofport;
+	return 0;
+}
+
+enum {
+	MATCHPOL_IN_PORT,
+	MATCHPOL_ETH_DST,
+	MATCHPOL_ETH_SRC,
+	MATCHPOL_ETH_TYPE,
+	MATCHPOL_VLAN_VID,
+	MATCHPOL_IP_PROTO,
+	MATCHPOL_IPV4_SRC,
+	MATCHPOL_IPV4_DST,
+	MATCHPOL_TCP_SRC,
+	MATCHPOL_TCP_DST,
+	MATCHPOL_UDP_SRC,
+	MATCHPOL_UDP_DST,
+	__MATCHPOL_MAX
+};
+static const struct blobmsg_policy match_policy[__MATCHPOL_MAX] = {
+	[MATCHPOL_IN_PORT] = { .name = "in_port", .type = BLOBMSG_TYPE_UNSPEC },
+	[MATCHPOL_ETH_DST] = { .name = "eth_dst", .type = BLOBMSG_TYPE_STRING },
+	[MATCHPOL_ETH_SRC] = { .name = "eth_src", .type = BLOBMSG_TYPE_STRING },
+	[MATCHPOL_ETH_TYPE] = { .name = "eth_type", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_VLAN_VID] = { .name = "vlan_vid", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_IP_PROTO] = { .name = "ip_proto", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_IPV4_SRC] = { .name = "ipv4_src", .type = BLOBMSG_TYPE_STRING },
+	[MATCHPOL_IPV4_DST] = { .name = "ipv4_dst", .type = BLOBMSG_TYPE_STRING },
+	[MATCHPOL_TCP_SRC] = { .name = "tcp_src", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_TCP_DST] = { .name = "tcp_dst", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_UDP_SRC] = { .name = "udp_src", .type = BLOBMSG_TYPE_INT32 },
+	[MATCHPOL_UDP_DST] = { .name = "udp_dst", .type = BLOBMSG_TYPE_INT32 },
+};
+
+static int
+_of_put_match(struct of_buf *b, struct blob_attr *attr,
+	struct of_port_cache *pc)
+{
+	static const uint8_t u16_fields[__MATCHPOL_MAX] = {
+		[MATCHPOL_TCP_SRC] = OXM_TCP_SRC,
+		[MATCHPOL_TCP_DST] = OXM_TCP_DST,
+		[MATCHPOL_UDP_SRC] = OXM_UDP_SRC,
+		[MATCHPOL_UDP_DST] = OXM_UDP_DST,
+	};
+	struct blob_attr *tb[__MATCHPOL_MAX];
+	size_t start = b->len;
+	uint32_t port;
+
+	_of_put_u16(b, OFPMT_OXM);
+	_of_put_u16(b, 0);
+
+	if (attr) {
+		blobmsg_parse(match_policy, __MATCHPOL_MAX, tb, blobmsg_data(attr),
+			blobmsg_data_len(attr));
+
+		if (tb[MATCHPOL_IN_PORT]) {
+			if (blobmsg_type(tb[MATCHPOL_IN_PORT]) == BLOBMSG_TYPE_INT32)
+				port = blobmsg_get_u32(tb[MATCHPOL_IN_PORT]);
+			else if (blobmsg_type(tb[MATCHPOL_IN_PORT]) != BLOBMSG_TYPE_STRING ||
+					_of_resolve_port(pc,
+						blobmsg_get_string(tb[MATCHPOL_IN_PORT]), &port))
+				return -1;
+			_of_put_oxm_u32(b, OXM_IN_PORT, port);
+		}
+
+		if (tb[MATCHPOL_ETH_DST] && _of_put_oxm_mac(b, OXM_ETH_DST,
+				blobmsg_get_string(tb[MATCHPOL_ETH_DST])))
+			return -1;
+		if (tb[MATCHPOL_ETH_SRC] && _of_put_oxm_mac(b, OXM_ETH_SRC,
+				blobmsg_get_string(tb[MATCHPOL_ETH_SRC])))
+			return -1;
+		if (tb[MATCHPOL_ETH_TYPE])
+			_of_put_oxm_u16(b, OXM_ETH_TYPE,
+				blobmsg_get_u32(tb[MATCHPOL_ETH_TYPE]));
+		if (tb[MATCHPOL_VLAN_VID])
+			_of_put_oxm_u16(b, OXM_VLAN_VID, OFPVID_PRESENT |
+				(blobmsg_get_u32(tb[MATCHPOL_VLAN_VID]) & 0xfff));
+		if (tb[MATCHPOL_IP_PROTO])
+			_of_put_oxm_u8(b, OXM_IP_PROTO,
+				blobmsg_get_u32(tb[MATCHPOL_IP_PROTO]));
+		if (tb[MATCHPOL_IPV4_SRC] && _of_put_oxm_ipv4(b, OXM_IPV4_SRC,
+				blobmsg_get_string(tb[MATCHPOL_IPV4_SRC])))
+			return -1;
+		if (tb[MATCHPOL_IPV4_DST] && _of_put_oxm_ipv4(b, OXM_IPV4_DST,
+				blobmsg_get_string(tb[MATCHPOL_IPV4_DST])))
+			return -1;
+
+		for (int i = 0; i < __MATCHPOL_MAX; i++) {
+			if (u16_fields[i] && tb[i])
+				_of_put_oxm_u16(b, u16_fields[i], blobmsg_get_u32(tb[i]));
+		}
+	}
+
+	// match length excludes the padding to 8 bytes
+	_of_set_u16(b, start + 2, b->len - start);
+	_of_pad(b, start, 8);
+	return 0;
+}
+
+static void
+_of_put_output(struct of_buf *b, uint32_t port)
+{
+	_of_put_u16(b, OFPAT_OUTPUT);
+	_of_put_u16(b, 16);
+	_of_put_u32(b, port);
+	_of_put_u16(b, port == OFPP_CONTROLLER ? OFPCML_NO_BUFFER : 0);
+	_of_reserve(b, 6);
+}
+
+/* Actions are strings in the style of ovs-ofctl: "output:<port>", "normal",
+ * "flood", "all", "controller", "local", "in_port", "drop", "pop_vlan",
+ * "push_vlan:<ethertype>", "set_vlan_vid:<vid>" and "goto_table:<id>".
+ * A bare port name or number is a shorthand for output.
+ */
+static int
+_of_put_instructions(struct of_buf *b, struct blob_attr *attr,
+	struct of_port_cache *pc)
+{
+	struct blob_attr *cur;
+	size_t start = 0, oxm_start;
+	int rem, goto_table = -1;
+	char *action, *arg;
+	uint32_t port;
+	uint16_t vid;
+
+	if (!attr)
+		return 0;
+
+	blobmsg_for_each_attr(cur, attr, rem) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+			return -1;
+
+		action = blobmsg_get_string(cur);
+		arg = strchr(action, ':');
+		arg = arg ? arg + 1 : NULL;
+
+		if (!strcmp(action, "drop"))
+			continue;
+
+		if (!strncmp(action, "goto_table:", 11)) {
+			goto_table = atoi(arg);
+			continue;
+		}
+
+		if (!start) {
+			start = b->len;
+			_of_put_u16(b, OFPIT_APPLY_ACTIONS);
+			_of_put_u16(b, 0);
+			_of_reserve(b, 4);
+		}
+
+		if (!strcmp(action, "pop_vlan")) {
+			_of_put_u16(b, OFPAT_POP_VLAN);
+			_of_put_u16(b, 8);
+			_of_reserve(b, 4);
+		} else if (!strncmp(action, "push_vlan:", 10)) {
+			_of_put_u16(b, OFPAT_PUSH_VLAN);
+			_of_put_u16(b, 8);
+			_of_put_u16(b, strtoul(arg, NULL, 0));
+			_of_reserve(b, 2);
+		} else if (!strncmp(action, "set_vlan_vid:", 13)) {
+			oxm_start = b->len;
+			vid = htons(OFPVID_PRESENT | (strtoul(arg, NULL, 0) & 0xfff));
+			_of_put_u16(b, OFPAT_SET_FIELD);
+			_of_put_u16(b, 0);
+			_of_put_oxm(b, OXM_VLAN_VID, false, &vid, NULL, 2);
+			_of_pad(b, oxm_start, 8);
+			_of_set_u16(b, oxm_start + 2, b->len - oxm_start);
+		} else {
+			if (!strncmp(action, "output:", 7))
+				action = arg;
+			if (_of_resolve_port(pc, action, &port))
+				return -1;
+			_of_put_output(b, port);
+		}
+	}
+
+	if (start)
+		_of_set_u16(b, start + 2, b->len - start);
+
+	if (goto_table >= 0) {
+		_of_put_u16(b, OFPIT_GOTO_TABLE);
+		_of_put_u16(b, 8);
+		_of_put_u8(b, goto_table);
+		_of_reserve(b, 3);
+	}
+
+	return 0;
+}
+
+enum {
+	FLOWPOL_TABLE,
+	FLOWPOL_PRIORITY,
+	FLOWPOL_COOKIE,
+	FLOWPOL_IDLE_TIMEOUT,
+	FLOWPOL_HARD_TIMEOUT,
+	FLOWPOL_MATCH,
+	FLOWPOL_ACTIONS,
+	__FLOWPOL_MAX
+};
+static const struct blobmsg_policy flow_policy[__FLOWPOL_MAX] = {
+	[FLOWPOL_TABLE] = { .name = "table", .type = BLOBMSG_TYPE_INT32 },
+	[FLOWPOL_PRIORITY] = { .name = "priority", .type = BLOBMSG_TYPE_INT32 },
+	[FLOWPOL_COOKIE] = { .name = "cookie", .type = BLOBMSG_TYPE_INT64 },
+	[FLOWPOL_IDLE_TIMEOUT] = { .name = "idle_timeout", .type = BLOBMSG_TYPE_INT32 },
+	[FLOWPOL_HARD_TIMEOUT] = { .name = "hard_timeout", .type = BLOBMSG_TYPE_INT32 },
+	[FLOWPOL_MATCH] = { .name = "match", .type = BLOBMSG_TYPE_TABLE },
+	[FLOWPOL_ACTIONS] = { .name = "actions", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+static int
+_of_put_flow_mod(struct of_buf *b, struct of_conn *c, uint32_t xid,
+	uint8_t command, struct blob_attr *flow, struct of_port_cache *pc)
+{
+	struct blob_attr *tb[__FLOWPOL_MAX];
+	bool delete = (command == OFPFC_DELETE || command == OFPFC_DELETE_STRICT);
+	uint64_t cookie;
+	size_t start;
+
+	if (blobmsg_type(flow) != BLOBMSG_TYPE_TABLE)
+		return -1;
+
+	blobmsg_parse(flow_policy, __FLOWPOL_MAX, tb, blobmsg_data(flow),
+		blobmsg_data_len(flow));
+
+	cookie = tb[FLOWPOL_COOKIE] ? blobmsg_get_u64(tb[FLOWPOL_COOKIE]) : 0;
+
+	start = _of_start_msg(b, c->version, OFPT_FLOW_MOD, xid);
+	_of_put_u64(b, cookie);
+	_of_put_u64(b, (delete && cookie) ? ~0ULL : 0);
+	_of_put_u8(b, tb[FLOWPOL_TABLE] ? blobmsg_get_u32(tb[FLOWPOL_TABLE]) :
+		(delete ? 0xff : 0));
+	_of_put_u8(b, command);
+	_of_put_u16(b, tb[FLOWPOL_IDLE_TIMEOUT] ?
+		blobmsg_get_u32(tb[FLOWPOL_IDLE_TIMEOUT]) : 0);
+	_of_put_u16(b, tb[FLOWPOL_HARD_TIMEOUT] ?
+		blobmsg_get_u32(tb[FLOWPOL_HARD_TIMEOUT]) : 0);
+	_of_put_u16(b, tb[FLOWPOL_PRIORITY] ?
+		blobmsg_get_u32(tb[FLOWPOL_PRIORITY]) : 0x8000);
+	_of_put_u32(b, OFP_NO_BUFFER);
+	_of_put_u32(b, OFPP_ANY);
+	_of_put_u32(b, OFPG_ANY);
+	_of_put_u16(b, 0);	// flags
+	_of_put_u16(b, 0);	// importance (1.4) or padding (1.3)
+
+	if (_of_put_match(b, tb[FLOWPOL_MATCH], pc))
+		return -1;
+
+	if (!delete && _of_put_instructions(b, tb[FLOWPOL_ACTIONS], pc))
+		return -1;
+
+	_of_end_msg(b, start);
+	return 0;
+}
+
+static bool
+_of_is_bundle_reply(struct of_conn *c, const uint8_t *msg, size_t len,
+	uint16_t type)
+{
+	const uint8_t *body = msg + OFP_HEADER_LEN;
+
+	if (c->version >= OFP_VERSION_14) {
+		if (msg[1] != OFPT_BUNDLE_CONTROL || len < 16)
+			return false;
+	} else {
+		if (msg[1] != OFPT_EXPERIMENTER || len < 24 ||
+				_of_get_u32(body) != ONF_EXPERIMENTER_ID ||
+				_of_get_u32(body + 4) != ONFT_BUNDLE_CONTROL)
+			return false;
+		body += 8;
+	}
+
+	return _of_get_u16(body + 4) == type;
+}
+
+static int
+_of_bundle_exchange(struct of_conn *c, uint8_t command, struct blob_attr *flows,
+	struct blob_buf *buf)
+{
+	struct of_port_cache pc = { .n = 0 };
+	struct of_buf b = { 0 };
+	struct blob_attr *cur;
+	uint64_t deadline = ovsd_now_us() + OPENFLOW_TIMEOUT_MS * 1000;
+	uint32_t bundle_id, first_xid, commit_xid, xid;
+	size_t start;
+	int rem, n_flows = 0, ret = OVSD_OK;
+	int failed_flow = -1;
+	uint16_t err_type = 0, err_code = 0;
+
+	bundle_id = c->xid;
+	_of_put_bundle_ctrl(&b, c, c->xid++, bundle_id, OFPBCT_OPEN_REQUEST);
+
+	first_xid = c->xid;
+	blobmsg_for_each_attr(cur, flows, rem) {
+		xid = c->xid++;
+
+		// the embedded message carries the xid of the add message
+		start = _of_put_bundle_hdr(&b, c, true, xid);
+		_of_put_u32(&b, bundle_id);
+		_of_put_u16(&b, 0);
+		_of_put_u16(&b, OFPBF_ATOMIC | OFPBF_ORDERED);
+		if (_of_put_flow_mod(&b, c, xid, command, cur, &pc)) {
+			blobmsg_add_u32(buf, "failed_flow", n_flows);
+			ret = OVSD_EINVALID_ARG;
+			goto out;
+		}
+		_of_end_msg(&b, start);
+		n_flows++;
+	}
+
+	commit_xid = c->xid++;
+	_of_put_bundle_ctrl(&b, c, commit_xid, bundle_id, OFPBCT_COMMIT_REQUEST);
+
+	if (b.error) {
+		ret = OVSD_EUNKNOWN;
+		goto out;
+	}
+
+	// everything goes out in one write, the switch answers in order
+	if (_of_write(c->fd, b.data, b.len, deadline))
+		goto io_error;
+
+	for (;;) {
+		if (_of_recv(c, &b, deadline))
+			goto io_error;
+
+		xid = _of_get_u32(b.data + 4);
+
+		// stale answers to an earlier exchange on this connection
+		if (xid - bundle_id > commit_xid - bundle_id)
+			continue;
+
+		if (b.data[1] == OFPT_ERROR && b.len >= 12) {
+			if (failed_flow < 0 && xid >= first_xid && xid < commit_xid) {
+				failed_flow = xid - first_xid;
+				err_type = _of_get_u16(b.data + 8);
+				err_code = _of_get_u16(b.data + 10);
+			} else if (!err_type) {
+				err_type = _of_get_u16(b.data + 8);
+				err_code = _of_get_u16(b.data + 10);
+			}
+		}
+
+		/*
+		 * The switch answers every request of the bundle, even after the
+		 * open request failed, so stop only at the answer to the commit or
+		 * the remaining replies would be read by the next exchange.
+		 */
+		if (xid != commit_xid)
+			continue;
+
+		if (b.data[1] == OFPT_ERROR ||
+				_of_is_bundle_reply(c, b.data, b.len, OFPBCT_COMMIT_REPLY))
+			break;
+
+		goto io_error;
+	}
+
+	if (err_type || failed_flow >= 0) {
+		if (failed_flow >= 0)
+			blobmsg_add_u32(buf, "failed_flow", failed_flow);
+		blobmsg_add_u32(buf, "error_type", err_type);
+		blobmsg_add_u32(buf, "error_code", err_code);
+		ret = OVSD_EOFREJECT;
+		goto out;
+	}
+
+	blobmsg_add_u32(buf, "flows", n_flows);
+	goto out;
+
+io_error:
+	ovsd_log_msg(L_WARNING, "%s: OpenFlow connection lost\n",
+		ovsd_name_str(c->name));
+	_of_conn_close(c);
+	ret = OVSD_EOFCONN;
+
+out:
+	free(b.data);
+	return ret;
+}
+
+int
+ovs_openflow_bundle(ovsd_name_t bridge, enum ovs_flow_cmd cmd, bool strict,
+	struct blob_attr *flows, struct blob_buf *buf)
+{
+	struct of_conn *c;
+	bool cached;
+	int ret;
+
+	if (cmd >= __OVS_FLOW_CMD_MAX)
+		return OVSD_EINVALID_ARG;
+
+	if (!bridge)
+		return OVSD_EINVALID_ARG;
+
+	cached = !!_of_conn_find(bridge);
+	c = _of_conn_get(bridge);
+	if (!c)
+		return OVSD_EOFCONN;
+
+	ret = _of_bundle_exchange(c, flow_mod_cmd[cmd][strict], flows, buf);
+
+	// the switch may have gone away since the connection was opened
+	if (ret == OVSD_EOFCONN && cached && (c = _of_conn_get(bridge)))
+		ret = _of_bundle_exchange(c, flow_mod_cmd[cmd][strict], flows, buf);
+
+	return ret;
+}
+
+/* Request the statistics of all tables, the switch may split the reply into
+ * several messages.
+ */
+static int
+_of_table_stats_exchange(struct of_conn *c, struct ovs_of_table_stats *stats,
+	int *n)
+{
+	struct of_buf b = { 0 };
+	uint64_t deadline = ovsd_now_us() + OPENFLOW_TIMEOUT_MS * 1000;
+	uint32_t xid = c->xid++;
+	const uint8_t *p;
+	uint16_t flags = OFPMPF_REPLY_MORE;
+	size_t start;
+	int max = *n, ret = OVSD_OK;
+
+	*n = 0;
+	start = _of_start_msg(&b, c->version, OFPT_MULTIPART_REQUEST, xid);
+	_of_put_u16(&b, OFPMP_TABLE_STATS);
+	_of_put_u16(&b, 0);
+	_of_put_u32(&b, 0);
+	_of_end_msg(&b, start);
+
+	if (b.error) {
+		ret = OVSD_EUNKNOWN;
+		goto out;
+	}
+
+	if (_of_write(c->fd, b.data, b.len, deadline))
+		goto io_error;
+
+	do {
+		if (_of_recv(c, &b, deadline))
+			goto io_error;
+
+		if (_of_get_u32(b.data + 4) != xid)
+			continue;
+
+		if (b.data[1] == OFPT_ERROR) {
+			ret = OVSD_EOFREJECT;
+			goto out;
+		}
+
+		if (b.data[1] != OFPT_MULTIPART_REPLY || b.len < 16 ||
+				_of_get_u16(b.data + 8) != OFPMP_TABLE_STATS)
+			goto io_error;
+
+		flags = _of_get_u16(b.data + 10);
+		for (p = b.data + 16; p + OFP_TABLE_STATS_LEN <= b.data + b.len &&
+				*n < max; p += OFP_TABLE_STATS_LEN) {
+			stats[*n].table = p[0];
+			stats[*n].active = _of_get_u32(p + 4);
+			stats[*n].lookup = _of_get_u64(p + 8);
+			stats[*n].matched = _of_get_u64(p + 16);
+			(*n)++;
+		}
+	} while (flags & OFPMPF_REPLY_MORE);
+
+	goto out;
+
+io_error:
+	ovsd_log_msg(L_WARNING, "%s: OpenFlow connection lost\n",
+		ovsd_name_str(c->name));
+	_of_conn_close(c);
+	ret = OVSD_EOFCONN;
+
+out:
+	free(b.data);
+	return ret;
+}
+
+int
+ovs_openflow_table_stats(ovsd_name_t bridge, struct ovs_of_table_stats *stats,
+	int *n)
+{
+	struct of_conn *c;
+	bool cached;
+	int ret, max = *n;
+
+	if (!bridge)
+		return OVSD_EINVALID_ARG;
+
+	cached = !!_of_conn_find(bridge);
+	c = _of_conn_get(bridge);
+	if (!c)
+		return OVSD_EOFCONN;
+
+	ret = _of_table_stats_exchange(c, stats, n);
+
+	// the switch may have gone away since the connection was opened
+	if (ret == OVSD_EOFCONN && cached && (c = _of_conn_get(bridge))) {
+		*n = max;
+		ret = _of_table_stats_exchange(c, stats, n);
+	}
+
+	return ret;
+}
+
+int
+ovs_openflow_connect(ovsd_name_t bridge)
+{
+	if (!bridge)
+		return OVSD_EINVALID_ARG;
+
+	return _of_conn_get(bridge) ? OVSD_OK : OVSD_EOFCONN;
+}
+
+void
+ovs_openflow_disconnect(ovsd_name_t bridge)
+{
+	struct of_conn *c = _of_conn_find(bridge);
+
+	if (c)
+		_of_conn_close(c);
+}
@@ -0,0 +1,52 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_OPENFLOW_H
+#define __OVSD_OPENFLOW_H
+
+#include "ovsd.h"
+#include "names.h"
+
+/* Upper bound for a complete bundle exchange with the switch */
+#define OPENFLOW_TIMEOUT_MS 5000
+
+enum ovs_flow_cmd {
+	OVS_FLOW_ADD,
+	OVS_FLOW_MODIFY,
+	OVS_FLOW_DELETE,
+	__OVS_FLOW_CMD_MAX
+};
+
+// OpenFlow numbers tables from 0 to 254
+#define OPENFLOW_TABLES_MAX 255
+
+struct ovs_of_table_stats {
+	uint8_t table;
+	uint32_t active;
+	uint64_t lookup;
+	uint64_t matched;
+};
+
+int ovs_openflow_connect(ovsd_name_t bridge);
+void ovs_openflow_disconnect(ovsd_name_t bridge);
+
+int ovs_openflow_bundle(ovsd_name_t bridge, enum ovs_flow_cmd cmd, bool strict,
+	struct blob_attr *flows, struct blob_buf *buf);
+
+/* Fill stats with the counters of up to *n tables of a bridge, *n is set to
+ * the number of tables reported.
+ */
+int ovs_openflow_table_stats(ovsd_name_t bridge,
+	struct ovs_of_table_stats *stats, int *n);
+
+#endif
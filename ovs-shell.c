@@ -14,20 +14,43 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 
 #include "ovs-shell.h"
+#include "config.h"
+#include "offline.h"
+#include "instance.h"
+#include "slowlog.h"
 
 #define CMD_LEN_MAX 65536
+#define SHELL_ARGS_MAX 32
+#define SHELL_OUTPUT_MAXSIZE 16384
 #define VLAN_TAG_MASK 0xfff
 
+// limits of the buffer for ovs_tables_load()
+#define TABLES_OUTPUT_MINSIZE (1 << 20)
+#define TABLES_OUTPUT_MAXSIZE (1 << 26)
+
+char *ovs_vsctl_path = "/usr/bin/ovs-vsctl";
+char *ovs_appctl_path = "/usr/bin/ovs-appctl";
+char *ovs_db_sock_path = OVS_RUNDIR "/db.sock";
+
 static char * const ovs_vsctl_cmd[__CMD_MAX] = {
 	[CMD_CREATE_BR] 		= "add-br",
 	[CMD_DEL_BR] 			= "del-br",
 	[CMD_ADD_PORT] 			= "add-port",
 	[CMD_DEL_PORT] 			= "del-port",
+	[CMD_ADD_BOND]			= "add-bond",
+	[CMD_ADD_BOND_IFACE]	= "add-bond-iface",
+	[CMD_DEL_BOND_IFACE]	= "del-bond-iface",
 	[CMD_BR_EXISTS]			= "br-exists",
 	[CMD_BR_TO_VLAN]		= "br-to-vlan",
 	[CMD_BR_TO_PARENT]		= "br-to-parent",
@@ -43,6 +66,15 @@ static char * const ovs_vsctl_cmd[__CMD_MAX] = {
 	[CMD_GET_SSL]			= "get-ssl",
 
 	[CMD_LIST_PORTS]		= "list-ports",
+	[CMD_LIST_IFACES]		= "list-ifaces",
+
+	[CMD_SET]				= "set",
+	[CMD_CLEAR]				= "clear",
+	[CMD_REMOVE]			= "remove",
+	[CMD_ADD]				= "add",
+	[CMD_CREATE]			= "create",
+	[CMD_GET]				= "get",
+	[CMD_LIST]				= "list",
 
 	[MODIFIER_MAY_EXIST]	= "--may-exist",
 	[MODIFIER_IF_EXISTS]	= "--if-exists",
@@ -60,22 +92,392 @@ ovs_cmd(enum ovs_vsctl_cmd cmd)
 	return ovs_vsctl_cmd[cmd];
 }
 
-int
-ovs_vsctl(char * const *argv)
+/* Deadline of the current operation, all ovs-vsctl calls made for it have to
+ * finish before. Without a deadline every call gets OVS_SHELL_TIMEOUT_MS.
+ */
+static uint64_t op_deadline_us;
+static bool op_timed_out;
+
+void
+ovs_shell_set_deadline(uint64_t deadline_us)
+{
+	op_deadline_us = deadline_us;
+	op_timed_out = false;
+}
+
+bool
+ovs_shell_timed_out(void)
+{
+	return op_timed_out;
+}
+
+static int
+_ovs_shell_wait(pid_t pid, int *status, struct rusage *ru, uint64_t deadline)
+{
+	pid_t rc;
+
+	for (;;) {
+		rc = wait4(pid, status, WNOHANG, ru);
+		if (rc == pid)
+			return 0;
+		if (rc < 0 && errno != EINTR)
+			return -1;
+		if (ovsd_now_us() >= deadline)
+			return OVSD_ETIMEOUT;
+
+		poll(NULL, 0, 5);
+	}
+}
+
+static int
+_ovs_shell_expired(char * const *argv)
+{
+	if (!op_timed_out)
+		ovsd_log_msg(L_WARNING, "ovs-vsctl %s: timed out\n",
+			argv[1] ? argv[1] : "");
+
+	op_timed_out = true;
+	return OVSD_ETIMEOUT;
+}
+
+static uint64_t
+_tv_us(struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* Read what is available on one of the output pipes of a child into buf, up
+ * to len - 1 bytes, and discard the rest. Returns false once the pipe is
+ * closed.
+ */
+static bool
+_ovs_shell_read(int fd, char *buf, size_t len, size_t *pos)
 {
-	int rc, status;
-	pid_t pid = fork();
-	if (!pid)
-		exit(execv(OVS_VSCTL, argv));
+	char discard[256];
+	ssize_t n;
+
+	do {
+		if (buf && *pos + 1 < len)
+			n = read(fd, buf + *pos, len - 1 - *pos);
+		else
+			n = read(fd, discard, sizeof(discard));
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0)
+		return false;
+
+	if (buf && *pos + 1 < len)
+		*pos += n;
+	return true;
+}
+
+/* Run a command and collect up to out_len - 1 bytes of its output into out, if
+ * given, and the beginning of its error output and its resource usage into
+ * call. The child is killed and reaped if it does not finish before the
+ * deadline. Returns the exit status of the child, -1 if it could not be run or
+ * OVSD_ETIMEOUT.
+ */
+static int
+_ovs_shell_run(char * const *argv, char *out, size_t out_len,
+	struct ovsd_call *call)
+{
+	struct ovsd_instance *inst = ovsd_instance_current();
+	struct pollfd pfd[2] = { { .events = POLLIN }, { .events = POLLIN } };
+	uint64_t now = ovsd_now_us(), deadline;
+	size_t argc, len = 0, err_len = 0, skip = 1;
+	int fds[2], efds[2], status, rc, n_open = 2;
+	char timeout_arg[32];
+	struct rusage ru;
+	pid_t pid;
+
+	deadline = op_deadline_us ? op_deadline_us :
+		now + OVS_SHELL_TIMEOUT_MS * 1000ULL;
+	if (now >= deadline)
+		return _ovs_shell_expired(argv);
+
+	// let ovs-vsctl give up on the database by itself first
+	snprintf(timeout_arg, sizeof(timeout_arg), "--timeout=%llu",
+		(unsigned long long) ((deadline - now) / 1000000 ?: 1));
+
+	for (argc = 0; argv[argc]; argc++);
+
+	char *exec_argv[argc + 3];
+	exec_argv[0] = argv[0];
+	exec_argv[skip++] = timeout_arg;
+	if (inst->db_arg)
+		exec_argv[skip++] = inst->db_arg;
+	memcpy(&exec_argv[skip], &argv[1], argc * sizeof(*argv));
+
+	if (pipe(fds))
+		return -1;
+
+	if (pipe(efds)) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		fcntl(efds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	pid = fork();
+	if (!pid) {
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(efds[1], STDERR_FILENO);
+		execv(argv[0], exec_argv);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	close(efds[1]);
 	if (pid < 0) {
-		rc = -1;
-	} else {
-		while ((rc = waitpid(pid, &status, 0)) == -1 && errno == EINTR);
-		rc = (rc == pid && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+		close(fds[0]);
+		close(efds[0]);
+		return -1;
 	}
+
+	// read until ovs-vsctl closes its output, i.e. exits
+	pfd[0].fd = fds[0];
+	pfd[1].fd = efds[0];
+	while (n_open) {
+		now = ovsd_now_us();
+		if (now >= deadline)
+			break;
+
+		rc = poll(pfd, 2, (deadline - now + 999) / 1000);
+		if (rc < 0 && errno != EINTR)
+			break;
+		if (rc <= 0)
+			continue;
+
+		// a closed pipe is left out of further polls by a negative fd
+		if (pfd[0].revents &&
+				!_ovs_shell_read(fds[0], out, out_len, &len)) {
+			pfd[0].fd = -1;
+			n_open--;
+		}
+		if (pfd[1].revents && !_ovs_shell_read(efds[0], call->err,
+				sizeof(call->err), &err_len)) {
+			pfd[1].fd = -1;
+			n_open--;
+		}
+	}
+	close(fds[0]);
+	close(efds[0]);
+
+	if (out)
+		out[len] = '\0';
+	call->err[err_len] = '\0';
+
+	memset(&ru, 0, sizeof(ru));
+	rc = _ovs_shell_wait(pid, &status, &ru, deadline);
+	if (rc == OVSD_ETIMEOUT) {
+		kill(pid, SIGKILL);
+		while (wait4(pid, NULL, 0, &ru) < 0 && errno == EINTR);
+	}
+
+	call->utime_us = _tv_us(&ru.ru_utime);
+	call->stime_us = _tv_us(&ru.ru_stime);
+	call->maxrss_kb = ru.ru_maxrss;
+
+	if (rc == OVSD_ETIMEOUT) {
+		call->timed_out = true;
+		if (!inst->db_arg)
+			ovsd_offline_failed(OVSD_ETIMEOUT);
+		return _ovs_shell_expired(argv);
+	}
+
+	rc = (!rc && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+	if (!inst->db_arg && (rc < 0 || rc == OVS_VSCTL_STATUS_ERROR))
+		ovsd_offline_failed(rc);
+
 	return rc;
 }
 
+/* Run ovs-vsctl (or ovs-appctl, given as argv[0]) against the selected
+ * instance and account the call to it and to the slow call log.
+ */
+static int
+_ovs_shell_exec(char * const *argv, char *out, size_t out_len)
+{
+	struct ovsd_instance *inst = ovsd_instance_current();
+	struct ovsd_call call;
+	uint64_t start;
+	int rc;
+
+	if (inst->db_arg) {
+		// ovs-appctl only talks to the local ovs-vswitchd
+		if (strcmp(argv[0], OVS_VSCTL))
+			return -1;
+
+		// the circuit breaker of the instance is open, don't bother
+		if (!ovsd_instance_available(inst))
+			return OVSD_EOFFLINE;
+	} else if (ovsd_offline_active()) {
+		return OVSD_EOFFLINE;
+	}
+
+	// out of time before the call, which is not the fault of the instance
+	start = ovsd_now_us();
+	if (op_deadline_us && start >= op_deadline_us)
+		return _ovs_shell_expired(argv);
+
+	memset(&call, 0, sizeof(call));
+	rc = _ovs_shell_run(argv, out, out_len, &call);
+	call.status = call.timed_out ? -1 : rc;
+	call.wall_us = ovsd_now_us() - start;
+
+	ovsd_instance_account(inst, rc, call.wall_us);
+	ovsd_slowlog_record(argv, inst->name, &call);
+
+	return rc;
+}
+
+/* Run an ovs-vsctl command given as a string of space separated words followed
+ * by an optional bridge (or other last argument) and capture its output.
+ */
+static int
+_ovs_shell_output(const char *cmd, const char *bridge, char *out,
+	size_t out_len)
+{
+	size_t args_len = strlen(cmd) + (bridge ? strlen(bridge) : 0) + 2;
+	char *argv[SHELL_ARGS_MAX], *tok, *save;
+	int argc = 0;
+
+	if (args_len > CMD_LEN_MAX)
+		return -1;
+
+	char args[args_len];
+	sprintf(args, "%s %s", cmd, bridge ? bridge : "");
+
+	argv[argc++] = OVS_VSCTL;
+	for (tok = strtok_r(args, " ", &save); tok && argc < SHELL_ARGS_MAX - 1;
+			tok = strtok_r(NULL, " ", &save))
+		argv[argc++] = tok;
+	argv[argc] = NULL;
+
+	return _ovs_shell_exec(argv, out, out_len);
+}
+
+int
+ovs_vsctl(char * const *argv)
+{
+	return _ovs_shell_exec(argv, NULL, 0);
+}
+
+/* Like ovs_vsctl(), but capture up to out_len - 1 bytes of the output */
+int
+ovs_vsctl_output(char * const *argv, char *out, size_t out_len)
+{
+	return _ovs_shell_exec(argv, out, out_len);
+}
+
+void
+ovs_txn_init(struct ovs_txn *txn)
+{
+	memset(txn, 0, sizeof(*txn));
+	ovs_txn_arg(txn, OVS_VSCTL);
+}
+
+void
+ovs_txn_free(struct ovs_txn *txn)
+{
+	for (size_t i = 0; i < txn->n_owned; i++)
+		free(txn->owned[i]);
+
+	free(txn->owned);
+	free(txn->argv);
+	memset(txn, 0, sizeof(*txn));
+}
+
+bool
+ovs_txn_empty(struct ovs_txn *txn)
+{
+	return txn->argc <= 1;
+}
+
+void
+ovs_txn_arg(struct ovs_txn *txn, const char *arg)
+{
+	char **argv;
+
+	// always leave room for the terminating NULL
+	if (txn->argc + 2 > txn->alloc) {
+		size_t alloc = txn->alloc ? txn->alloc * 2 : 32;
+
+		argv = realloc(txn->argv, alloc * sizeof(*argv));
+		if (!argv) {
+			txn->error = true;
+			return;
+		}
+
+		txn->argv = argv;
+		txn->alloc = alloc;
+	}
+
+	txn->argv[txn->argc++] = (char *) arg;
+	txn->argv[txn->argc] = NULL;
+}
+
+void
+ovs_txn_argf(struct ovs_txn *txn, const char *format, ...)
+{
+	char **owned, *arg;
+	va_list ap;
+	int len;
+
+	owned = realloc(txn->owned, (txn->n_owned + 1) * sizeof(*owned));
+	if (!owned) {
+		txn->error = true;
+		return;
+	}
+	txn->owned = owned;
+
+	va_start(ap, format);
+	len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	if (len < 0 || !(arg = malloc(len + 1))) {
+		txn->error = true;
+		return;
+	}
+
+	va_start(ap, format);
+	vsnprintf(arg, len + 1, format, ap);
+	va_end(ap);
+
+	txn->owned[txn->n_owned++] = arg;
+	ovs_txn_arg(txn, arg);
+}
+
+void
+ovs_txn_cmd(struct ovs_txn *txn, ...)
+{
+	const char *arg;
+	va_list ap;
+
+	ovs_txn_arg(txn, ovs_cmd(ATOMIC_CMD_SEPARATOR));
+
+	va_start(ap, txn);
+	while ((arg = va_arg(ap, const char *)))
+		ovs_txn_arg(txn, arg);
+	va_end(ap);
+}
+
+int
+ovs_txn_commit(struct ovs_txn *txn)
+{
+	if (txn->error)
+		return OVSD_EUNKNOWN;
+
+	if (ovs_txn_empty(txn))
+		return OVSD_OK;
+
+	return ovs_vsctl(txn->argv);
+}
+
 /* Remove leading and trailing whitespace from string
  */
 static char *
@@ -164,49 +566,25 @@ void
 ovs_shell_capture_string(const char *cmd, const char *bridge,
 		const char *name, struct blob_buf *buf)
 {
-	char output[256];
-	FILE *f;
-
-	size_t cmd_len = strlen(OVS_VSCTL) + strlen(cmd) + strlen(bridge) + 3;
-
-	if (cmd_len > CMD_LEN_MAX)
-		return;
-
-	char cmd_str[cmd_len];
-	sprintf(cmd_str, "%s %s %s", OVS_VSCTL, cmd, bridge);
+	char output[SHELL_OUTPUT_LINE_MAXSIZE], *nl;
 
-	if ((f = popen(cmd_str, "r")) == NULL)
+	if (_ovs_shell_output(cmd, bridge, output, sizeof(output)))
 		return;
 
-	if (fgets(output, 256, f) == NULL)
-		goto done;
+	if ((nl = strchr(output, '\n')))
+		*nl = '\0';
 
 	blobmsg_add_string(buf, name, sanitize(output));
-
-done:
-	pclose(f);
 }
 
 void
 ovs_shell_capture_list(const char *cmd, const char *bridge,
 	const char *list_name, struct blob_buf *buf, bool table)
 {
-	char *tmp, output[512];
-	FILE *f;
+	char *tmp, *line, *save, output[SHELL_OUTPUT_MAXSIZE];
 	void *list;
-	size_t cmd_len;
-
-	cmd_len = strlen(OVS_VSCTL) + 1 + strlen(cmd) + 1;
-	if (bridge)
-		cmd_len += strlen(bridge) + 1;
-
-	if (cmd_len > CMD_LEN_MAX)
-		return;
-
-	char cmd_str[cmd_len];
-	sprintf(cmd_str, "%s %s %s", OVS_VSCTL, cmd, bridge ? bridge : "");
 
-	if ((f = popen(cmd_str, "r")) == NULL)
+	if (_ovs_shell_output(cmd, bridge, output, sizeof(output)))
 		return;
 
 	if (table)
@@ -214,14 +592,17 @@ ovs_shell_capture_list(const char *cmd, const char *bridge,
 	else
 		list = blobmsg_open_array(buf, list_name);
 
-	while (fgets(output, 512, f) != NULL) {
+	for (line = strtok_r(output, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (strlen(line) >= SHELL_OUTPUT_LINE_MAXSIZE)
+			line[SHELL_OUTPUT_LINE_MAXSIZE - 1] = '\0';
 
 		// in case of table, separate key and value
-		if (table && (tmp = strchr(output, ':'))) {
+		if (table && (tmp = strchr(line, ':'))) {
 			*tmp++ = '\0';
-			blobmsg_add_string(buf, sanitize(output), sanitize(tmp));
+			blobmsg_add_string(buf, sanitize(line), sanitize(tmp));
 		} else {
-			blobmsg_add_string(buf, NULL, sanitize(output));
+			blobmsg_add_string(buf, NULL, sanitize(line));
 		}
 	}
 
@@ -229,7 +610,187 @@ ovs_shell_capture_list(const char *cmd, const char *bridge,
 		blobmsg_close_table(buf, list);
 	else
 		blobmsg_close_array(buf, list);
-	pclose(f);
+}
+
+static const struct {
+	char *table;
+	char *columns;
+	int n_cols;
+} ovs_table_info[__OVS_TABLE_MAX] = {
+	[OVS_TABLE_BRIDGES] = { "Bridge", "name,ports,controller,fail_mode",
+		__BRCOL_MAX },
+	[OVS_TABLE_PORTS] = { "Port", "_uuid,name,tag", __PORTCOL_MAX },
+	[OVS_TABLE_CONTROLLERS] = { "Controller", "_uuid,target", __CTLCOL_MAX },
+};
+
+// output buffer size that held the last listing, the next one starts with it
+static size_t tables_output_size = TABLES_OUTPUT_MINSIZE;
+
+static int
+_cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Split a line of CSV into fields in place. Quoted fields may contain commas
+ * and doubled quotes. Returns the number of fields, -1 if there are more than
+ * max.
+ */
+static int
+_csv_split(char *line, char **fields, int max)
+{
+	char *r = line, *w = line;
+	int n = 0;
+
+	while (n < max) {
+		fields[n++] = w;
+		if (*r == '"') {
+			for (r++; *r; r++) {
+				if (*r == '"' && *++r != '"')
+					break;
+				*w++ = *r;
+			}
+		} else {
+			while (*r && *r != ',')
+				*w++ = *r++;
+		}
+
+		if (*r != ',') {
+			*w = '\0';
+			return *r ? -1 : n;
+		}
+
+		r++;
+		*w++ = '\0';
+	}
+
+	return -1;
+}
+
+static int
+_table_add_row(struct ovs_table *t, char *line)
+{
+	char **cols;
+
+	if ((t->n_rows + 1) * t->n_cols > t->alloc) {
+		int alloc = t->alloc ? t->alloc * 2 : 16 * t->n_cols;
+
+		cols = realloc(t->cols, alloc * sizeof(*cols));
+		if (!cols)
+			return OVSD_EUNKNOWN;
+
+		t->cols = cols;
+		t->alloc = alloc;
+	}
+
+	if (_csv_split(line, t->cols + t->n_rows * t->n_cols, t->n_cols) !=
+			t->n_cols)
+		return OVSD_EUNKNOWN;
+
+	t->n_rows++;
+	return OVSD_OK;
+}
+
+/* List all tables with --format=csv --data=bare in one ovs-vsctl call. Every
+ * table starts with its headings, which are also where one table ends and
+ * the next one begins. If the output fills the buffer, the call is repeated
+ * with twice the room.
+ */
+int
+ovs_tables_load(struct ovs_tables *t)
+{
+	char *argv[4 + 4 * __OVS_TABLE_MAX], colargs[__OVS_TABLE_MAX][64];
+	char *out, *line;
+	int argc = 0, n = -1, ret;
+
+	memset(t, 0, sizeof(*t));
+
+	argv[argc++] = OVS_VSCTL;
+	argv[argc++] = "--format=csv";
+	argv[argc++] = "--data=bare";
+	for (int i = 0; i < __OVS_TABLE_MAX; i++) {
+		if (i)
+			argv[argc++] = "--";
+		snprintf(colargs[i], sizeof(colargs[i]), "--columns=%s",
+			ovs_table_info[i].columns);
+		argv[argc++] = colargs[i];
+		argv[argc++] = ovs_cmd(CMD_LIST);
+		argv[argc++] = ovs_table_info[i].table;
+		t->tables[i].n_cols = ovs_table_info[i].n_cols;
+	}
+	argv[argc] = NULL;
+
+	for (;;) {
+		out = realloc(t->out, tables_output_size);
+		if (!out)
+			return OVSD_EUNKNOWN;
+		t->out = out;
+
+		ret = ovs_vsctl_output(argv, out, tables_output_size);
+		if (ret)
+			return ret;
+
+		if (strlen(out) < tables_output_size - 1)
+			break;
+
+		// a full buffer may have cut off rows, ask again with more room
+		if (tables_output_size >= TABLES_OUTPUT_MAXSIZE) {
+			ovsd_log_msg(L_WARNING, "list: output too large\n");
+			return OVSD_EUNKNOWN;
+		}
+		tables_output_size *= 2;
+	}
+
+	while ((line = strsep(&out, "\n"))) {
+		if (!*line)
+			continue;
+
+		if (n + 1 < __OVS_TABLE_MAX &&
+				!strcmp(line, ovs_table_info[n + 1].columns)) {
+			n++;
+			continue;
+		}
+
+		if (n < 0 || _table_add_row(&t->tables[n], line))
+			return OVSD_EUNKNOWN;
+	}
+
+	if (n != __OVS_TABLE_MAX - 1)
+		return OVSD_EUNKNOWN;
+
+	for (int i = 0; i < __OVS_TABLE_MAX; i++)
+		qsort(t->tables[i].cols, t->tables[i].n_rows,
+			t->tables[i].n_cols * sizeof(*t->tables[i].cols), _cmp_str);
+
+	return OVSD_OK;
+}
+
+void
+ovs_tables_free(struct ovs_tables *t)
+{
+	for (int i = 0; i < __OVS_TABLE_MAX; i++)
+		free(t->tables[i].cols);
+	free(t->out);
+	memset(t, 0, sizeof(*t));
+}
+
+char *
+ovs_table_col(struct ovs_tables *t, enum ovs_table_id table, int row, int col)
+{
+	return t->tables[table].cols[row * t->tables[table].n_cols + col];
+}
+
+// find the row whose first column is key
+int
+ovs_table_find(struct ovs_tables *t, enum ovs_table_id table, const char *key)
+{
+	struct ovs_table *tbl = &t->tables[table];
+	char **row;
+
+	row = bsearch(&key, tbl->cols, tbl->n_rows,
+		tbl->n_cols * sizeof(*tbl->cols), _cmp_str);
+
+	return row ? (row - tbl->cols) / tbl->n_cols : -1;
 }
 
 bool
@@ -250,28 +811,16 @@ ovs_shell_br_exists(char *name)
 static int
 _ovs_shell_get_output(const char *cmd, const char *bridge, char *buf, int n)
 {
-	FILE *f;
-	size_t cmd_len;
-	int ret = 0;
-
-	cmd_len = strlen(OVS_VSCTL) + 1 + strlen(cmd) + 1;
-	if (bridge)
-		cmd_len += strlen(bridge) + 1;
-
-	if (cmd_len > CMD_LEN_MAX)
-		return -1;
-
-	char cmd_str[cmd_len];
-	sprintf(cmd_str, "%s %s %s", OVS_VSCTL, cmd, bridge ? bridge : "");
+	char *nl;
 
-	if ((f = popen(cmd_str, "r")) == NULL)
+	if (_ovs_shell_output(cmd, bridge, buf, n))
 		return -1;
 
-	if (fgets(buf, n, f) == NULL)
-		ret = -1;
+	// only the first line is of interest
+	if ((nl = strchr(buf, '\n')))
+		*nl = '\0';
 
-	pclose(f);
-	return ret;
+	return buf[0] ? 0 : -1;
 }
 
 int
@@ -288,124 +837,613 @@ ovs_shell_br_to_vlan(char *bridge)
 	return atoi(buf);
 }
 
-size_t
-ovs_shell_br_to_parent(char *bridge, char *buf, size_t n)
+/* Returns a reference to the interned name of the bridge's parent. For
+ * bridges that are not fake bridges, this is the bridge itself.
+ */
+ovsd_name_t
+ovs_shell_br_to_parent(char *bridge)
 {
-	char out_buf[64];
+	char out_buf[SHELL_OUTPUT_LINE_MAXSIZE];
 
 	if (!ovs_shell_br_exists(bridge))
-		return 0;
+		return OVSD_NAME_NONE;
 
-	if (_ovs_shell_get_output(ovs_cmd(CMD_BR_TO_PARENT), bridge, out_buf, 64))
-		return 0;
+	if (_ovs_shell_get_output(ovs_cmd(CMD_BR_TO_PARENT), bridge, out_buf,
+			sizeof(out_buf)))
+		return OVSD_NAME_NONE;
 
-	sanitize(out_buf);
-	strncpy(buf, out_buf, n);
-	return strnlen(out_buf, 64);
+	return ovsd_name_get(sanitize(out_buf));
 }
 
+/* Look up the OpenFlow port number of an interface. Returns -1 if the
+ * interface does not exist or has no port number assigned (yet).
+ */
 int
-ovs_shell_create_bridge(struct ovswitch_br_config *cfg)
+ovs_shell_get_ofport(const char *iface)
 {
-	bool fake_br = false;
-	size_t ovs_vsctl_nargs = 2;	// program name and terminating NULL
-	size_t cur_arg;
+	char buf[16];
+	size_t cmd_len = strlen(iface) + strlen(" ofport") + 1;
 
-	// 1: add-br 2: --may-exist 3: br-name
-	ovs_vsctl_nargs += 3;
+	if (cmd_len > CMD_LEN_MAX)
+		return -1;
 
-	// in case of fake bridge, check args
-	if (cfg->parent && (cfg->vlan_tag >= 0)) {
+	char arg[cmd_len];
+	sprintf(arg, "%s ofport", iface);
 
-		// check 802.1q compliance
-		if (cfg->vlan_tag > 0 && ((cfg->vlan_tag & VLAN_TAG_MASK) == 0xfff))
-			return OVSD_EINVALID_VLAN;
+	if (_ovs_shell_get_output("get interface", arg, buf, sizeof(buf)))
+		return -1;
 
-		// check if parent bridge exists
-		if (!ovs_shell_br_exists(cfg->parent))
-			return OVSD_ENOPARENT;
+	return atoi(buf) > 0 ? atoi(buf) : -1;
+}
 
-		ovs_vsctl_nargs += 2;
-		fake_br = true;
+/* Append the commands creating and configuring a bridge to a transaction.
+ * The parent of a fake bridge has to exist or be created earlier in the same
+ * transaction.
+ */
+int
+ovs_shell_txn_add_bridge(struct ovs_txn *txn, struct ovswitch_br_config *cfg)
+{
+	// check 802.1q compliance of fake bridges, nothing is added on error
+	if (cfg->parent && cfg->vlan_tag > 0 &&
+			((cfg->vlan_tag & VLAN_TAG_MASK) == 0xfff))
+		return OVSD_EINVALID_VLAN;
+
+	// create bridge command w/ may exist modifier
+	ovs_txn_cmd(txn, ovs_cmd(MODIFIER_MAY_EXIST), ovs_cmd(CMD_CREATE_BR),
+		cfg->name, NULL);
+
+	// fake bridge parameters
+	if (cfg->parent) {
+		ovs_txn_arg(txn, cfg->parent);
+		ovs_txn_argf(txn, "%hu", cfg->vlan_tag);
+		return OVSD_OK;
+	}
+
+	ovs_shell_txn_tune_bridge(txn, cfg, false);
+	ovs_shell_txn_add_bond(txn, cfg, false);
+	ovs_shell_txn_set_telemetry(txn, cfg, false);
+	ovs_shell_txn_set_mirrors(txn, cfg, NULL, 0, false);
+	ovs_shell_txn_set_flow_tables(txn, cfg, false);
+
+	if (!cfg->ofcontrollers)
+		return OVSD_OK;
+
+	ovs_shell_txn_set_controllers(txn, cfg);
+	return OVSD_OK;
+}
+
+/* Append the commands creating the controllers of a bridge with their
+ * connection settings and attaching them to the bridge, replacing the
+ * existing ones like set-controller does. The database drops the old rows.
+ */
+static void
+_ovs_shell_txn_create_controllers(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg)
+{
+	char refs[cfg->n_ofcontrollers * 48 + 32];
+	size_t id = txn->argc, off;
+
+	for (int i = 0; i < cfg->n_ofcontrollers; i++) {
+		ovs_txn_cmd(txn, NULL);
+		ovs_txn_argf(txn, "--id=@c%zu_%d", id, i);
+		ovs_txn_arg(txn, ovs_cmd(CMD_CREATE));
+		ovs_txn_arg(txn, "Controller");
+		ovs_txn_argf(txn, "target=\"%s\"", cfg->ofcontrollers[i]);
+
+		if (cfg->ctl_inactivity_probe >= 0)
+			ovs_txn_argf(txn, "inactivity_probe=%d",
+				cfg->ctl_inactivity_probe);
+		if (cfg->ctl_max_backoff >= 0)
+			ovs_txn_argf(txn, "max_backoff=%d", cfg->ctl_max_backoff);
+		if (cfg->ctl_rate_limit >= 0)
+			ovs_txn_argf(txn, "controller_rate_limit=%d",
+				cfg->ctl_rate_limit);
+		if (cfg->ctl_burst_limit >= 0)
+			ovs_txn_argf(txn, "controller_burst_limit=%d",
+				cfg->ctl_burst_limit);
+		if (cfg->ctl_connection_mode)
+			ovs_txn_argf(txn, "connection_mode=%s",
+				cfg->ctl_connection_mode);
+	}
+
+	off = sprintf(refs, "controller=[");
+	for (int i = 0; i < cfg->n_ofcontrollers; i++)
+		off += sprintf(refs + off, "%s@c%zu_%d", i ? "," : "", id, i);
+	strcpy(refs + off, "]");
+
+	ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+	ovs_txn_arg(txn, refs);
+}
+
+/* Append the commands setting the OpenFlow controllers, fail mode and SSL
+ * options of a bridge. Controllers with connection settings are created
+ * with them in the same transaction.
+ */
+void
+ovs_shell_txn_set_controllers(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg)
+{
+	if (!cfg->parent && ovsd_config_has_controller_tuning(cfg)) {
+		_ovs_shell_txn_create_controllers(txn, cfg);
+	} else {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET_OFCTL), cfg->name, NULL);
+		for (int i = 0; i < cfg->n_ofcontrollers; i++)
+			ovs_txn_arg(txn, cfg->ofcontrollers[i]);
+	}
+
+	// fail mode in case of OF controller unavailability
+	switch (cfg->fail_mode) {
+		case OVS_FAIL_MODE_SECURE:
+			ovs_txn_cmd(txn, ovs_cmd(CMD_SET_FAIL_MODE), cfg->name, "secure",
+				NULL);
+			break;
+		case OVS_FAIL_MODE_STANDALONE:
+			ovs_txn_cmd(txn, ovs_cmd(CMD_SET_FAIL_MODE), cfg->name,
+				"standalone", NULL);
+			break;
+		default: break;
 	}
 
-	// 1: atomic cmd separator, 2: set-controller cmd,
-	// 3: bridge, 4...: controllers
-	if (!fake_br && cfg->ofcontrollers) {
-		ovs_vsctl_nargs += 3 + cfg->n_ofcontrollers;
-		// 1: atomic cmd separator, 2: set-fail-mode, 3: bridge, 4: fail-mode
-		ovs_vsctl_nargs += 4;
+	// SSL options
+	if (cfg->ssl_privkey_file) {
+		ovs_txn_cmd(txn, NULL);
+		if (cfg->ssl_bootstrap)
+			ovs_txn_arg(txn, ovs_cmd(MODIFIER_SSL_BOOTSTRAP));
+		ovs_txn_arg(txn, ovs_cmd(CMD_SET_SSL));
+		ovs_txn_arg(txn, cfg->ssl_privkey_file);
+		ovs_txn_arg(txn, cfg->ssl_cert_file);
+		ovs_txn_arg(txn, cfg->ssl_cacert_file);
+	}
+}
+
+/* Append the commands applying the datapath tuning options of a bridge. The
+ * global options of ovs-vswitchd are only ever set, never removed, since
+ * other bridges may have set them. If clear is set, the datapath type of the
+ * bridge falls back to the default.
+ */
+void
+ovs_shell_txn_tune_bridge(struct ovs_txn *txn, struct ovswitch_br_config *cfg,
+	bool clear)
+{
+	if (cfg->datapath_type || clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "datapath_type=%s",
+			cfg->datapath_type ? cfg->datapath_type : "system");
+	}
+
+	// MAC learning settings not given fall back to the defaults
+	if (cfg->mac_table_size >= 0) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "other_config:mac-table-size=%d",
+			cfg->mac_table_size);
+	} else if (clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_REMOVE), "Bridge", cfg->name,
+			"other_config", "mac-table-size", NULL);
+	}
+
+	if (cfg->mac_aging_time >= 0) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "other_config:mac-aging-time=%d",
+			cfg->mac_aging_time);
+	} else if (clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_REMOVE), "Bridge", cfg->name,
+			"other_config", "mac-aging-time", NULL);
+	}
+
+	if (cfg->flow_limit < 0 && cfg->max_idle < 0 &&
+			cfg->n_handler_threads < 0 && cfg->n_revalidator_threads < 0 &&
+			!cfg->pmd_cpu_mask)
+		return;
+
+	ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Open_vSwitch", ".", NULL);
+	if (cfg->flow_limit >= 0)
+		ovs_txn_argf(txn, "other_config:flow-limit=%d", cfg->flow_limit);
+	if (cfg->max_idle >= 0)
+		ovs_txn_argf(txn, "other_config:max-idle=%d", cfg->max_idle);
+	if (cfg->n_handler_threads >= 0)
+		ovs_txn_argf(txn, "other_config:n-handler-threads=%d",
+			cfg->n_handler_threads);
+	if (cfg->n_revalidator_threads >= 0)
+		ovs_txn_argf(txn, "other_config:n-revalidator-threads=%d",
+			cfg->n_revalidator_threads);
+	if (cfg->pmd_cpu_mask)
+		ovs_txn_argf(txn, "other_config:pmd-cpu-mask=%s", cfg->pmd_cpu_mask);
+}
+
+/* Append the commands creating the bond of a bridge, if it has one, and
+ * applying its settings. If clear is set, settings not given are reset.
+ */
+void
+ovs_shell_txn_add_bond(struct ovs_txn *txn, struct ovswitch_br_config *cfg,
+	bool clear)
+{
+	if (!cfg->n_bond_members)
+		return;
+
+	ovs_txn_cmd(txn, ovs_cmd(MODIFIER_MAY_EXIST), ovs_cmd(CMD_ADD_BOND),
+		cfg->name, cfg->bond_name, NULL);
+	for (int i = 0; i < cfg->n_bond_members; i++)
+		ovs_txn_arg(txn, cfg->bond_members[i]);
+
+	ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Port", cfg->bond_name, NULL);
+	ovs_txn_argf(txn, "bond_mode=%s", cfg->bond_mode);
+	ovs_txn_argf(txn, "lacp=%s", cfg->lacp);
+	ovs_txn_argf(txn, "other_config:lacp-time=%s", cfg->lacp_time);
+
+	if (cfg->bond_rebalance_interval >= 0)
+		ovs_txn_argf(txn, "other_config:bond-rebalance-interval=%d",
+			cfg->bond_rebalance_interval);
+	else if (clear)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_REMOVE), "Port", cfg->bond_name,
+			"other_config", "bond-rebalance-interval", NULL);
+}
 
-		// SSL options: 5 or 6 options
-		// separator, (--bootstrap), set-ssl, private key, cert, CA cert
-		if (cfg->ssl_privkey_file) {
-			if (cfg->ssl_bootstrap)
-				ovs_vsctl_nargs += 6;
-			else
-				ovs_vsctl_nargs += 5;
+// set column of strings, e.g. targets=["192.0.2.1:6343","192.0.2.2:6343"]
+static void
+_txn_arg_strset(struct ovs_txn *txn, const char *column, char **vals, int n)
+{
+	size_t len = strlen(column) + 4, off;
+
+	for (int i = 0; i < n; i++)
+		len += strlen(vals[i]) + 3;
+
+	char arg[len];
+	off = sprintf(arg, "%s=[", column);
+	for (int i = 0; i < n; i++)
+		off += sprintf(arg + off, "%s\"%s\"", i ? "," : "", vals[i]);
+	strcpy(arg + off, "]");
+
+	ovs_txn_arg(txn, arg);
+}
+
+/* Append the commands applying the sFlow and IPFIX settings of a bridge. The
+ * records are replaced as a whole, the database drops the old ones once they
+ * are no longer referenced. If clear is set, telemetry not given is disabled.
+ */
+void
+ovs_shell_txn_set_telemetry(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear)
+{
+	// record ids have to be unique within the transaction
+	size_t id = txn->argc;
+
+	if (cfg->n_sflow_targets) {
+		ovs_txn_cmd(txn, NULL);
+		ovs_txn_argf(txn, "--id=@sflow%zu", id);
+		ovs_txn_arg(txn, ovs_cmd(CMD_CREATE));
+		ovs_txn_arg(txn, "sFlow");
+		_txn_arg_strset(txn, "targets", cfg->sflow_targets,
+			cfg->n_sflow_targets);
+		if (cfg->sflow_agent)
+			ovs_txn_argf(txn, "agent=\"%s\"", cfg->sflow_agent);
+		if (cfg->sflow_sampling > 0)
+			ovs_txn_argf(txn, "sampling=%d", cfg->sflow_sampling);
+		if (cfg->sflow_polling >= 0)
+			ovs_txn_argf(txn, "polling=%d", cfg->sflow_polling);
+		if (cfg->sflow_header > 0)
+			ovs_txn_argf(txn, "header=%d", cfg->sflow_header);
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "sflow=@sflow%zu", id);
+	} else if (clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Bridge", cfg->name, "sflow",
+			NULL);
+	}
+
+	if (cfg->n_ipfix_targets) {
+		ovs_txn_cmd(txn, NULL);
+		ovs_txn_argf(txn, "--id=@ipfix%zu", id);
+		ovs_txn_arg(txn, ovs_cmd(CMD_CREATE));
+		ovs_txn_arg(txn, "IPFIX");
+		_txn_arg_strset(txn, "targets", cfg->ipfix_targets,
+			cfg->n_ipfix_targets);
+		if (cfg->ipfix_sampling > 0)
+			ovs_txn_argf(txn, "sampling=%d", cfg->ipfix_sampling);
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "ipfix=@ipfix%zu", id);
+	} else if (clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Bridge", cfg->name, "ipfix",
+			NULL);
+	}
+}
+
+static bool
+_port_available(struct ovswitch_br_config *cfg, const char *port,
+	ovsd_name_t *ports, int n_ports)
+{
+	ovsd_name_t name;
+
+	if (cfg->n_bond_members && !strcmp(cfg->bond_name, port))
+		return true;
+
+	name = ovsd_name_lookup(port);
+	for (int i = 0; name && i < n_ports; i++)
+		if (ports[i] == name)
+			return true;
+
+	return false;
+}
+
+static bool
+_mirror_ready(struct ovswitch_br_config *cfg, struct ovsd_mirror *m,
+	ovsd_name_t *ports, int n_ports)
+{
+	if (m->output_port && !_port_available(cfg, m->output_port, ports,
+			n_ports))
+		return false;
+
+	for (int i = 0; i < m->n_select; i++)
+		if (!_port_available(cfg, m->select[i], ports, n_ports))
+			return false;
+
+	return true;
+}
+
+/* Append the commands creating the mirrors of a bridge. Mirrors refer to
+ * their ports, so only those are created whose ports are all among the given
+ * ones (or are the bond of the bridge). If clear is set, existing mirrors are
+ * removed first. The database drops removed mirrors.
+ */
+void
+ovs_shell_txn_set_mirrors(struct ovs_txn *txn, struct ovswitch_br_config *cfg,
+	ovsd_name_t *ports, int n_ports, bool clear)
+{
+	struct ovsd_mirror *m;
+	size_t id = txn->argc;
+
+	if (clear)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Bridge", cfg->name, "mirrors",
+			NULL);
+
+	for (int i = 0; i < cfg->n_mirrors; i++) {
+		m = &cfg->mirrors[i];
+		if (!_mirror_ready(cfg, m, ports, n_ports))
+			continue;
+
+		for (int j = 0; j < m->n_select; j++) {
+			ovs_txn_cmd(txn, NULL);
+			ovs_txn_argf(txn, "--id=@m%zu_%ds%d", id, i, j);
+			ovs_txn_arg(txn, ovs_cmd(CMD_GET));
+			ovs_txn_arg(txn, "Port");
+			ovs_txn_arg(txn, m->select[j]);
+		}
+
+		if (m->output_port) {
+			ovs_txn_cmd(txn, NULL);
+			ovs_txn_argf(txn, "--id=@m%zu_%do", id, i);
+			ovs_txn_arg(txn, ovs_cmd(CMD_GET));
+			ovs_txn_arg(txn, "Port");
+			ovs_txn_arg(txn, m->output_port);
+		}
+
+		ovs_txn_cmd(txn, NULL);
+		ovs_txn_argf(txn, "--id=@m%zu_%d", id, i);
+		ovs_txn_arg(txn, ovs_cmd(CMD_CREATE));
+		ovs_txn_arg(txn, "Mirror");
+		ovs_txn_argf(txn, "name=\"%s\"", m->name);
+
+		if (!m->n_select)
+			ovs_txn_arg(txn, "select_all=true");
+
+		// a mirrored port is selected in both directions
+		for (int dir = 0; dir < 2 && m->n_select; dir++) {
+			char sel[m->n_select * 48 + 32];
+			size_t off;
+
+			off = sprintf(sel, "%s=[", dir ? "select_dst_port" :
+				"select_src_port");
+			for (int j = 0; j < m->n_select; j++)
+				off += sprintf(sel + off, "%s@m%zu_%ds%d", j ? "," : "", id,
+					i, j);
+			strcpy(sel + off, "]");
+			ovs_txn_arg(txn, sel);
 		}
+
+		if (m->output_port)
+			ovs_txn_argf(txn, "output_port=@m%zu_%do", id, i);
+		else
+			ovs_txn_argf(txn, "output_vlan=%d", m->output_vlan);
+
+		ovs_txn_cmd(txn, ovs_cmd(CMD_ADD), "Bridge", cfg->name, "mirrors",
+			NULL);
+		ovs_txn_argf(txn, "@m%zu_%d", id, i);
 	}
+}
 
-	// build argv for ovs-vsctl
-	char *ovs_vsctl_argv[ovs_vsctl_nargs];
+/* Append the commands creating the Flow_Table records of a bridge and mapping
+ * them to their table numbers. A table already configured is replaced. If
+ * clear is set, the other tables fall back to the defaults. The database
+ * drops the old records.
+ */
+void
+ovs_shell_txn_set_flow_tables(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear)
+{
+	struct ovsd_flow_table *t;
+	size_t id = txn->argc;
+
+	if (clear)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Bridge", cfg->name,
+			"flow_tables", NULL);
+
+	for (int i = 0; i < cfg->n_flow_tables; i++) {
+		t = &cfg->flow_tables[i];
+
+		ovs_txn_cmd(txn, NULL);
+		ovs_txn_argf(txn, "--id=@t%zu_%d", id, i);
+		ovs_txn_arg(txn, ovs_cmd(CMD_CREATE));
+		ovs_txn_arg(txn, "Flow_Table");
+
+		if (t->flow_limit >= 0)
+			ovs_txn_argf(txn, "flow_limit=%d", t->flow_limit);
+		if (t->overflow_policy)
+			ovs_txn_argf(txn, "overflow_policy=%s", t->overflow_policy);
+		if (t->name)
+			ovs_txn_argf(txn, "name=\"%s\"", t->name);
+
+		if (t->n_groups) {
+			size_t len = 16;
+			for (int j = 0; j < t->n_groups; j++)
+				len += strlen(t->groups[j]) + 3;
+
+			char groups[len];
+			size_t off = sprintf(groups, "groups=[");
+			for (int j = 0; j < t->n_groups; j++)
+				off += sprintf(groups + off, "%s\"%s\"", j ? "," : "",
+					t->groups[j]);
+			strcpy(groups + off, "]");
+			ovs_txn_arg(txn, groups);
+		}
 
-	cur_arg = 0;
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Bridge", cfg->name, NULL);
+		ovs_txn_argf(txn, "flow_tables:%d=@t%zu_%d", t->table, id, i);
+	}
+}
 
-	// program name
-	ovs_vsctl_argv[cur_arg++] = OVS_VSCTL;
+/* Add the given columns of the records a column of a bridge refers to, e.g.
+ * its sFlow settings, to buf. If list is set, every record is a table in an
+ * array, otherwise the (single) record is added as a table.
+ */
+void
+ovs_shell_capture_refs(char *bridge, char *column, char *table,
+	const char * const *columns, const char *name, bool list,
+	struct blob_buf *buf)
+{
+	char refs[SHELL_OUTPUT_MAXSIZE], out[SHELL_OUTPUT_MAXSIZE];
+	char colarg[SHELL_OUTPUT_LINE_MAXSIZE], *ref, *save, *line, *next;
+	void *arr = NULL, *tbl;
+	size_t off;
 
-	// create bridge command w/ may exist modifier
-	ovs_vsctl_argv[cur_arg++] = ovs_cmd(MODIFIER_MAY_EXIST);
-	ovs_vsctl_argv[cur_arg++] = ovs_cmd(CMD_CREATE_BR);
+	char * const get_argv[] = {
+		OVS_VSCTL, ovs_cmd(CMD_GET), "Bridge", bridge, column, NULL
+	};
 
-	// bridge name
-	ovs_vsctl_argv[cur_arg++] = cfg->name;
+	if (ovs_vsctl_output(get_argv, refs, sizeof(refs)))
+		return;
 
-	// fake bridge parameters
-	if (fake_br) {
-		ovs_vsctl_argv[cur_arg++] = cfg->parent;
-		ovs_vsctl_argv[cur_arg] = alloca(6 * sizeof(char));
-		sprintf(ovs_vsctl_argv[cur_arg++], "%hu", cfg->vlan_tag);
-	} else if (cfg->ofcontrollers) {
-		ovs_vsctl_argv[cur_arg++] = ovs_cmd(ATOMIC_CMD_SEPARATOR);
-		ovs_vsctl_argv[cur_arg++] = ovs_cmd(CMD_SET_OFCTL);
-		ovs_vsctl_argv[cur_arg++] = cfg->name;
-		for (int i = 0; i < cfg->n_ofcontrollers; i++)
-			ovs_vsctl_argv[cur_arg++] = cfg->ofcontrollers[i];
-
-		// fail mode in case of OF controller unavailability
-		switch (cfg->fail_mode) {
-			case OVS_FAIL_MODE_SECURE:
-				ovs_vsctl_argv[cur_arg++] = ovs_cmd(ATOMIC_CMD_SEPARATOR);
-				ovs_vsctl_argv[cur_arg++] = ovs_cmd(CMD_SET_FAIL_MODE);
-				ovs_vsctl_argv[cur_arg++] = cfg->name;
-				ovs_vsctl_argv[cur_arg++] = "secure";
-				break;
-			case OVS_FAIL_MODE_STANDALONE:
-				ovs_vsctl_argv[cur_arg++] = ovs_cmd(ATOMIC_CMD_SEPARATOR);
-				ovs_vsctl_argv[cur_arg++] = ovs_cmd(CMD_SET_FAIL_MODE);
-				ovs_vsctl_argv[cur_arg++] = cfg->name;
-				ovs_vsctl_argv[cur_arg++] = "standalone";
-				break;
-			default: break;
+	off = snprintf(colarg, sizeof(colarg), "--columns=");
+	for (int i = 0; columns[i] && off < sizeof(colarg); i++)
+		off += snprintf(colarg + off, sizeof(colarg) - off, "%s%s",
+			i ? "," : "", columns[i]);
+
+	if (list)
+		arr = blobmsg_open_array(buf, name);
+
+	for (ref = strtok_r(refs, "[], \n", &save); ref;
+			ref = strtok_r(NULL, "[], \n", &save)) {
+		char * const argv[] = {
+			OVS_VSCTL, "--bare", colarg, ovs_cmd(CMD_LIST), table, ref, NULL
+		};
+
+		if (ovs_vsctl_output(argv, out, sizeof(out)))
+			continue;
+
+		// one line per column, empty columns give empty lines
+		tbl = blobmsg_open_table(buf, list ? NULL : name);
+		next = out;
+		for (int i = 0; columns[i]; i++) {
+			line = next ? strsep(&next, "\n") : "";
+			blobmsg_add_string(buf, columns[i], line);
 		}
+		blobmsg_close_table(buf, tbl);
+
+		if (!list)
+			break;
+	}
 
-		// SSL options
-		if (cfg->ssl_privkey_file) {
-			ovs_vsctl_argv[cur_arg++] = ovs_cmd(ATOMIC_CMD_SEPARATOR);
-			if (cfg->ssl_bootstrap)
-				ovs_vsctl_argv[cur_arg++] = ovs_cmd(MODIFIER_SSL_BOOTSTRAP);
-			ovs_vsctl_argv[cur_arg++] = ovs_cmd(CMD_SET_SSL);
-			ovs_vsctl_argv[cur_arg++] = cfg->ssl_privkey_file;
-			ovs_vsctl_argv[cur_arg++] = cfg->ssl_cert_file;
-			ovs_vsctl_argv[cur_arg++] = cfg->ssl_cacert_file;
+	if (list)
+		blobmsg_close_array(buf, arr);
+}
+
+/* Append the command setting the number of receive queues of an interface,
+ * a negative number removes the setting if clear is set.
+ */
+void
+ovs_shell_txn_set_rxq(struct ovs_txn *txn, const char *iface, int n_rxq,
+	bool clear)
+{
+	if (n_rxq > 0) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Interface", iface, NULL);
+		ovs_txn_argf(txn, "other_config:n_rxq=%d", n_rxq);
+	} else if (clear) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_REMOVE), "Interface", iface,
+			"other_config", "n_rxq", NULL);
+	}
+}
+
+void
+ovs_shell_txn_add_port(struct ovs_txn *txn, const char *bridge,
+	const char *port, struct ovsd_port_vlan *vlan)
+{
+	ovs_txn_cmd(txn, ovs_cmd(MODIFIER_MAY_EXIST), ovs_cmd(CMD_ADD_PORT),
+		bridge, port, NULL);
+
+	if (vlan)
+		ovs_shell_txn_set_port_vlan(txn, port, vlan, false);
+}
+
+/* Append the commands applying the 802.1Q settings of a port. If clear is
+ * set, options not given are removed from the port, otherwise they are left
+ * as they are.
+ */
+void
+ovs_shell_txn_set_port_vlan(struct ovs_txn *txn, const char *port,
+	struct ovsd_port_vlan *vlan, bool clear)
+{
+	char trunks[4096 * 5 + 1];
+	struct blob_attr *cur;
+	size_t len = 0;
+	int rem;
+
+	if (ovsd_config_has_vlan(vlan)) {
+		ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Port", port, NULL);
+
+		if (vlan->tag >= 0)
+			ovs_txn_argf(txn, "tag=%d", vlan->tag);
+
+		if (vlan->trunks) {
+			trunks[0] = '\0';
+			blobmsg_for_each_attr(cur, vlan->trunks, rem) {
+				if (len + 6 > sizeof(trunks))
+					break;
+
+				len += sprintf(trunks + len, "%s%u", len ? "," : "",
+					blobmsg_get_u32(cur));
+			}
+			ovs_txn_argf(txn, "trunks=[%s]", trunks);
 		}
+
+		if (vlan->mode)
+			ovs_txn_argf(txn, "vlan_mode=%s", vlan->mode);
 	}
 
-	// execv needs terminating NULL in argv
-	ovs_vsctl_argv[cur_arg] = NULL;
+	if (!clear)
+		return;
+
+	if (vlan->tag < 0)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Port", port, "tag", NULL);
+	if (!vlan->trunks)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Port", port, "trunks", NULL);
+	if (!vlan->mode)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Port", port, "vlan_mode", NULL);
+}
+
+int
+ovs_shell_create_bridge(struct ovswitch_br_config *cfg)
+{
+	struct ovs_txn txn;
+	int ret;
+
+	// in case of fake bridge, check if parent bridge exists
+	if (cfg->parent && !ovs_shell_br_exists(cfg->parent))
+		return OVSD_ENOPARENT;
 
-	return ovs_vsctl(ovs_vsctl_argv);
+	ovs_txn_init(&txn);
+	ret = ovs_shell_txn_add_bridge(&txn, cfg);
+	if (!ret)
+		ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	return ret;
 }
 
 int
@@ -423,17 +1461,35 @@ ovs_shell_delete_bridge(char *bridge)
 }
 
 int
-ovs_shell_add_port(char *bridge, char *port)
+ovs_shell_add_port(char *bridge, char *port, struct ovsd_port_vlan *vlan,
+	int n_rxq)
 {
+	struct ovs_txn txn;
+	int ret;
+
 	if (!ovs_shell_br_exists(bridge))
 		return OVSD_ENOEXIST;
 
+	// the port is added with its VLAN membership in one transaction
+	ovs_txn_init(&txn);
+	ovs_shell_txn_add_port(&txn, bridge, port, vlan);
+	ovs_shell_txn_set_rxq(&txn, port, n_rxq, false);
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	return ret;
+}
+
+/* Add an interface to or remove it from an existing bond */
+int
+ovs_shell_set_bond_iface(char *bond, char *iface, bool add)
+{
 	char * const argv[6] = {
 		[0] = OVS_VSCTL,
-		[1] = ovs_cmd(MODIFIER_MAY_EXIST),
-		[2] = ovs_cmd(CMD_ADD_PORT),
-		[3] = bridge,
-		[4] = port,
+		[1] = ovs_cmd(add ? MODIFIER_MAY_EXIST : MODIFIER_IF_EXISTS),
+		[2] = ovs_cmd(add ? CMD_ADD_BOND_IFACE : CMD_DEL_BOND_IFACE),
+		[3] = bond,
+		[4] = iface,
 		[5] = NULL,
 	};
 
@@ -17,16 +17,33 @@
 #include <stdbool.h>
 
 #include "ovsd.h"
+#include "names.h"
 
-#define OVS_VSCTL "/usr/bin/ovs-vsctl"
+/* Paths of the Open vSwitch utilities and of the socket of the local
+ * database, which can be replaced by stand-ins e.g. for load tests.
+ */
+extern char *ovs_vsctl_path;
+extern char *ovs_appctl_path;
+extern char *ovs_db_sock_path;
+
+#define OVS_VSCTL ovs_vsctl_path
+#define OVS_APPCTL ovs_appctl_path
+#define OVS_RUNDIR "/var/run/openvswitch"
+#define OVS_DB_SOCK ovs_db_sock_path
 
 #define SHELL_OUTPUT_LINE_MAXSIZE 256
 
+// time limit of a single ovs-vsctl call outside of any operation deadline
+#define OVS_SHELL_TIMEOUT_MS 10000
+
 enum ovs_vsctl_cmd {
 	CMD_CREATE_BR,
 	CMD_DEL_BR,
 	CMD_ADD_PORT,
 	CMD_DEL_PORT,
+	CMD_ADD_BOND,
+	CMD_ADD_BOND_IFACE,
+	CMD_DEL_BOND_IFACE,
 	CMD_BR_EXISTS,
 	CMD_BR_TO_VLAN,
 	CMD_BR_TO_PARENT,
@@ -43,6 +60,15 @@ enum ovs_vsctl_cmd {
 	CMD_GET_SSL,
 
 	CMD_LIST_PORTS,
+	CMD_LIST_IFACES,
+
+	CMD_SET,
+	CMD_CLEAR,
+	CMD_REMOVE,
+	CMD_ADD,
+	CMD_CREATE,
+	CMD_GET,
+	CMD_LIST,
 
 	MODIFIER_MAY_EXIST,
 	MODIFIER_IF_EXISTS,
@@ -58,6 +84,61 @@ enum ovs_vsctl_cmd {
 
 char * const ovs_cmd(enum ovs_vsctl_cmd);
 int ovs_vsctl(char * const *argv);
+int ovs_vsctl_output(char * const *argv, char *out, size_t out_len);
+
+/* Set the absolute time (see ovsd_now_us()) by which all ovs-vsctl calls of
+ * the current operation have to be done, 0 for none. Calls that overrun it
+ * are killed and fail with OVSD_ETIMEOUT.
+ */
+void ovs_shell_set_deadline(uint64_t deadline_us);
+bool ovs_shell_timed_out(void);
+
+/* Builder for ovs-vsctl invocations that combine any number of commands into
+ * one database transaction.
+ */
+struct ovs_txn {
+	char **argv;
+	size_t argc;
+	size_t alloc;
+
+	// strings allocated by ovs_txn_argf()
+	char **owned;
+	size_t n_owned;
+
+	bool error;
+};
+
+void ovs_txn_init(struct ovs_txn *txn);
+void ovs_txn_free(struct ovs_txn *txn);
+bool ovs_txn_empty(struct ovs_txn *txn);
+
+/* Start a new command consisting of the given NULL-terminated arguments */
+void ovs_txn_cmd(struct ovs_txn *txn, ...);
+void ovs_txn_arg(struct ovs_txn *txn, const char *arg);
+void ovs_txn_argf(struct ovs_txn *txn, const char *format, ...);
+
+int ovs_txn_commit(struct ovs_txn *txn);
+
+int ovs_shell_txn_add_bridge(struct ovs_txn *txn, struct ovswitch_br_config *cfg);
+void ovs_shell_txn_add_port(struct ovs_txn *txn, const char *bridge,
+	const char *port, struct ovsd_port_vlan *vlan);
+void ovs_shell_txn_set_port_vlan(struct ovs_txn *txn, const char *port,
+	struct ovsd_port_vlan *vlan, bool clear);
+void ovs_shell_txn_set_controllers(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg);
+void ovs_shell_txn_tune_bridge(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear);
+void ovs_shell_txn_add_bond(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear);
+void ovs_shell_txn_set_telemetry(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear);
+void ovs_shell_txn_set_mirrors(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, ovsd_name_t *ports, int n_ports,
+	bool clear);
+void ovs_shell_txn_set_flow_tables(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, bool clear);
+void ovs_shell_txn_set_rxq(struct ovs_txn *txn, const char *iface, int n_rxq,
+	bool clear);
 
 void ovs_shell_capture_string(const char *cmd, const char *bridge,
 	const char *name, struct blob_buf *buf);
@@ -65,12 +146,70 @@ void ovs_shell_capture_string(const char *cmd, const char *bridge,
 void ovs_shell_capture_list(const char *cmd, const char *bridge,
 	const char *list_name, struct blob_buf *buf, bool table);
 
+void ovs_shell_capture_refs(char *bridge, char *column, char *table,
+	const char * const *columns, const char *name, bool list,
+	struct blob_buf *buf);
+
+/* The Bridge, Port and Controller tables of the selected instance, read with
+ * one ovs-vsctl call by ovs_tables_load(). The rows of each table are sorted
+ * by their first column, the strings point into the output of ovs-vsctl.
+ */
+enum ovs_table_id {
+	OVS_TABLE_BRIDGES,
+	OVS_TABLE_PORTS,
+	OVS_TABLE_CONTROLLERS,
+	__OVS_TABLE_MAX
+};
+
+enum {
+	BRCOL_NAME,
+	BRCOL_PORTS,
+	BRCOL_CONTROLLER,
+	BRCOL_FAIL_MODE,
+	__BRCOL_MAX
+};
+
+enum {
+	PORTCOL_UUID,
+	PORTCOL_NAME,
+	PORTCOL_TAG,
+	__PORTCOL_MAX
+};
+
+enum {
+	CTLCOL_UUID,
+	CTLCOL_TARGET,
+	__CTLCOL_MAX
+};
+
+struct ovs_table {
+	char **cols;
+	int n_cols;
+	int n_rows;
+	int alloc;
+};
+
+struct ovs_tables {
+	struct ovs_table tables[__OVS_TABLE_MAX];
+	char *out;
+};
+
+int ovs_tables_load(struct ovs_tables *t);
+void ovs_tables_free(struct ovs_tables *t);
+char *ovs_table_col(struct ovs_tables *t, enum ovs_table_id table, int row,
+	int col);
+int ovs_table_find(struct ovs_tables *t, enum ovs_table_id table,
+	const char *key);
+
 bool ovs_shell_br_exists(char *name);
 int ovs_shell_br_to_vlan(char *bridge);
-size_t ovs_shell_br_to_parent(char *bridge, char *buf, size_t n);
+ovsd_name_t ovs_shell_br_to_parent(char *bridge);
+int ovs_shell_get_ofport(const char *iface);
 int ovs_shell_create_bridge(struct ovswitch_br_config *cfg);
 int ovs_shell_delete_bridge(char *bridge);
-int ovs_shell_add_port(char *bridge, char *port);
+int ovs_shell_add_port(char *bridge, char *port,
+	struct ovsd_port_vlan *vlan, int n_rxq);
 int ovs_shell_remove_port(char *bridge, char *port);
+int ovs_shell_set_bond_iface(char *bond, char *iface, bool add);
 
 #endif //OVSD_OVS_SHELL_H
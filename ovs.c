@@ -12,26 +12,261 @@
  * GNU General Public License for more details.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ovs.h"
 #include "ovs-shell.h"
+#include "tunnel.h"
+#include "state.h"
+#include "bond.h"
+#include "config.h"
+#include "instance.h"
+#include "patch.h"
 
+/* Fake bridges share the OpenFlow switch of their parent. The management
+ * socket of bridges in remote instances is out of reach.
+ */
+static void
+_ovs_create_connect(struct ovswitch_br_config *cfg)
+{
+	ovsd_name_t name;
+
+	if (cfg->parent || !ovsd_instance_is_local())
+		return;
+
+	name = ovsd_name_get(cfg->name);
+	ovs_openflow_connect(name);
+	ovsd_name_put(name);
+}
+
+/* The bridge is created together with the patch ports linking it to its
+ * peers. If that fails, e.g. because a peer went missing, the bridge is
+ * created on its own.
+ */
 int
 ovs_create(struct ovswitch_br_config *cfg)
 {
-	int ret = ovs_shell_create_bridge(cfg);
+	struct ovs_txn txn;
+	int ret;
 
-	if (ret)
-		fprintf(stderr, "Could not create bridge '%s': %s\n",
+	// in case of fake bridge, check if parent bridge exists
+	if (cfg->parent && !ovs_shell_br_exists(cfg->parent))
+		return OVSD_ENOPARENT;
+
+	ovs_txn_init(&txn);
+	ret = ovs_shell_txn_add_bridge(&txn, cfg);
+	if (!ret) {
+		ovs_patch_txn_link(&txn, cfg);
+		ret = ovs_txn_commit(&txn);
+	}
+	ovs_txn_free(&txn);
+
+	if (ret && cfg->n_patch_peers) {
+		ovsd_log_msg(L_WARNING, "Could not link bridge '%s' to its peers: %s\n",
+			cfg->name, ovs_strerror(ret));
+		ret = ovs_shell_create_bridge(cfg);
+	}
+
+	if (ret) {
+		ovsd_log_msg(L_WARNING, "Could not create bridge '%s': %s\n",
 			cfg->name ? cfg->name : "", ovs_strerror(ret));
+		return ret;
+	}
+
+	_ovs_create_connect(cfg);
+	return ret;
+}
+
+/* Create many bridges with as few ovs-vsctl transactions as possible. Bridges
+ * are ordered by dependency level: level 0 are real bridges and fake bridges
+ * whose parent already exists, a fake bridge with its parent in the batch is
+ * one level above it. Each level is created in one transaction. If a
+ * transaction fails, the bridges of its level are created one by one, so that
+ * every bridge gets its own status.
+ *
+ * Entries with a non-zero status on entry are skipped.
+ */
+void
+ovs_create_many(struct ovswitch_br_config *cfgs, int *status, int n)
+{
+	int level[n], dep[n], max_level = 0, lvl, ret;
+	struct ovs_txn txn;
+	bool changed;
+
+	for (int i = 0; i < n; i++)
+		level[i] = (status[i] || cfgs[i].parent) ? -1 : 0;
+
+	// a fake bridge depends on the bridge its parent is created with
+	do {
+		changed = false;
+		for (int i = 0; i < n; i++) {
+			if (status[i] || level[i] >= 0)
+				continue;
+
+			for (int j = 0; j < n; j++) {
+				if (level[j] < 0 || strcmp(cfgs[i].parent, cfgs[j].name))
+					continue;
+
+				level[i] = level[j] + 1;
+				dep[i] = j;
+				if (level[i] > max_level)
+					max_level = level[i];
+				changed = true;
+				break;
+			}
+		}
+	} while (changed);
+
+	for (int i = 0; i < n; i++) {
+		if (status[i] || level[i] >= 0)
+			continue;
+
+		if (ovs_shell_br_exists(cfgs[i].parent)) {
+			level[i] = 0;
+			dep[i] = -1;
+		}
+		else
+			status[i] = OVSD_ENOPARENT;
+	}
+
+	for (lvl = 0; lvl <= max_level; lvl++) {
+		ovs_txn_init(&txn);
+		for (int i = 0; i < n; i++) {
+			if (status[i] || level[i] != lvl)
+				continue;
+
+			// the parent failed in a lower level
+			if (level[i] && status[dep[i]]) {
+				status[i] = OVSD_ENOPARENT;
+				continue;
+			}
+
+			status[i] = ovs_shell_txn_add_bridge(&txn, &cfgs[i]);
+		}
+
+		// link the real bridges with their peers, each pair once
+		for (int i = 0; !lvl && i < n; i++) {
+			if (status[i] || level[i] || cfgs[i].parent)
+				continue;
+
+			ovs_patch_txn_link(&txn, &cfgs[i]);
+			for (int j = i + 1; j < n; j++)
+				if (!status[j] && !level[j])
+					ovs_patch_txn_link_pair(&txn, &cfgs[i], &cfgs[j]);
+		}
 
+		ret = ovs_txn_empty(&txn) ? 0 : ovs_txn_commit(&txn);
+		ovs_txn_free(&txn);
+
+		for (int i = 0; i < n; i++) {
+			if (status[i] || level[i] != lvl)
+				continue;
+
+			if (ret)
+				status[i] = ovs_create(&cfgs[i]);
+			else
+				_ovs_create_connect(&cfgs[i]);
+		}
+	}
+}
+
+static bool
+_ovs_bond_changed(struct ovswitch_br_config *old, struct ovswitch_br_config *cfg)
+{
+	if (!cfg->n_bond_members || strcmp(old->bond_name, cfg->bond_name) ||
+			old->n_bond_members != cfg->n_bond_members)
+		return true;
+
+	for (int i = 0; i < cfg->n_bond_members; i++)
+		if (!ovsd_config_is_bond_member(old, cfg->bond_members[i]))
+			return true;
+
+	return false;
+}
+
+/* Apply the configuration of an existing bridge without recreating it, so
+ * that its ports and flows are kept. This is only possible while the bridge
+ * keeps its parent and VLAN, OVSD_EINVALID_ARG is returned otherwise.
+ */
+int
+ovs_reconfigure(struct ovswitch_br_config *cfg)
+{
+	struct ovsd_bridge *br;
+	ovsd_name_t name, parent;
+	struct ovs_txn txn;
+	int ret = OVSD_OK;
+
+	if (!ovs_shell_br_exists(cfg->name))
+		return OVSD_ENOEXIST;
+
+	name = ovsd_name_get(cfg->name);
+	parent = ovs_shell_br_to_parent(cfg->name);
+	if (cfg->parent ? (parent != ovsd_name_lookup(cfg->parent) ||
+			ovs_shell_br_to_vlan(cfg->name) != cfg->vlan_tag) :
+			parent != name)
+		ret = OVSD_EINVALID_ARG;
+	ovsd_name_put(parent);
+
+	// fake bridges have nothing to change but their structure
+	if (ret || cfg->parent)
+		goto out;
+
+	ovs_txn_init(&txn);
+	ovs_shell_txn_tune_bridge(&txn, cfg, true);
+
+	// a bond whose members changed is replaced
+	br = ovsd_state_bridge(name);
+	if (br && br->cfg.n_bond_members && _ovs_bond_changed(&br->cfg, cfg))
+		ovs_txn_cmd(&txn, ovs_cmd(MODIFIER_IF_EXISTS), ovs_cmd(CMD_DEL_PORT),
+			cfg->name, br->cfg.bond_name, NULL);
+	ovs_shell_txn_add_bond(&txn, cfg, true);
+	ovs_shell_txn_set_telemetry(&txn, cfg, true);
+	ovs_shell_txn_set_mirrors(&txn, cfg, br ? br->ports : NULL,
+		br ? br->n_ports : 0, true);
+	ovs_shell_txn_set_flow_tables(&txn, cfg, true);
+	ovs_patch_txn_update(&txn, cfg);
+
+	if (cfg->ofcontrollers) {
+		ovs_shell_txn_set_controllers(&txn, cfg);
+	} else {
+		ovs_txn_cmd(&txn, ovs_cmd(CMD_DEL_OFCTL), cfg->name, NULL);
+		ovs_txn_cmd(&txn, ovs_cmd(CMD_DEL_FAIL_MODE), cfg->name, NULL);
+	}
+
+	for (unsigned int i = 0; br && i < br->n_ports; i++)
+		ovs_shell_txn_set_rxq(&txn, ovsd_name_str(br->ports[i]), cfg->n_rxq,
+			true);
+
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	if (ret)
+		ovsd_log_msg(L_WARNING, "Could not reconfigure bridge '%s': %s\n",
+			cfg->name, ovs_strerror(ret));
+
+out:
+	ovsd_name_put(name);
 	return ret;
 }
 
 int
 ovs_delete(char *bridge)
 {
-	return ovs_shell_delete_bridge(bridge);
+	struct ovs_txn txn;
+	int ret;
+
+	ovs_openflow_disconnect(ovsd_name_lookup(bridge));
+
+	// the peers lose their patch ports towards the bridge
+	ovs_txn_init(&txn);
+	ovs_txn_cmd(&txn, ovs_cmd(MODIFIER_IF_EXISTS), ovs_cmd(CMD_DEL_BR),
+		bridge, NULL);
+	ovs_patch_txn_unlink(&txn, bridge);
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	return ret;
 }
 
 int
@@ -43,13 +278,77 @@ ovs_prepare_bridge(char *bridge)
 	return 0;
 }
 
+/* Recreate the mirrors of a bridge after one of their ports was added or
+ * removed. Mirrors that refer to ports not on the bridge are left out.
+ */
+static void
+_ovs_update_mirrors(struct ovsd_bridge *br, char *port, bool add)
+{
+	ovsd_name_t ports[br->n_ports + 1], name;
+	struct ovs_txn txn;
+	int n = 0, ret;
+
+	if (!ovsd_config_mirrors_port(&br->cfg, port))
+		return;
+
+	// the state does not know about the change yet
+	name = ovsd_name_get(port);
+	for (unsigned int i = 0; i < br->n_ports; i++)
+		if (br->ports[i] != name)
+			ports[n++] = br->ports[i];
+	if (add)
+		ports[n++] = name;
+
+	ovs_txn_init(&txn);
+	ovs_shell_txn_set_mirrors(&txn, &br->cfg, ports, n, true);
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+	ovsd_name_put(name);
+
+	if (ret)
+		ovsd_log_msg(L_WARNING, "Could not update mirrors of bridge %s: %s\n",
+			br->cfg.name, ovs_strerror(ret));
+}
+
 int
-ovs_add_port(char *bridge, char *port)
+ovs_add_port(char *bridge, char *port, struct ovsd_port_vlan *vlan)
 {
-	int ret = ovs_shell_add_port(bridge, port);
+	struct ovsd_bridge *br = ovsd_state_bridge(ovsd_name_lookup(bridge));
+	int ret;
+
+	// members of the bridge's bond join the bond instead of the bridge
+	if (br && ovsd_config_is_bond_member(&br->cfg, port))
+		ret = ovs_shell_set_bond_iface(br->cfg.bond_name, port, true);
+	else
+		ret = ovs_shell_add_port(bridge, port, vlan, br ? br->cfg.n_rxq : -1);
 	if (ret)
-		fprintf(stderr, "Could not add port '%s' to bridge %s: %s\n",
-			port, bridge, ovs_strerror(ret));
+		ovsd_log_msg(L_WARNING, "Could not add port '%s' to bridge %s: "
+			"%s\n", port, bridge, ovs_strerror(ret));
+	else if (br)
+		_ovs_update_mirrors(br, port, true);
+
+	return ret;
+}
+
+/* Set the 802.1Q settings of many ports in one transaction. Options that are
+ * not given are cleared.
+ */
+int
+ovs_set_port_vlans(char **ports, struct ovsd_port_vlan *vlans, int n)
+{
+	struct ovs_txn txn;
+	int ret;
+
+	ovs_txn_init(&txn);
+	for (int i = 0; i < n; i++)
+		ovs_shell_txn_set_port_vlan(&txn, ports[i], &vlans[i], true);
+
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	if (ret)
+		ovsd_log_msg(L_WARNING, "Could not configure VLANs of %d ports: %s\n",
+			n, ovs_strerror(ret));
 
 	return ret;
 }
@@ -57,10 +356,34 @@ ovs_add_port(char *bridge, char *port)
 int
 ovs_remove_port(char *bridge, char *port)
 {
-	int ret = ovs_shell_remove_port(bridge, port);
+	struct ovsd_bridge *br = ovsd_state_bridge(ovsd_name_lookup(bridge));
+	int ret;
+
+	if (br && ovsd_config_is_bond_member(&br->cfg, port))
+		ret = ovs_shell_set_bond_iface(br->cfg.bond_name, port, false);
+	else
+		ret = ovs_shell_remove_port(bridge, port);
+	if (ret)
+		ovsd_log_msg(L_WARNING, "Could not remove port '%s' to bridge %s: "
+			"%s\n", port, bridge, ovs_strerror(ret));
+	else if (br)
+		_ovs_update_mirrors(br, port, false);
+
+	return ret;
+}
+
+int
+ovs_set_tunnels(char *bridge, struct blob_attr *peers, struct blob_buf *buf)
+{
+	int ret;
+
+	if (!ovs_shell_br_exists(bridge))
+		return OVSD_ENOEXIST;
+
+	ret = ovs_tunnel_reconcile(bridge, peers, buf);
 	if (ret)
-		fprintf(stderr, "Could not remove port '%s' to bridge %s: %s\n",
-			port, bridge, ovs_strerror(ret));
+		ovsd_log_msg(L_WARNING, "Could not set tunnels of bridge %s: %s\n",
+			bridge, ovs_strerror(ret));
 
 	return ret;
 }
@@ -74,10 +397,91 @@ ovs_check_state(char *bridge)
 	return 0;
 }
 
+static const char * const sflow_columns[] = {
+	"targets", "agent", "sampling", "polling", "header", NULL
+};
+
+static const char * const ipfix_columns[] = {
+	"targets", "sampling", NULL
+};
+
+static const char * const controller_columns[] = {
+	"target", "is_connected", "connection_mode", "inactivity_probe",
+	"max_backoff", "controller_rate_limit", "controller_burst_limit", NULL
+};
+
+static const char * const mirror_columns[] = {
+	"name", "select_all", "output_vlan", "statistics", NULL
+};
+
+static struct ovsd_flow_table *
+_ovs_flow_table(struct ovswitch_br_config *cfg, int table)
+{
+	for (int i = 0; cfg && i < cfg->n_flow_tables; i++)
+		if (cfg->flow_tables[i].table == table)
+			return &cfg->flow_tables[i];
+
+	return NULL;
+}
+
+/* Add the occupancy of the tables of a bridge that are configured or hold
+ * flows, with their limits, to buf. The switch is asked over OpenFlow, so
+ * this is only possible with a local switch.
+ */
+static void
+_ovs_dump_flow_tables(ovsd_name_t name, struct ovsd_bridge *br,
+	struct blob_buf *buf)
+{
+	struct ovswitch_br_config *cfg = br ? &br->cfg : NULL;
+	struct ovs_of_table_stats *stats;
+	struct ovsd_flow_table *t;
+	int n = OPENFLOW_TABLES_MAX;
+	void *arr, *tbl;
+
+	if (!ovsd_instance_is_local())
+		return;
+
+	stats = calloc(n, sizeof(*stats));
+	if (!stats)
+		return;
+
+	if (ovs_openflow_table_stats(name, stats, &n)) {
+		free(stats);
+		return;
+	}
+
+	arr = blobmsg_open_array(buf, "flow_tables");
+	for (int i = 0; i < n; i++) {
+		t = _ovs_flow_table(cfg, stats[i].table);
+		if (!t && !stats[i].active)
+			continue;
+
+		tbl = blobmsg_open_table(buf, NULL);
+		blobmsg_add_u32(buf, "table", stats[i].table);
+		if (t && t->name)
+			blobmsg_add_string(buf, "name", t->name);
+		blobmsg_add_u32(buf, "active", stats[i].active);
+		blobmsg_add_u64(buf, "lookup", stats[i].lookup);
+		blobmsg_add_u64(buf, "matched", stats[i].matched);
+		if (t && t->flow_limit >= 0) {
+			blobmsg_add_u32(buf, "flow_limit", t->flow_limit);
+			blobmsg_add_u32(buf, "usage", t->flow_limit ?
+				(uint64_t) stats[i].active * 100 / t->flow_limit : 100);
+		}
+		if (t && t->overflow_policy)
+			blobmsg_add_string(buf, "overflow_policy", t->overflow_policy);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_array(buf, arr);
+
+	free(stats);
+}
+
 int
 ovs_dump_info(struct blob_buf *buf, char *bridge)
 {
-	char out_buf[64];
+	struct ovsd_bridge *br;
+	ovsd_name_t name, parent;
 	int vlan_tag;
 
 	ovs_shell_capture_list(ovs_cmd(CMD_GET_SSL), NULL, "ssl", buf, true);
@@ -88,9 +492,10 @@ ovs_dump_info(struct blob_buf *buf, char *bridge)
 	if (!ovs_shell_br_exists(bridge))
 		return OVSD_ENOEXIST;
 
-	if (ovs_shell_br_to_parent(bridge, out_buf, 64) && strcmp(out_buf, bridge))
-		blobmsg_add_string(buf, "parent", out_buf);
-
+	name = ovsd_name_get(bridge);
+	parent = ovs_shell_br_to_parent(bridge);
+	if (parent && parent != name)
+		blobmsg_add_string(buf, "parent", ovsd_name_str(parent));
 
 	vlan_tag = ovs_shell_br_to_vlan(bridge);
 	if (vlan_tag > 0)
@@ -98,14 +503,53 @@ ovs_dump_info(struct blob_buf *buf, char *bridge)
 
 	ovs_shell_capture_list(ovs_cmd(CMD_GET_OFCTL), bridge,
 		"ofcontrollers", buf, false);
+	ovs_shell_capture_refs(bridge, "controller", "Controller",
+		controller_columns, "controllers", true, buf);
 	ovs_shell_capture_string(ovs_cmd(CMD_GET_FAIL_MODE), bridge,
 		"fail_mode", buf);
 	ovs_shell_capture_list(ovs_cmd(CMD_LIST_PORTS), bridge, "ports",
 		buf, false);
 
+	br = ovsd_state_bridge(ovsd_name_lookup(bridge));
+	if (br && br->cfg.n_bond_members)
+		ovs_bond_dump(br->cfg.bond_name, buf);
+
+	ovs_shell_capture_refs(bridge, "sflow", "sFlow", sflow_columns, "sflow",
+		false, buf);
+	ovs_shell_capture_refs(bridge, "ipfix", "IPFIX", ipfix_columns, "ipfix",
+		false, buf);
+	ovs_shell_capture_refs(bridge, "mirrors", "Mirror", mirror_columns,
+		"mirrors", true, buf);
+
+	// fake bridges share the tables of their parent
+	if (!parent || parent == name)
+		_ovs_dump_flow_tables(name, br, buf);
+
+	ovsd_name_put(parent);
+	ovsd_name_put(name);
 	return 0;
 }
 
+int
+ovs_flow_mod(char *bridge, enum ovs_flow_cmd cmd, bool strict,
+	struct blob_attr *flows, struct blob_buf *buf)
+{
+	ovsd_name_t name;
+	int ret;
+
+	if (!ovsd_instance_is_local())
+		return OVSD_EINVALID_ARG;
+
+	if (!ovs_shell_br_exists(bridge))
+		return OVSD_ENOEXIST;
+
+	name = ovsd_name_get(bridge);
+	ret = ovs_openflow_bundle(name, cmd, strict, flows, buf);
+	ovsd_name_put(name);
+
+	return ret;
+}
+
 const char*
 ovs_strerror(int error)
 {
@@ -118,6 +562,16 @@ ovs_strerror(int error)
 			return "parent does not exist";
 		case OVSD_EINVALID_VLAN:
 			return "invalid VLAN tag";
+		case OVSD_EBUSY:
+			return "request queue full, try again later";
+		case OVSD_EOFCONN:
+			return "OpenFlow connection failed";
+		case OVSD_EOFREJECT:
+			return "rejected by OpenFlow switch";
+		case OVSD_ETIMEOUT:
+			return "operation timed out";
+		case OVSD_EOFFLINE:
+			return "Open vSwitch database unavailable";
 		case OVSD_EUNKNOWN:
 		default:
 			return "unknown error";
@@ -15,17 +15,25 @@
 #define __OVSD_OVS_H
 
 #include "ovsd.h"
+#include "openflow.h"
 
 int ovs_delete(char *bridge);
 int ovs_create(struct ovswitch_br_config *cfg);
+void ovs_create_many(struct ovswitch_br_config *cfgs, int *status, int n);
+int ovs_reconfigure(struct ovswitch_br_config *cfg);
 
 int ovs_prepare_bridge(char *bridge);
-int ovs_add_port(char *bridge, char *port);
+int ovs_add_port(char *bridge, char *port, struct ovsd_port_vlan *vlan);
+int ovs_set_port_vlans(char **ports, struct ovsd_port_vlan *vlans, int n);
 int ovs_remove_port(char *bridge, char *port);
+int ovs_set_tunnels(char *bridge, struct blob_attr *peers, struct blob_buf *buf);
 
 int ovs_check_state(char *bridge);
 int ovs_dump_info(struct blob_buf *buf, char *bridge);
 
+int ovs_flow_mod(char *bridge, enum ovs_flow_cmd cmd, bool strict,
+	struct blob_attr *flows, struct blob_buf *buf);
+
 const char* ovs_strerror(int error);
 
 #endif
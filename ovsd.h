@@ -14,6 +14,8 @@
 #ifndef __OVSD_H
 #define __OVSD_H
 
+#include <time.h>
+
 #include <libubus.h>
 
 enum ovsd_status {
@@ -23,6 +25,11 @@ enum ovsd_status {
 	OVSD_ENOPARENT,
 	OVSD_EINVALID_ARG,
 	OVSD_EINVALID_VLAN,
+	OVSD_EBUSY,
+	OVSD_EOFCONN,
+	OVSD_EOFREJECT,
+	OVSD_ETIMEOUT,
+	OVSD_EOFFLINE,
 };
 
 enum ovsd_ovs_vsctl_status {
@@ -44,9 +51,42 @@ enum ovs_fail_mode {
 	OVS_FAIL_MODE_SECURE,
 };
 
+/* A SPAN or RSPAN port mirror. Traffic of the selected ports, or of all ports
+ * if none are selected, is copied to an output port or VLAN.
+ */
+struct ovsd_mirror {
+	char *name;
+	char **select;
+	int n_select;
+	char *output_port;
+	int output_vlan;
+
+	// copy of the config string the fields above point into
+	char *spec;
+};
+
+/* Capacity settings of an OpenFlow table, -1 or NULL if not given. On
+ * overflow, Open vSwitch either refuses new flows or evicts old ones, fairly
+ * across the groups of flows given by the fields in groups.
+ */
+struct ovsd_flow_table {
+	int table;
+	int flow_limit;
+	const char *overflow_policy;
+	char *name;
+	char **groups;
+	int n_groups;
+
+	// copy of the config string the fields above point into
+	char *spec;
+};
+
 struct ovswitch_br_config {
 	char *name;
 
+	// name of the Open vSwitch instance, NULL for the local one
+	char *instance;
+
 	// fake bridge args
 	char *parent;
 	unsigned int vlan_tag;
@@ -56,26 +96,143 @@ struct ovswitch_br_config {
 	int n_ofcontrollers;
 	enum ovs_fail_mode fail_mode;
 
+	// controller connection args, -1 or NULL for the Open vSwitch defaults
+	int ctl_inactivity_probe;
+	int ctl_max_backoff;
+	int ctl_rate_limit;
+	int ctl_burst_limit;
+	const char *ctl_connection_mode;
+
 	// SSL args
 	char *ssl_privkey_file;
 	char *ssl_cert_file;
 	char *ssl_cacert_file;
 	bool ssl_bootstrap;
+
+	// datapath tuning args, -1 or NULL if not given. All but datapath_type
+	// and n_rxq are global settings of ovs-vswitchd.
+	int flow_limit;
+	int max_idle;
+	int n_handler_threads;
+	int n_revalidator_threads;
+	char *datapath_type;
+	char *pmd_cpu_mask;
+
+	// receive queues of every interface on the bridge (userspace datapath)
+	int n_rxq;
+
+	// MAC learning table of the bridge, -1 if not given
+	int mac_table_size;
+	int mac_aging_time;
+
+	// link aggregation args, no bond if n_bond_members is 0
+	char bond_name[32];
+	char **bond_members;
+	int n_bond_members;
+	const char *bond_mode;
+	const char *lacp;
+	const char *lacp_time;
+	int bond_rebalance_interval;
+
+	// sampled telemetry args, disabled if no targets are given
+	char **sflow_targets;
+	int n_sflow_targets;
+	int sflow_sampling;
+	int sflow_polling;
+	int sflow_header;
+	char *sflow_agent;
+	char **ipfix_targets;
+	int n_ipfix_targets;
+	int ipfix_sampling;
+
+	// port mirrors
+	struct ovsd_mirror *mirrors;
+	int n_mirrors;
+
+	// bridges linked to this one with a pair of patch ports
+	char **patch_peers;
+	int n_patch_peers;
+
+	// OpenFlow table capacity
+	struct ovsd_flow_table *flow_tables;
+	int n_flow_tables;
 };
 
 #define OVSWITCH_CONFIG_INIT {\
 	.name = NULL,\
+	.instance = NULL,\
 	.parent = NULL,\
 	.vlan_tag = 0,\
 	.ofcontrollers = NULL,\
 	.n_ofcontrollers = 0,\
+	.ctl_inactivity_probe = -1,\
+	.ctl_max_backoff = -1,\
+	.ctl_rate_limit = -1,\
+	.ctl_burst_limit = -1,\
+	.ctl_connection_mode = NULL,\
 	.ssl_privkey_file = NULL,\
 	.ssl_cert_file = NULL,\
 	.ssl_cacert_file = NULL,\
 	.ssl_bootstrap = false,\
+	.flow_limit = -1,\
+	.max_idle = -1,\
+	.n_handler_threads = -1,\
+	.n_revalidator_threads = -1,\
+	.datapath_type = NULL,\
+	.pmd_cpu_mask = NULL,\
+	.n_rxq = -1,\
+	.mac_table_size = -1,\
+	.mac_aging_time = -1,\
+	.bond_members = NULL,\
+	.n_bond_members = 0,\
+	.bond_rebalance_interval = -1,\
+	.sflow_targets = NULL,\
+	.n_sflow_targets = 0,\
+	.sflow_sampling = -1,\
+	.sflow_polling = -1,\
+	.sflow_header = -1,\
+	.sflow_agent = NULL,\
+	.ipfix_targets = NULL,\
+	.n_ipfix_targets = 0,\
+	.ipfix_sampling = -1,\
+	.mirrors = NULL,\
+	.n_mirrors = 0,\
+	.patch_peers = NULL,\
+	.n_patch_peers = 0,\
+	.flow_tables = NULL,\
+	.n_flow_tables = 0,\
 }
 
 
+/* 802.1Q settings of a port. Unset options are left alone or cleared,
+ * depending on the operation.
+ */
+struct ovsd_port_vlan {
+	// access VLAN, -1 if not given
+	int tag;
+
+	// array of VLAN ids carried by a trunk port, NULL if not given
+	struct blob_attr *trunks;
+
+	// one of access, trunk, native-tagged, native-untagged
+	char *mode;
+};
+
+#define OVSD_PORT_VLAN_INIT {\
+	.tag = -1,\
+	.trunks = NULL,\
+	.mode = NULL,\
+}
+
 void ovsd_log_msg(int log_lvl, const char *format, ...);
 
+static inline uint64_t
+ovsd_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 #endif
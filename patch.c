@@ -0,0 +1,128 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <string.h>
+
+#include "patch.h"
+#include "state.h"
+#include "instance.h"
+
+#define PATCH_PORT_FMT "p-%s-%s"
+
+static bool
+_declares(struct ovswitch_br_config *cfg, const char *peer)
+{
+	for (int i = 0; i < cfg->n_patch_peers; i++)
+		if (!strcmp(cfg->patch_peers[i], peer))
+			return true;
+
+	return false;
+}
+
+static bool
+_linked(struct ovswitch_br_config *a, struct ovswitch_br_config *b)
+{
+	if (a->parent || b->parent || !strcmp(a->name, b->name))
+		return false;
+
+	if (ovsd_instance_find(a->instance) != ovsd_instance_find(b->instance))
+		return false;
+
+	return _declares(a, b->name) || _declares(b, a->name);
+}
+
+static void
+_txn_add_patch(struct ovs_txn *txn, const char *bridge, const char *peer)
+{
+	ovs_txn_cmd(txn, ovs_cmd(MODIFIER_MAY_EXIST), ovs_cmd(CMD_ADD_PORT),
+		bridge, NULL);
+	ovs_txn_argf(txn, PATCH_PORT_FMT, bridge, peer);
+	ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Interface", NULL);
+	ovs_txn_argf(txn, PATCH_PORT_FMT, bridge, peer);
+	ovs_txn_arg(txn, "type=patch");
+	ovs_txn_argf(txn, "options:peer=" PATCH_PORT_FMT, peer, bridge);
+}
+
+static void
+_txn_del_patch(struct ovs_txn *txn, const char *bridge, const char *peer)
+{
+	ovs_txn_cmd(txn, ovs_cmd(MODIFIER_IF_EXISTS), ovs_cmd(CMD_DEL_PORT),
+		bridge, NULL);
+	ovs_txn_argf(txn, PATCH_PORT_FMT, bridge, peer);
+}
+
+void
+ovs_patch_txn_link_pair(struct ovs_txn *txn, struct ovswitch_br_config *a,
+	struct ovswitch_br_config *b)
+{
+	if (!_linked(a, b))
+		return;
+
+	_txn_add_patch(txn, a->name, b->name);
+	_txn_add_patch(txn, b->name, a->name);
+}
+
+void
+ovs_patch_txn_link_except(struct ovs_txn *txn, struct ovswitch_br_config *cfg,
+	ovsd_name_t *missing, int n)
+{
+	struct ovsd_bridge *br;
+	ovsd_name_t i;
+	int m;
+
+	ovsd_state_for_each_bridge(br, i) {
+		for (m = 0; m < n && missing[m] != i; m++)
+			;
+		if (m == n)
+			ovs_patch_txn_link_pair(txn, cfg, &br->cfg);
+	}
+}
+
+void
+ovs_patch_txn_link(struct ovs_txn *txn, struct ovswitch_br_config *cfg)
+{
+	ovs_patch_txn_link_except(txn, cfg, NULL, 0);
+}
+
+void
+ovs_patch_txn_unlink(struct ovs_txn *txn, char *bridge)
+{
+	struct ovsd_bridge *self, *br;
+	ovsd_name_t i;
+
+	self = ovsd_state_bridge(ovsd_name_lookup(bridge));
+	if (!self)
+		return;
+
+	ovsd_state_for_each_bridge(br, i)
+		if (_linked(&self->cfg, &br->cfg))
+			_txn_del_patch(txn, br->cfg.name, bridge);
+}
+
+void
+ovs_patch_txn_update(struct ovs_txn *txn, struct ovswitch_br_config *cfg)
+{
+	struct ovsd_bridge *self, *br;
+	ovsd_name_t i;
+
+	self = ovsd_state_bridge(ovsd_name_lookup(cfg->name));
+	ovsd_state_for_each_bridge(br, i) {
+		if (!self || !_linked(&self->cfg, &br->cfg) || _linked(cfg, &br->cfg))
+			continue;
+
+		_txn_del_patch(txn, cfg->name, br->cfg.name);
+		_txn_del_patch(txn, br->cfg.name, cfg->name);
+	}
+
+	ovs_patch_txn_link(txn, cfg);
+}
@@ -0,0 +1,52 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_PATCH_H
+#define __OVSD_PATCH_H
+
+#include "ovsd.h"
+#include "ovs-shell.h"
+#include "names.h"
+
+/* Two bridges are linked by a pair of patch ports if either names the other
+ * as a patch peer. The port on bridge X linked to bridge P is named p-X-P.
+ * Only real bridges of the same Open vSwitch instance can be linked.
+ */
+
+/* Add the patch ports linking the bridge of cfg with the known bridges to
+ * txn. Peers that are created in the same transaction are linked with
+ * ovs_patch_txn_link_pair.
+ */
+void ovs_patch_txn_link(struct ovs_txn *txn, struct ovswitch_br_config *cfg);
+
+/* Like ovs_patch_txn_link, but leave out the n known bridges in missing, e.g.
+ * those that are not in Open vSwitch at this point of the transaction.
+ */
+void ovs_patch_txn_link_except(struct ovs_txn *txn,
+	struct ovswitch_br_config *cfg, ovsd_name_t *missing, int n);
+
+// add the pair of patch ports linking a and b to txn, if they are peers
+void ovs_patch_txn_link_pair(struct ovs_txn *txn, struct ovswitch_br_config *a,
+	struct ovswitch_br_config *b);
+
+/* Remove the patch ports the known peers of a bridge have towards it. Its own
+ * patch ports go with the bridge.
+ */
+void ovs_patch_txn_unlink(struct ovs_txn *txn, char *bridge);
+
+/* Remove the pairs of patch ports linking a known bridge with peers that are
+ * not named in its new configuration anymore, and add the new ones.
+ */
+void ovs_patch_txn_update(struct ovs_txn *txn, struct ovswitch_br_config *cfg);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "restart.h"
+#include "info.h"
+#include "log.h"
+#include "offline.h"
+#include "sched.h"
+#include "state.h"
+#include "ubus.h"
+
+static char **restart_argv;
+
+// state handed over by the previous binary
+static struct blob_attr *handover;
+static struct blob_attr *handover_tb[__RESTART_MAX];
+static bool handover_failed;
+
+static volatile sig_atomic_t signalled;
+
+static const struct blob_attr_info restart_info[__RESTART_MAX] = {
+	[RESTART_STATE] = { .type = BLOB_ATTR_NESTED },
+	[RESTART_OFFLINE_OPS] = { .type = BLOB_ATTR_NESTED },
+	[RESTART_OFFLINE_OPEN] = { .type = BLOB_ATTR_INT32 },
+	[RESTART_GENERATION] = { .type = BLOB_ATTR_INT32 },
+};
+
+static int
+_restart_read(int fd)
+{
+	struct stat st;
+	ssize_t n;
+	size_t len = 0;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(struct blob_attr))
+		return -1;
+
+	handover = malloc(st.st_size);
+	if (!handover)
+		return -1;
+
+	while (len < st.st_size) {
+		n = pread(fd, (char *) handover + len, st.st_size - len, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		len += n;
+	}
+
+	if (blob_pad_len(handover) > len)
+		return -1;
+
+	blob_parse(handover, handover_tb, restart_info, __RESTART_MAX);
+	return 0;
+}
+
+void
+ovsd_restart_init(int argc, char **argv)
+{
+	char *env = getenv(OVSD_RESTART_ENV);
+	int fd;
+
+	// getopt reorders argv and options are parsed in place
+	restart_argv = calloc(argc + 1, sizeof(*restart_argv));
+	for (int i = 0; restart_argv && i < argc; i++)
+		restart_argv[i] = strdup(argv[i]);
+
+	if (!env)
+		return;
+
+	fd = atoi(env);
+	unsetenv(OVSD_RESTART_ENV);
+
+	if (_restart_read(fd)) {
+		free(handover);
+		handover = NULL;
+		memset(handover_tb, 0, sizeof(handover_tb));
+		handover_failed = true;
+	}
+	close(fd);
+}
+
+struct blob_attr *
+ovsd_restart_handover(enum ovsd_restart_attr attr)
+{
+	return handover ? handover_tb[attr] : NULL;
+}
+
+void
+ovsd_restart_resume(void)
+{
+	struct blob_attr **tb = handover_tb;
+
+	if (handover_failed)
+		ovsd_log_msg(L_WARNING, "Could not read the state handed over by the "
+			"previous ovsd, restoring it from the journal\n");
+
+	if (!handover)
+		return;
+
+	if (tb[RESTART_GENERATION])
+		ovsd_info_resume(blob_get_u32(tb[RESTART_GENERATION]));
+	if (tb[RESTART_OFFLINE_OPS])
+		ovsd_offline_adopt(tb[RESTART_OFFLINE_OPS],
+			tb[RESTART_OFFLINE_OPEN] &&
+			blob_get_u32(tb[RESTART_OFFLINE_OPEN]));
+
+	ovsd_log_msg(L_NOTICE, "took over the state of the previous ovsd\n");
+
+	free(handover);
+	handover = NULL;
+	memset(handover_tb, 0, sizeof(handover_tb));
+}
+
+static int
+_restart_snapshot(void)
+{
+	struct blob_buf buf = { 0 };
+	size_t len, off = 0;
+	ssize_t n;
+	void *c;
+	int fd;
+
+	fd = memfd_create("ovsd-handover", 0);
+	if (fd < 0)
+		return -1;
+
+	blob_buf_init(&buf, 0);
+	c = blob_nest_start(&buf, RESTART_STATE);
+	ovsd_state_snapshot(&buf);
+	blob_nest_end(&buf, c);
+	c = blob_nest_start(&buf, RESTART_OFFLINE_OPS);
+	ovsd_offline_snapshot(&buf);
+	blob_nest_end(&buf, c);
+	blob_put_u32(&buf, RESTART_OFFLINE_OPEN, ovsd_offline_active());
+	blob_put_u32(&buf, RESTART_GENERATION, ovsd_info_generation());
+
+	len = blob_pad_len(buf.head);
+	while (off < len) {
+		n = write(fd, (char *) buf.head + off, len - off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	blob_buf_free(&buf);
+
+	if (off < len) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+_restart_exec(void)
+{
+	char fd_str[16];
+	int fd;
+
+	if (!restart_argv || !restart_argv[0]) {
+		ovsd_log_msg(L_WARNING, "hot restart: command line unknown\n");
+		return;
+	}
+
+	// do not tear down anything if the new binary cannot be run anyway
+	if (strchr(restart_argv[0], '/') && access(restart_argv[0], X_OK)) {
+		ovsd_log_msg(L_WARNING, "hot restart: cannot execute %s: %s\n",
+			restart_argv[0], strerror(errno));
+		return;
+	}
+
+	fd = _restart_snapshot();
+	if (fd < 0) {
+		ovsd_log_msg(L_WARNING, "hot restart: cannot save state: %s\n",
+			strerror(errno));
+		return;
+	}
+
+	snprintf(fd_str, sizeof(fd_str), "%d", fd);
+	setenv(OVSD_RESTART_ENV, fd_str, 1);
+
+	ovsd_log_msg(L_NOTICE, "hot restart: handing over to %s\n",
+		restart_argv[0]);
+
+	// the new binary registers the 'ovs' object again right after startup
+	ovsd_ubus_done();
+	ovsd_state_done();
+
+	// the ring is only drained from the main loop, which is not coming back
+	ovsd_log_flush();
+	execvp(restart_argv[0], restart_argv);
+
+	// nothing left to go back to, the journal restores the state
+	ovsd_log_msg(L_CRIT, "hot restart: exec %s failed: %s\n",
+		restart_argv[0], strerror(errno));
+	exit(1);
+}
+
+static void
+_restart_cb(struct uloop_timeout *t)
+{
+	// requests in progress cannot be handed over
+	if (!ovsd_sched_idle()) {
+		uloop_timeout_set(t, OVSD_RESTART_POLL_MS);
+		return;
+	}
+
+	_restart_exec();
+}
+
+static struct uloop_timeout restart_timer = {
+	.cb = _restart_cb,
+};
+
+void
+ovsd_restart_request(void)
+{
+	ovsd_log_msg(L_NOTICE, "hot restart requested\n");
+	uloop_timeout_set(&restart_timer, 0);
+}
+
+void
+ovsd_restart_signal(int signo)
+{
+	signalled = 1;
+	uloop_end();
+}
+
+bool
+ovsd_restart_pending(void)
+{
+	if (!signalled)
+		return false;
+
+	signalled = 0;
+	ovsd_restart_request();
+	return true;
+}
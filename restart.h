@@ -0,0 +1,58 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_RESTART_H
+#define __OVSD_RESTART_H
+
+#include "ovsd.h"
+
+// environment variable with the memfd holding the handed over state
+#define OVSD_RESTART_ENV "OVSD_HANDOVER_FD"
+
+// how often a requested restart checks for pending requests
+#define OVSD_RESTART_POLL_MS 10
+
+enum ovsd_restart_attr {
+	RESTART_STATE = 1,
+	RESTART_OFFLINE_OPS,
+	RESTART_OFFLINE_OPEN,
+	RESTART_GENERATION,
+	__RESTART_MAX
+};
+
+/* Remember the command line to exec the new binary with, and read the state
+ * handed over by the previous binary if ovsd was started by a hot restart.
+ * Must be called before the command line is parsed.
+ */
+void ovsd_restart_init(int argc, char **argv);
+
+// part of the handed over state, NULL if there is none
+struct blob_attr *ovsd_restart_handover(enum ovsd_restart_attr attr);
+
+/* Take over the rest of the handed over state once ubus is connected, and
+ * release it.
+ */
+void ovsd_restart_resume(void);
+
+/* Exec the ovsd binary again as soon as no requests are pending, handing
+ * over the state in a memfd. Open vSwitch is not touched.
+ */
+void ovsd_restart_request(void);
+
+/* Signal handler requesting a hot restart. The main loop ends and
+ * ovsd_restart_pending() arranges the restart before it is run again.
+ */
+void ovsd_restart_signal(int signo);
+bool ovsd_restart_pending(void);
+
+#endif
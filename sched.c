@@ -0,0 +1,474 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+#include "ovs-shell.h"
+#include "instance.h"
+
+struct sched_queue {
+	struct list_head jobs;
+	unsigned int limit;
+	unsigned int depth;
+
+	// time a job of this class may take from dispatch to reply
+	unsigned int timeout_ms;
+
+	// statistics
+	unsigned int max_depth;
+	uint64_t n_served;
+	uint64_t n_rejected;
+	uint64_t n_timeouts;
+	uint64_t wait_total_us;
+	uint64_t wait_max_us;
+};
+
+static const char *sched_class_name[__SCHED_CLASS_MAX] = {
+	[SCHED_CLASS_READ] = "read",
+	[SCHED_CLASS_HOTPLUG] = "hotplug",
+	[SCHED_CLASS_LIFECYCLE] = "lifecycle",
+	[SCHED_CLASS_RELOAD] = "reload",
+};
+
+static struct sched_queue queues[__SCHED_CLASS_MAX] = {
+	[SCHED_CLASS_READ] = { .limit = 32, .timeout_ms = 2000 },
+	[SCHED_CLASS_HOTPLUG] = { .limit = 256, .timeout_ms = 5000 },
+	[SCHED_CLASS_LIFECYCLE] = { .limit = 256, .timeout_ms = 10000 },
+	[SCHED_CLASS_RELOAD] = { .limit = 32, .timeout_ms = 20000 },
+};
+
+/* Right after startup netifd sends a burst of requests for all configured
+ * interfaces. Batchable jobs are held back until the burst is over, so that
+ * they can be served together.
+ */
+#define SCHED_BOOT_WINDOW_MS 30000
+#define SCHED_BATCH_QUIET_MS 100
+#define SCHED_BATCH_HOLD_MAX_MS 1000
+
+/* Latency from submission to reply per method, in a log-linear histogram of
+ * microseconds: 8 buckets per power of two, so percentiles are within 1/8 of
+ * the true value. Latencies of more than 2^32 us land in the last bucket.
+ */
+#define LAT_SUB_BITS 3
+#define LAT_BUCKETS ((32 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+#define LAT_METHODS_MAX 32
+
+struct sched_latency {
+	char *method;
+	uint64_t count;
+	uint64_t max_us;
+	uint32_t buckets[LAT_BUCKETS];
+};
+
+static struct sched_latency *latency[LAT_METHODS_MAX];
+
+static struct ubus_context *sched_ctx;
+static uint64_t sched_start_us;
+static uint64_t last_batch_us;
+
+static void sched_dispatch(struct uloop_timeout *t);
+static struct uloop_timeout dispatch_timer = {
+	.cb = sched_dispatch,
+};
+
+enum {
+	JOBPOL_NAME,
+	JOBPOL_BRIDGE,
+	JOBPOL_INSTANCE,
+	__JOBPOL_MAX
+};
+static const struct blobmsg_policy job_policy[__JOBPOL_MAX] = {
+	[JOBPOL_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[JOBPOL_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[JOBPOL_INSTANCE] = { .name = "instance", .type = BLOBMSG_TYPE_STRING },
+};
+
+static unsigned int
+_lat_bucket(uint64_t us)
+{
+	unsigned int shift;
+
+	if (us >= 1ULL << 32)
+		return LAT_BUCKETS - 1;
+	if (us < (1 << LAT_SUB_BITS))
+		return us;
+
+	shift = 31 - __builtin_clz(us) - LAT_SUB_BITS;
+	return ((shift + 1) << LAT_SUB_BITS) +
+		((us >> shift) & ((1 << LAT_SUB_BITS) - 1));
+}
+
+// highest latency that falls into a bucket
+static uint64_t
+_lat_bucket_max(unsigned int idx)
+{
+	unsigned int shift;
+	uint64_t mant;
+
+	if (idx < (1 << LAT_SUB_BITS))
+		return idx;
+
+	shift = (idx >> LAT_SUB_BITS) - 1;
+	mant = (idx & ((1 << LAT_SUB_BITS) - 1)) | (1 << LAT_SUB_BITS);
+	return ((mant + 1) << shift) - 1;
+}
+
+static void
+_lat_record(const char *method, uint64_t us)
+{
+	struct sched_latency *l = NULL;
+	int i;
+
+	for (i = 0; i < LAT_METHODS_MAX && latency[i]; i++) {
+		if (!strcmp(latency[i]->method, method)) {
+			l = latency[i];
+			break;
+		}
+	}
+
+	if (!l) {
+		if (i == LAT_METHODS_MAX)
+			return;
+
+		l = calloc(1, sizeof(*l) + strlen(method) + 1);
+		if (!l)
+			return;
+
+		l->method = strcpy((char *) (l + 1), method);
+		latency[i] = l;
+	}
+
+	l->count++;
+	l->buckets[_lat_bucket(us)]++;
+	if (us > l->max_us)
+		l->max_us = us;
+}
+
+static uint64_t
+_lat_percentile(struct sched_latency *l, unsigned int per_mille)
+{
+	uint64_t rank = (l->count * per_mille + 999) / 1000, seen = 0;
+
+	for (unsigned int i = 0; i < LAT_BUCKETS; i++) {
+		seen += l->buckets[i];
+		if (seen >= rank)
+			return _lat_bucket_max(i) < l->max_us ?
+				_lat_bucket_max(i) : l->max_us;
+	}
+
+	return l->max_us;
+}
+
+static void
+_job_free(struct ovsd_job *job)
+{
+	ovsd_name_put(job->bridge);
+	free(job->msg);
+	free(job);
+}
+
+/* Find the oldest job for the same bridge in a queue of lower priority than
+ * the given job. Requests for one bridge must not overtake each other, e.g.
+ * check_state must not be answered before a queued create has run.
+ */
+static struct ovsd_job *
+_sched_older_job(struct ovsd_job *job)
+{
+	struct ovsd_job *cur, *oldest = job;
+
+	if (!job->bridge)
+		return job;
+
+	for (int i = job->cls + 1; i < __SCHED_CLASS_MAX; i++) {
+		list_for_each_entry(cur, &queues[i].jobs, list) {
+			if (cur->queued_at >= oldest->queued_at)
+				break;
+
+			if (cur->bridge == job->bridge) {
+				oldest = cur;
+				break;
+			}
+		}
+	}
+
+	return oldest;
+}
+
+/* Instance a job goes to: the one named in the request, e.g. by create, or
+ * the one its bridge lives in. It is resolved at dispatch time, as a queued
+ * create may have placed the bridge meanwhile.
+ */
+static struct ovsd_instance *
+_sched_instance(struct ovsd_job *job)
+{
+	struct ovsd_instance *inst;
+
+	if (!job->instance)
+		return ovsd_instance_of(job->bridge);
+
+	// unknown instances are rejected by the handler
+	inst = ovsd_instance_find(job->instance);
+	return inst ? inst : ovsd_instance_find(NULL);
+}
+
+static struct ovsd_job *
+_sched_next(void)
+{
+	struct sched_queue *q;
+
+	for (int i = 0; i < __SCHED_CLASS_MAX; i++) {
+		q = &queues[i];
+		if (!list_empty(&q->jobs))
+			return _sched_older_job(list_first_entry(&q->jobs,
+				struct ovsd_job, list));
+	}
+
+	return NULL;
+}
+
+/* Hold a batchable job during the boot window until no further batchable
+ * job has been submitted for a while, but not longer than the hold maximum.
+ */
+static bool
+_sched_hold(struct ovsd_job *job)
+{
+	uint64_t now = ovsd_now_us(), until;
+
+	if (now - sched_start_us > SCHED_BOOT_WINDOW_MS * 1000ULL)
+		return false;
+
+	until = last_batch_us + SCHED_BATCH_QUIET_MS * 1000ULL;
+	if (until > job->queued_at + SCHED_BATCH_HOLD_MAX_MS * 1000ULL)
+		until = job->queued_at + SCHED_BATCH_HOLD_MAX_MS * 1000ULL;
+
+	if (now >= until)
+		return false;
+
+	uloop_timeout_set(&dispatch_timer, (until - now + 999) / 1000);
+	return true;
+}
+
+static void
+_sched_account(struct ovsd_job *job)
+{
+	struct sched_queue *q = &queues[job->cls];
+	uint64_t wait;
+
+	list_del(&job->list);
+	q->depth--;
+
+	wait = ovsd_now_us() - job->queued_at;
+	q->wait_total_us += wait;
+	if (wait > q->wait_max_us)
+		q->wait_max_us = wait;
+	q->n_served++;
+}
+
+/* Take the given job and all jobs directly following it in its queue that
+ * share its batch handler and instance, and serve them together.
+ */
+static void
+_sched_run_batch(struct ovsd_job *job)
+{
+	struct list_head *head = &queues[job->cls].jobs;
+	ovsd_batch_handler_t batch = job->batch;
+	struct ovsd_instance *inst = ovsd_instance_current();
+	struct ovsd_job *next;
+	LIST_HEAD(jobs);
+
+	while (&job->list != head && job->batch == batch &&
+			_sched_instance(job) == inst) {
+		next = list_entry(job->list.next, struct ovsd_job, list);
+		_sched_account(job);
+		list_add_tail(&job->list, &jobs);
+		job = next;
+	}
+
+	batch(sched_ctx, &jobs);
+}
+
+void
+ovsd_sched_complete(struct ovsd_job *job, int ret)
+{
+	_lat_record(job->method, ovsd_now_us() - job->queued_at);
+	list_del(&job->list);
+	ubus_complete_deferred_request(sched_ctx, &job->req, ret);
+	_job_free(job);
+}
+
+/* Serve exactly one job per main loop iteration, so that requests arriving
+ * in the meantime are classified before the next job is picked.
+ */
+static void
+sched_dispatch(struct uloop_timeout *t)
+{
+	struct ovsd_job *job = _sched_next();
+	struct sched_queue *q;
+	int ret;
+
+	if (!job || (job->batch && _sched_hold(job)))
+		return;
+
+	q = &queues[job->cls];
+	ovs_shell_set_deadline(ovsd_now_us() + q->timeout_ms * 1000ULL);
+	ovsd_instance_select(_sched_instance(job));
+
+	if (job->batch) {
+		_sched_run_batch(job);
+	} else {
+		_sched_account(job);
+		ret = job->handler(sched_ctx, job->obj, &job->req, job->method,
+			job->msg);
+
+		// partial results of an operation that ran out of time are no answer
+		if (ovs_shell_timed_out())
+			ret = UBUS_STATUS_TIMEOUT;
+
+		ubus_complete_deferred_request(sched_ctx, &job->req, ret);
+		_lat_record(job->method, ovsd_now_us() - job->queued_at);
+		_job_free(job);
+	}
+
+	if (ovs_shell_timed_out())
+		q->n_timeouts++;
+	ovs_shell_set_deadline(0);
+	ovsd_instance_select(NULL);
+
+	if (_sched_next())
+		uloop_timeout_set(&dispatch_timer, 0);
+}
+
+int
+ovsd_sched_submit(struct ubus_object *obj, struct ubus_request_data *req,
+	const char *method, struct blob_attr *msg, enum ovsd_sched_class cls,
+	ubus_handler_t handler, ovsd_batch_handler_t batch)
+{
+	struct sched_queue *q = &queues[cls];
+	struct blob_attr *tb[__JOBPOL_MAX];
+	struct ovsd_job *job;
+	char *method_buf;
+
+	if (q->depth >= q->limit) {
+		q->n_rejected++;
+		return OVSD_EBUSY;
+	}
+
+	job = calloc(1, sizeof(*job) + strlen(method) + 1);
+	if (!job)
+		return OVSD_EUNKNOWN;
+
+	method_buf = (char *) (job + 1);
+	strcpy(method_buf, method);
+
+	job->msg = blob_memdup(msg);
+	if (!job->msg) {
+		free(job);
+		return OVSD_EUNKNOWN;
+	}
+
+	blobmsg_parse(job_policy, __JOBPOL_MAX, tb, blob_data(job->msg),
+		blob_len(job->msg));
+	job->bridge = ovsd_name_get(blobmsg_get_string(tb[JOBPOL_NAME] ?
+		tb[JOBPOL_NAME] : tb[JOBPOL_BRIDGE]));
+	job->instance = blobmsg_get_string(tb[JOBPOL_INSTANCE]);
+
+	job->cls = cls;
+	job->obj = obj;
+	job->handler = handler;
+	job->batch = batch;
+	job->method = method_buf;
+	job->queued_at = ovsd_now_us();
+	ubus_defer_request(sched_ctx, req, &job->req);
+
+	list_add_tail(&job->list, &q->jobs);
+	if (++q->depth > q->max_depth)
+		q->max_depth = q->depth;
+
+	// a pending timer may be a held batch, other jobs are not held up by it
+	if (batch)
+		last_batch_us = job->queued_at;
+	if (!batch || !dispatch_timer.pending)
+		uloop_timeout_set(&dispatch_timer, 0);
+
+	return OVSD_OK;
+}
+
+bool
+ovsd_sched_idle(void)
+{
+	return !_sched_next();
+}
+
+void
+ovsd_sched_dump(struct blob_buf *buf)
+{
+	struct sched_queue *q;
+	void *list, *tbl;
+
+	list = blobmsg_open_table(buf, "queues");
+	for (int i = 0; i < __SCHED_CLASS_MAX; i++) {
+		q = &queues[i];
+
+		tbl = blobmsg_open_table(buf, sched_class_name[i]);
+		blobmsg_add_u32(buf, "depth", q->depth);
+		blobmsg_add_u32(buf, "limit", q->limit);
+		blobmsg_add_u32(buf, "max_depth", q->max_depth);
+		blobmsg_add_u64(buf, "served", q->n_served);
+		blobmsg_add_u64(buf, "rejected", q->n_rejected);
+		blobmsg_add_u32(buf, "timeout_ms", q->timeout_ms);
+		blobmsg_add_u64(buf, "timeouts", q->n_timeouts);
+		blobmsg_add_u64(buf, "wait_avg_us",
+			q->n_served ? q->wait_total_us / q->n_served : 0);
+		blobmsg_add_u64(buf, "wait_max_us", q->wait_max_us);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_table(buf, list);
+
+	list = blobmsg_open_table(buf, "latency");
+	for (int i = 0; i < LAT_METHODS_MAX && latency[i]; i++) {
+		tbl = blobmsg_open_table(buf, latency[i]->method);
+		blobmsg_add_u64(buf, "count", latency[i]->count);
+		blobmsg_add_u64(buf, "p50_us", _lat_percentile(latency[i], 500));
+		blobmsg_add_u64(buf, "p99_us", _lat_percentile(latency[i], 990));
+		blobmsg_add_u64(buf, "p999_us", _lat_percentile(latency[i], 999));
+		blobmsg_add_u64(buf, "max_us", latency[i]->max_us);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_table(buf, list);
+}
+
+int
+ovsd_sched_set_timeout(const char *cls, unsigned int timeout_ms)
+{
+	for (int i = 0; i < __SCHED_CLASS_MAX; i++) {
+		if (strcmp(sched_class_name[i], cls))
+			continue;
+
+		queues[i].timeout_ms = timeout_ms;
+		return 0;
+	}
+
+	return -1;
+}
+
+void
+ovsd_sched_init(struct ubus_context *ctx)
+{
+	sched_ctx = ctx;
+	sched_start_us = ovsd_now_us();
+
+	for (int i = 0; i < __SCHED_CLASS_MAX; i++)
+		INIT_LIST_HEAD(&queues[i].jobs);
+}
@@ -0,0 +1,75 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_SCHED_H
+#define __OVSD_SCHED_H
+
+#include "ovsd.h"
+#include "names.h"
+
+/* Request classes in order of decreasing priority. A queued request is only
+ * served if all queues of higher priority are empty.
+ */
+enum ovsd_sched_class {
+	SCHED_CLASS_READ,
+	SCHED_CLASS_HOTPLUG,
+	SCHED_CLASS_LIFECYCLE,
+	SCHED_CLASS_RELOAD,
+	__SCHED_CLASS_MAX
+};
+
+struct ovsd_job;
+
+/* Serves a list of queued jobs of the same method at once. The handler must
+ * complete every job with ovsd_sched_complete().
+ */
+typedef void (*ovsd_batch_handler_t)(struct ubus_context *ctx,
+	struct list_head *jobs);
+
+struct ovsd_job {
+	struct list_head list;
+
+	enum ovsd_sched_class cls;
+	uint64_t queued_at;
+
+	// bridge the request refers to, if any
+	ovsd_name_t bridge;
+
+	// Open vSwitch instance named in the request, points into msg
+	const char *instance;
+
+	// deferred ubus request and a private copy of its message
+	struct ubus_object *obj;
+	struct ubus_request_data req;
+	ubus_handler_t handler;
+	ovsd_batch_handler_t batch;
+	struct blob_attr *msg;
+	char *method;
+};
+
+void ovsd_sched_init(struct ubus_context *ctx);
+
+int ovsd_sched_submit(struct ubus_object *obj, struct ubus_request_data *req,
+	const char *method, struct blob_attr *msg, enum ovsd_sched_class cls,
+	ubus_handler_t handler, ovsd_batch_handler_t batch);
+void ovsd_sched_complete(struct ovsd_job *job, int ret);
+
+/* True if no request is waiting to be served */
+bool ovsd_sched_idle(void);
+
+void ovsd_sched_dump(struct blob_buf *buf);
+
+/* Set the deadline of a request class by name, e.g. "read" */
+int ovsd_sched_set_timeout(const char *cls, unsigned int timeout_ms);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "slowlog.h"
+
+struct slowlog_entry {
+	uint64_t id;
+	time_t time;
+	const char *instance;
+
+	// arguments separated by spaces
+	char *args;
+	struct ovsd_call call;
+};
+
+static struct slowlog_entry entries[OVSD_SLOWLOG_SIZE];
+static unsigned int head, count;
+static uint64_t n_recorded;
+
+static unsigned int threshold_ms = OVSD_SLOWLOG_THRESHOLD_MS;
+
+static bool
+_call_failed(struct ovsd_call *call)
+{
+	return call->timed_out || call->status < 0 ||
+		call->status == OVS_VSCTL_STATUS_ERROR;
+}
+
+void
+ovsd_slowlog_record(char * const *argv, const char *instance,
+	struct ovsd_call *call)
+{
+	struct slowlog_entry *e;
+	size_t len = 1;
+	char *p;
+
+	if (call->wall_us < threshold_ms * 1000ULL && !_call_failed(call))
+		return;
+
+	e = &entries[head];
+	head = (head + 1) % OVSD_SLOWLOG_SIZE;
+	if (count < OVSD_SLOWLOG_SIZE)
+		count++;
+
+	e->id = ++n_recorded;
+	e->time = time(NULL);
+	e->instance = instance;
+	e->call = *call;
+
+	for (int i = 0; argv[i]; i++)
+		len += strlen(argv[i]) + 1;
+
+	free(e->args);
+	e->args = p = malloc(len);
+	if (p)
+		*p = '\0';
+	for (int i = 0; p && argv[i]; i++)
+		p += sprintf(p, "%s%s", i ? " " : "", argv[i]);
+
+	ovsd_log_msg(L_DEBUG, "slow call %llu: %s (%llu ms, status %d)\n",
+		(unsigned long long) e->id, e->args ? e->args : "?",
+		(unsigned long long) (call->wall_us / 1000), call->status);
+}
+
+void
+ovsd_slowlog_set_threshold(unsigned int threshold)
+{
+	threshold_ms = threshold;
+}
+
+void
+ovsd_slowlog_clear(void)
+{
+	for (unsigned int i = 0; i < OVSD_SLOWLOG_SIZE; i++) {
+		free(entries[i].args);
+		entries[i].args = NULL;
+	}
+
+	head = count = 0;
+}
+
+void
+ovsd_slowlog_dump(struct blob_buf *buf)
+{
+	struct slowlog_entry *e;
+	void *list, *tbl;
+
+	blobmsg_add_u32(buf, "threshold_ms", threshold_ms);
+	blobmsg_add_u64(buf, "recorded", n_recorded);
+
+	// oldest first
+	list = blobmsg_open_array(buf, "calls");
+	for (unsigned int i = 0; i < count; i++) {
+		e = &entries[(head + OVSD_SLOWLOG_SIZE - count + i) %
+			OVSD_SLOWLOG_SIZE];
+
+		tbl = blobmsg_open_table(buf, NULL);
+		blobmsg_add_u64(buf, "id", e->id);
+		blobmsg_add_u64(buf, "time", e->time);
+		if (e->instance)
+			blobmsg_add_string(buf, "instance", e->instance);
+		if (e->args)
+			blobmsg_add_string(buf, "command", e->args);
+		blobmsg_add_u32(buf, "status", e->call.status);
+		blobmsg_add_u8(buf, "timed_out", e->call.timed_out);
+		blobmsg_add_u64(buf, "wall_us", e->call.wall_us);
+		blobmsg_add_u64(buf, "user_us", e->call.utime_us);
+		blobmsg_add_u64(buf, "system_us", e->call.stime_us);
+		blobmsg_add_u32(buf, "maxrss_kb", e->call.maxrss_kb);
+		if (e->call.err[0])
+			blobmsg_add_string(buf, "stderr", e->call.err);
+		blobmsg_close_table(buf, tbl);
+	}
+	blobmsg_close_array(buf, list);
+}
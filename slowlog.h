@@ -0,0 +1,49 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_SLOWLOG_H
+#define __OVSD_SLOWLOG_H
+
+#include "ovsd.h"
+
+#define OVSD_SLOWLOG_SIZE 32
+#define OVSD_SLOWLOG_THRESHOLD_MS 500
+
+#define OVSD_SLOWLOG_STDERR_MAX 256
+
+/* Outcome of one ovs-vsctl or ovs-appctl call */
+struct ovsd_call {
+	// exit status, -1 if the child could not be run or died of a signal
+	int status;
+	bool timed_out;
+
+	uint64_t wall_us;
+	uint64_t utime_us;
+	uint64_t stime_us;
+	long maxrss_kb;
+
+	// beginning of what the child wrote to stderr
+	char err[OVSD_SLOWLOG_STDERR_MAX];
+};
+
+/* Keep a call in the log if it took longer than the threshold or failed. The
+ * log holds the last OVSD_SLOWLOG_SIZE of them.
+ */
+void ovsd_slowlog_record(char * const *argv, const char *instance,
+	struct ovsd_call *call);
+
+void ovsd_slowlog_set_threshold(unsigned int threshold_ms);
+void ovsd_slowlog_clear(void);
+void ovsd_slowlog_dump(struct blob_buf *buf);
+
+#endif
@@ -0,0 +1,440 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+#include "config.h"
+#include "instance.h"
+#include "info.h"
+#include "journal.h"
+#include "ovs.h"
+#include "ovs-shell.h"
+#include "patch.h"
+
+// bridges indexed by name handle
+static struct ovsd_bridge **bridges;
+static ovsd_name_t n_bridges;
+
+// no journal records are written while the journal is replayed
+static bool replaying;
+static struct blob_buf jbuf;
+
+enum {
+	PORTREC_BRIDGE,
+	PORTREC_MEMBER,
+	__PORTREC_MAX
+};
+static const struct blobmsg_policy port_rec_policy[__PORTREC_MAX] = {
+	[PORTREC_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[PORTREC_MEMBER] = { .name = "member", .type = BLOBMSG_TYPE_STRING },
+};
+
+enum {
+	BRREC_NAME,
+	__BRREC_MAX
+};
+static const struct blobmsg_policy br_rec_policy[__BRREC_MAX] = {
+	[BRREC_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+};
+
+static void
+_journal_bridge(struct ovsd_bridge *br, bool keep_ports)
+{
+	if (replaying)
+		return;
+
+	blob_buf_init(&jbuf, keep_ports ? JOURNAL_BRIDGE_SET :
+		JOURNAL_BRIDGE_REPLACE);
+	blob_put_raw(&jbuf, blob_data(br->config), blob_len(br->config));
+	ovsd_journal_append(jbuf.head);
+}
+
+static void
+_journal_name(int type, ovsd_name_t bridge, ovsd_name_t port)
+{
+	if (replaying)
+		return;
+
+	blob_buf_init(&jbuf, type);
+	if (port) {
+		blobmsg_add_string(&jbuf, "bridge", ovsd_name_str(bridge));
+		blobmsg_add_string(&jbuf, "member", ovsd_name_str(port));
+	} else {
+		blobmsg_add_string(&jbuf, "name", ovsd_name_str(bridge));
+	}
+	ovsd_journal_append(jbuf.head);
+}
+
+struct ovsd_bridge *
+ovsd_state_bridge(ovsd_name_t name)
+{
+	return name < n_bridges ? bridges[name] : NULL;
+}
+
+ovsd_name_t
+ovsd_state_max(void)
+{
+	return n_bridges;
+}
+
+static void
+_bridge_free(struct ovsd_bridge *br)
+{
+	for (unsigned int i = 0; i < br->n_ports; i++)
+		ovsd_name_put(br->ports[i]);
+
+	ovsd_config_free(&br->cfg);
+	ovsd_name_put(br->parent);
+	ovsd_name_put(br->name);
+	free(br->ports);
+	free(br->config);
+	free(br);
+}
+
+static int
+_bridge_insert(struct ovsd_bridge *br)
+{
+	struct ovsd_bridge **b;
+	ovsd_name_t n = ovsd_name_max();
+
+	if (br->name >= n_bridges) {
+		b = realloc(bridges, n * sizeof(*b));
+		if (!b)
+			return -1;
+
+		memset(b + n_bridges, 0, (n - n_bridges) * sizeof(*b));
+		bridges = b;
+		n_bridges = n;
+	}
+
+	bridges[br->name] = br;
+	return 0;
+}
+
+/* Record the configuration of a bridge. If the bridge is already known, the
+ * configuration is replaced and its member ports are either kept or dropped.
+ */
+int
+ovsd_state_set_bridge(struct blob_attr *config, bool keep_ports)
+{
+	struct ovsd_bridge *br, *old;
+
+	br = calloc(1, sizeof(*br));
+	if (!br)
+		return OVSD_EUNKNOWN;
+
+	br->config = blob_memdup(config);
+	if (!br->config) {
+		free(br);
+		return OVSD_EUNKNOWN;
+	}
+
+	br->cfg = (struct ovswitch_br_config) OVSWITCH_CONFIG_INIT;
+	if (ovsd_config_parse(br->config, &br->cfg)) {
+		_bridge_free(br);
+		return OVSD_EINVALID_ARG;
+	}
+
+	br->name = ovsd_name_get(br->cfg.name);
+	br->parent = ovsd_name_get(br->cfg.parent);
+
+	old = ovsd_state_bridge(br->name);
+	if (old && keep_ports) {
+		br->ports = old->ports;
+		br->n_ports = old->n_ports;
+		br->alloc_ports = old->alloc_ports;
+		old->ports = NULL;
+		old->n_ports = 0;
+	}
+
+	if (_bridge_insert(br)) {
+		_bridge_free(br);
+		return OVSD_EUNKNOWN;
+	}
+
+	if (old)
+		_bridge_free(old);
+
+	ovsd_info_changed(br->name);
+	_journal_bridge(br, keep_ports);
+	return OVSD_OK;
+}
+
+void
+ovsd_state_del_bridge(ovsd_name_t name)
+{
+	struct ovsd_bridge *br = ovsd_state_bridge(name), *child;
+	ovsd_name_t i;
+
+	if (!br)
+		return;
+
+	// deleting a bridge also deletes its fake bridges
+	ovsd_state_for_each_bridge(child, i)
+		if (child->parent == name)
+			ovsd_state_del_bridge(child->name);
+
+	ovsd_info_changed(name);
+	_journal_name(JOURNAL_BRIDGE_DEL, name, OVSD_NAME_NONE);
+	bridges[name] = NULL;
+	_bridge_free(br);
+}
+
+int
+ovsd_state_add_port(ovsd_name_t bridge, ovsd_name_t port)
+{
+	struct ovsd_bridge *br = ovsd_state_bridge(bridge);
+	ovsd_name_t *ports;
+
+	if (!br || !port)
+		return OVSD_ENOEXIST;
+
+	for (unsigned int i = 0; i < br->n_ports; i++)
+		if (br->ports[i] == port)
+			return OVSD_OK;
+
+	if (br->n_ports == br->alloc_ports) {
+		unsigned int alloc = br->alloc_ports ? br->alloc_ports * 2 : 4;
+
+		ports = realloc(br->ports, alloc * sizeof(*ports));
+		if (!ports)
+			return OVSD_EUNKNOWN;
+
+		br->ports = ports;
+		br->alloc_ports = alloc;
+	}
+
+	br->ports[br->n_ports++] = ovsd_name_ref(port);
+	ovsd_info_changed(bridge);
+	_journal_name(JOURNAL_PORT_ADD, bridge, port);
+	return OVSD_OK;
+}
+
+void
+ovsd_state_del_port(ovsd_name_t bridge, ovsd_name_t port)
+{
+	struct ovsd_bridge *br = ovsd_state_bridge(bridge);
+
+	if (!br)
+		return;
+
+	for (unsigned int i = 0; i < br->n_ports; i++) {
+		if (br->ports[i] != port)
+			continue;
+
+		br->ports[i] = br->ports[--br->n_ports];
+		ovsd_info_changed(bridge);
+		_journal_name(JOURNAL_PORT_DEL, bridge, port);
+		ovsd_name_put(port);
+		return;
+	}
+}
+
+static void
+_state_replay(struct blob_attr *rec)
+{
+	struct blob_attr *tb[__PORTREC_MAX];
+	ovsd_name_t bridge, port;
+
+	switch (blob_id(rec)) {
+	case JOURNAL_BRIDGE_SET:
+	case JOURNAL_BRIDGE_REPLACE:
+		ovsd_state_set_bridge(rec, blob_id(rec) == JOURNAL_BRIDGE_SET);
+		break;
+	case JOURNAL_BRIDGE_DEL:
+		blobmsg_parse(br_rec_policy, __BRREC_MAX, tb, blob_data(rec),
+			blob_len(rec));
+		ovsd_state_del_bridge(ovsd_name_lookup(
+			blobmsg_get_string(tb[BRREC_NAME])));
+		break;
+	case JOURNAL_PORT_ADD:
+	case JOURNAL_PORT_DEL:
+		blobmsg_parse(port_rec_policy, __PORTREC_MAX, tb, blob_data(rec),
+			blob_len(rec));
+		if (!tb[PORTREC_BRIDGE] || !tb[PORTREC_MEMBER])
+			break;
+
+		bridge = ovsd_name_lookup(blobmsg_get_string(tb[PORTREC_BRIDGE]));
+		port = ovsd_name_get(blobmsg_get_string(tb[PORTREC_MEMBER]));
+		if (blob_id(rec) == JOURNAL_PORT_ADD)
+			ovsd_state_add_port(bridge, port);
+		else
+			ovsd_state_del_port(bridge, port);
+		ovsd_name_put(port);
+		break;
+	}
+}
+
+static void
+_state_dump(void)
+{
+	struct ovsd_bridge *br;
+	ovsd_name_t i;
+
+	// parents before their fake bridges
+	for (int fake = 0; fake < 2; fake++) {
+		ovsd_state_for_each_bridge(br, i) {
+			if (!br->parent != !fake)
+				continue;
+
+			_journal_bridge(br, true);
+			for (unsigned int p = 0; p < br->n_ports; p++)
+				_journal_name(JOURNAL_PORT_ADD, br->name, br->ports[p]);
+		}
+	}
+}
+
+/* Bring an instance in line with the state loaded from the journal: create
+ * all known bridges and add their ports in a single transaction. Nothing is
+ * removed.
+ */
+static void
+_state_reconcile_instance(struct ovsd_instance *inst)
+{
+	struct ovsd_bridge *br;
+	struct ovs_txn txn;
+	ovsd_name_t i;
+	int ret;
+
+	ovs_txn_init(&txn);
+
+	for (int fake = 0; fake < 2; fake++) {
+		ovsd_state_for_each_bridge(br, i) {
+			if (!br->parent != !fake || ovsd_instance_of(i) != inst)
+				continue;
+
+			if (fake && !ovsd_state_bridge(br->parent))
+				continue;
+
+			ovs_shell_txn_add_bridge(&txn, &br->cfg);
+			for (unsigned int p = 0; p < br->n_ports; p++) {
+				// bond members are part of the bond created above
+				if (ovsd_config_is_bond_member(&br->cfg,
+						ovsd_name_str(br->ports[p])))
+					continue;
+
+				ovs_shell_txn_add_port(&txn, br->cfg.name,
+					ovsd_name_str(br->ports[p]), NULL);
+				ovs_shell_txn_set_rxq(&txn, ovsd_name_str(br->ports[p]),
+					br->cfg.n_rxq, false);
+			}
+
+			// mirrors that refer to ports could not be created above
+			if (br->n_ports && br->cfg.n_mirrors)
+				ovs_shell_txn_set_mirrors(&txn, &br->cfg, br->ports,
+					br->n_ports, true);
+		}
+	}
+
+	// peers are linked once all bridges exist, both sides of a pair add
+	// it, which --may-exist tolerates
+	ovsd_state_for_each_bridge(br, i)
+		if (!br->parent && ovsd_instance_of(i) == inst)
+			ovs_patch_txn_link(&txn, &br->cfg);
+
+	if (!ovs_txn_empty(&txn)) {
+		ovsd_instance_select(inst);
+		ret = ovs_txn_commit(&txn);
+		ovsd_instance_select(NULL);
+
+		if (ret)
+			ovsd_log_msg(L_WARNING, "%s: restoring state from journal failed: "
+				"%s\n", inst->name, ovs_strerror(ret));
+		else
+			ovsd_log_msg(L_NOTICE, "%s: state restored from journal\n",
+				inst->name);
+	}
+
+	ovs_txn_free(&txn);
+}
+
+static void
+_state_reconcile(struct uloop_timeout *t)
+{
+	struct ovsd_instance *inst;
+
+	for (int i = 0; (inst = ovsd_instance_get(i)); i++)
+		_state_reconcile_instance(inst);
+}
+
+static struct uloop_timeout reconcile_timer = {
+	.cb = _state_reconcile,
+};
+
+int
+ovsd_state_init(const char *journal_path, struct blob_attr *snapshot)
+{
+	struct blob_attr *rec;
+	int ret, rem;
+
+	replaying = true;
+	if (snapshot)
+		blob_for_each_attr(rec, snapshot, rem)
+			_state_replay(rec);
+	ret = ovsd_journal_open(journal_path, snapshot ? NULL : _state_replay,
+		_state_dump);
+	replaying = false;
+
+	// the previous ovsd left Open vSwitch as the snapshot describes it
+	if (snapshot) {
+		if (!ret)
+			ovsd_journal_compact();
+		return ret;
+	}
+
+	if (ret)
+		return ret;
+
+	// reconcile once the main loop is running
+	if (n_bridges)
+		uloop_timeout_set(&reconcile_timer, 0);
+
+	return 0;
+}
+
+void
+ovsd_state_snapshot(struct blob_buf *buf)
+{
+	struct ovsd_bridge *br;
+	ovsd_name_t i;
+	void *rec;
+
+	// parents before their fake bridges
+	for (int fake = 0; fake < 2; fake++) {
+		ovsd_state_for_each_bridge(br, i) {
+			if (!br->parent != !fake)
+				continue;
+
+			rec = blob_nest_start(buf, JOURNAL_BRIDGE_SET);
+			blob_put_raw(buf, blob_data(br->config), blob_len(br->config));
+			blob_nest_end(buf, rec);
+
+			for (unsigned int p = 0; p < br->n_ports; p++) {
+				rec = blob_nest_start(buf, JOURNAL_PORT_ADD);
+				blobmsg_add_string(buf, "bridge", ovsd_name_str(br->name));
+				blobmsg_add_string(buf, "member",
+					ovsd_name_str(br->ports[p]));
+				blob_nest_end(buf, rec);
+			}
+		}
+	}
+}
+
+void
+ovsd_state_done(void)
+{
+	ovsd_journal_close();
+	blob_buf_free(&jbuf);
+}
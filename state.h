@@ -0,0 +1,59 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_STATE_H
+#define __OVSD_STATE_H
+
+#include "ovsd.h"
+#include "names.h"
+
+/* Desired state of a bridge as accepted from netifd. Every change is written
+ * to the journal, so the state survives a restart of ovsd.
+ */
+struct ovsd_bridge {
+	ovsd_name_t name;
+	ovsd_name_t parent;
+
+	// configuration message, cfg points into it
+	struct blob_attr *config;
+	struct ovswitch_br_config cfg;
+
+	ovsd_name_t *ports;
+	unsigned int n_ports;
+	unsigned int alloc_ports;
+};
+
+/* Load the state from the journal and bring Open vSwitch in line with it. If
+ * a snapshot handed over by a previous ovsd is given, the state is taken from
+ * it instead and Open vSwitch is left alone.
+ */
+int ovsd_state_init(const char *journal_path, struct blob_attr *snapshot);
+void ovsd_state_done(void);
+
+// add the state to buf as a sequence of journal records
+void ovsd_state_snapshot(struct blob_buf *buf);
+
+struct ovsd_bridge *ovsd_state_bridge(ovsd_name_t name);
+ovsd_name_t ovsd_state_max(void);
+
+#define ovsd_state_for_each_bridge(br, i) \
+	for (i = 1; i < ovsd_state_max(); i++) \
+		if ((br = ovsd_state_bridge(i)))
+
+int ovsd_state_set_bridge(struct blob_attr *config, bool keep_ports);
+void ovsd_state_del_bridge(ovsd_name_t name);
+
+int ovsd_state_add_port(ovsd_name_t bridge, ovsd_name_t port);
+void ovsd_state_del_port(ovsd_name_t bridge, ovsd_name_t port);
+
+#endif
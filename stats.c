@@ -0,0 +1,427 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "stats.h"
+#include "state.h"
+#include "names.h"
+#include "ovs-shell.h"
+
+#define STATS_OUTPUT_MAXSIZE (256 * 1024)
+
+static const unsigned int stats_default_windows[] = { 60, 300 };
+
+enum stats_counter {
+	CNT_RX_PACKETS,
+	CNT_TX_PACKETS,
+	CNT_RX_BYTES,
+	CNT_TX_BYTES,
+	CNT_RX_DROPPED,
+	CNT_TX_DROPPED,
+	__CNT_MAX
+};
+
+static const char * const counter_names[__CNT_MAX] = {
+	[CNT_RX_PACKETS] = "rx_packets",
+	[CNT_TX_PACKETS] = "tx_packets",
+	[CNT_RX_BYTES] = "rx_bytes",
+	[CNT_TX_BYTES] = "tx_bytes",
+	[CNT_RX_DROPPED] = "rx_dropped",
+	[CNT_TX_DROPPED] = "tx_dropped",
+};
+
+/* Counter increments of one interval. 32 bytes, two samples per cache line;
+ * packet and drop deltas fit 32 bits for any realistic interval.
+ */
+struct stats_sample {
+	uint32_t dt_ms;
+	uint32_t rx_packets;
+	uint32_t tx_packets;
+	uint32_t dropped;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+};
+
+enum stats_rate {
+	RATE_RX_PPS,
+	RATE_TX_PPS,
+	RATE_RX_BPS,
+	RATE_TX_BPS,
+	RATE_DROP_PPS,
+	__RATE_MAX
+};
+
+static const char * const rate_names[__RATE_MAX] = {
+	[RATE_RX_PPS] = "rx_pps",
+	[RATE_TX_PPS] = "tx_pps",
+	[RATE_RX_BPS] = "rx_bps",
+	[RATE_TX_BPS] = "tx_bps",
+	[RATE_DROP_PPS] = "drop_pps",
+};
+
+/* History of a port, about 4 KiB: the ring of samples and the absolute
+ * counters of the newest one, which the next sample is a delta to.
+ */
+struct port_stats {
+	ovsd_name_t name;
+	uint64_t last[__CNT_MAX];
+	uint64_t last_us;
+	uint16_t head;
+	uint16_t count;
+	bool seen;
+
+	struct stats_sample ring[OVSD_STATS_RING_SIZE];
+};
+
+// port histories indexed by name handle
+static struct port_stats **ports;
+static ovsd_name_t n_ports;
+
+static unsigned int interval_ms;
+
+static void stats_sample_cb(struct uloop_timeout *t);
+static struct uloop_timeout sample_timer = {
+	.cb = stats_sample_cb,
+};
+
+static struct port_stats *
+_port_get(ovsd_name_t name)
+{
+	struct port_stats **p;
+	ovsd_name_t n = ovsd_name_max();
+
+	if (name >= n_ports) {
+		p = realloc(ports, n * sizeof(*p));
+		if (!p)
+			return NULL;
+
+		memset(p + n_ports, 0, (n - n_ports) * sizeof(*p));
+		ports = p;
+		n_ports = n;
+	}
+
+	if (!ports[name]) {
+		ports[name] = calloc(1, sizeof(**ports));
+		if (ports[name])
+			ports[name]->name = ovsd_name_ref(name);
+	}
+
+	return ports[name];
+}
+
+static void
+_port_free(ovsd_name_t name)
+{
+	ovsd_name_put(ports[name]->name);
+	free(ports[name]);
+	ports[name] = NULL;
+}
+
+// mark the ports of all bridges in a map indexed by name handle
+static uint8_t *
+_managed_ports(void)
+{
+	struct ovsd_bridge *br;
+	uint8_t *managed;
+	ovsd_name_t i;
+
+	managed = calloc(ovsd_name_max(), 1);
+	if (!managed)
+		return NULL;
+
+	ovsd_state_for_each_bridge(br, i)
+		for (unsigned int p = 0; p < br->n_ports; p++)
+			managed[br->ports[p]] = 1;
+
+	return managed;
+}
+
+static uint64_t
+_delta(uint64_t now, uint64_t last)
+{
+	// counters went backwards, e.g. the interface was recreated
+	return now >= last ? now - last : 0;
+}
+
+static uint32_t
+_delta32(uint64_t now, uint64_t last)
+{
+	uint64_t d = _delta(now, last);
+
+	return d > UINT32_MAX ? UINT32_MAX : d;
+}
+
+static void
+_port_record(struct port_stats *ps, uint64_t *cnt, uint64_t now_us)
+{
+	struct stats_sample *s;
+
+	if (ps->last_us) {
+		s = &ps->ring[ps->head];
+		s->dt_ms = (now_us - ps->last_us) / 1000 ?: 1;
+		s->rx_packets = _delta32(cnt[CNT_RX_PACKETS],
+			ps->last[CNT_RX_PACKETS]);
+		s->tx_packets = _delta32(cnt[CNT_TX_PACKETS],
+			ps->last[CNT_TX_PACKETS]);
+		s->dropped = _delta32(cnt[CNT_RX_DROPPED] + cnt[CNT_TX_DROPPED],
+			ps->last[CNT_RX_DROPPED] + ps->last[CNT_TX_DROPPED]);
+		s->rx_bytes = _delta(cnt[CNT_RX_BYTES], ps->last[CNT_RX_BYTES]);
+		s->tx_bytes = _delta(cnt[CNT_TX_BYTES], ps->last[CNT_TX_BYTES]);
+
+		ps->head = (ps->head + 1) % OVSD_STATS_RING_SIZE;
+		if (ps->count < OVSD_STATS_RING_SIZE)
+			ps->count++;
+	}
+
+	memcpy(ps->last, cnt, sizeof(ps->last));
+	ps->last_us = now_us;
+	ps->seen = true;
+}
+
+/* Parse the output of 'list Interface' with the name and statistics columns,
+ * i.e. a name line followed by a line of key=value pairs per interface.
+ */
+static void
+_stats_parse(char *out, uint64_t now_us)
+{
+	char *line, *save, *tok, *tsave, *val;
+	struct port_stats *ps = NULL;
+	uint64_t cnt[__CNT_MAX];
+	uint8_t *managed;
+	ovsd_name_t name;
+
+	managed = _managed_ports();
+	if (!managed)
+		return;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (!strchr(line, '=')) {
+			name = ovsd_name_lookup(line);
+			ps = (name && managed[name]) ? _port_get(name) : NULL;
+			continue;
+		}
+
+		if (!ps)
+			continue;
+
+		memset(cnt, 0, sizeof(cnt));
+		for (tok = strtok_r(line, " ", &tsave); tok;
+				tok = strtok_r(NULL, " ", &tsave)) {
+			if (!(val = strchr(tok, '=')))
+				continue;
+
+			*val++ = '\0';
+			for (int i = 0; i < __CNT_MAX; i++)
+				if (!strcmp(tok, counter_names[i]))
+					cnt[i] = strtoull(val, NULL, 10);
+		}
+
+		_port_record(ps, cnt, now_us);
+		ps = NULL;
+	}
+
+	free(managed);
+}
+
+static void
+_stats_sample(void)
+{
+	char * const argv[] = {
+		OVS_VSCTL, "--bare", "--columns=name,statistics", ovs_cmd(CMD_LIST),
+		"Interface", NULL
+	};
+	char *out;
+
+	out = malloc(STATS_OUTPUT_MAXSIZE);
+	if (!out)
+		return;
+
+	for (ovsd_name_t i = 0; i < n_ports; i++)
+		if (ports[i])
+			ports[i]->seen = false;
+
+	// sampling must never take longer than half an interval
+	ovs_shell_set_deadline(ovsd_now_us() + interval_ms * 500ULL);
+	if (!ovs_vsctl_output(argv, out, STATS_OUTPUT_MAXSIZE))
+		_stats_parse(out, ovsd_now_us());
+	else
+		for (ovsd_name_t i = 0; i < n_ports; i++)
+			if (ports[i])
+				ports[i]->seen = true;
+	ovs_shell_set_deadline(0);
+
+	free(out);
+
+	// forget ports that are gone
+	for (ovsd_name_t i = 0; i < n_ports; i++) {
+		if (ports[i] && !ports[i]->seen)
+			_port_free(i);
+	}
+}
+
+static void
+stats_sample_cb(struct uloop_timeout *t)
+{
+	_stats_sample();
+	uloop_timeout_set(t, interval_ms);
+}
+
+static uint64_t
+_value(struct stats_sample *s, enum stats_rate rate)
+{
+	switch (rate) {
+	case RATE_RX_PPS: return s->rx_packets;
+	case RATE_TX_PPS: return s->tx_packets;
+	case RATE_RX_BPS: return s->rx_bytes * 8;
+	case RATE_TX_BPS: return s->tx_bytes * 8;
+	case RATE_DROP_PPS: return s->dropped;
+	default: return 0;
+	}
+}
+
+static uint64_t
+_rate(uint64_t value, uint64_t dt_ms)
+{
+	return dt_ms ? value * 1000 / dt_ms : 0;
+}
+
+static void
+_dump_window(struct port_stats *ps, unsigned int window, struct blob_buf *buf)
+{
+	uint64_t min[__RATE_MAX], max[__RATE_MAX], sum[__RATE_MAX], r, span = 0;
+	struct stats_sample *s;
+	char name[16];
+	void *tbl, *rt;
+	int idx;
+
+	for (int i = 0; i < __RATE_MAX; i++) {
+		min[i] = UINT64_MAX;
+		max[i] = sum[i] = 0;
+	}
+
+	// walk back from the newest sample until the window is covered
+	for (int n = 0; n < ps->count && span < window * 1000ULL; n++) {
+		idx = (ps->head + OVSD_STATS_RING_SIZE - 1 - n) % OVSD_STATS_RING_SIZE;
+		s = &ps->ring[idx];
+
+		for (int i = 0; i < __RATE_MAX; i++) {
+			r = _rate(_value(s, i), s->dt_ms);
+			if (r < min[i])
+				min[i] = r;
+			if (r > max[i])
+				max[i] = r;
+			sum[i] += _value(s, i);
+		}
+		span += s->dt_ms;
+	}
+
+	if (!span)
+		return;
+
+	snprintf(name, sizeof(name), "%u", window);
+	tbl = blobmsg_open_table(buf, name);
+	blobmsg_add_u32(buf, "covered", span / 1000);
+	for (int i = 0; i < __RATE_MAX; i++) {
+		rt = blobmsg_open_table(buf, rate_names[i]);
+		blobmsg_add_u64(buf, "min", min[i]);
+		blobmsg_add_u64(buf, "avg", _rate(sum[i], span));
+		blobmsg_add_u64(buf, "max", max[i]);
+		blobmsg_close_table(buf, rt);
+	}
+	blobmsg_close_table(buf, tbl);
+}
+
+static void
+_dump_port(ovsd_name_t name, struct blob_attr *windows, struct blob_buf *buf)
+{
+	struct port_stats *ps = name < n_ports ? ports[name] : NULL;
+	struct stats_sample *s;
+	struct blob_attr *cur;
+	void *tbl, *w;
+	int rem;
+
+	if (!ps || !ps->count)
+		return;
+
+	s = &ps->ring[(ps->head + OVSD_STATS_RING_SIZE - 1) % OVSD_STATS_RING_SIZE];
+
+	tbl = blobmsg_open_table(buf, ovsd_name_str(name));
+	for (int i = 0; i < __RATE_MAX; i++)
+		blobmsg_add_u64(buf, rate_names[i], _rate(_value(s, i), s->dt_ms));
+
+	w = blobmsg_open_table(buf, "windows");
+	if (windows) {
+		blobmsg_for_each_attr(cur, windows, rem)
+			if (blobmsg_type(cur) == BLOBMSG_TYPE_INT32)
+				_dump_window(ps, blobmsg_get_u32(cur), buf);
+	} else {
+		for (int i = 0; i < ARRAY_SIZE(stats_default_windows); i++)
+			_dump_window(ps, stats_default_windows[i], buf);
+	}
+	blobmsg_close_table(buf, w);
+
+	blobmsg_close_table(buf, tbl);
+}
+
+int
+ovsd_stats_dump(struct blob_attr *names, struct blob_attr *windows,
+	struct blob_buf *buf)
+{
+	struct blob_attr *cur;
+	void *tbl;
+	int rem;
+
+	if (!interval_ms)
+		return OVSD_ENOEXIST;
+
+	blobmsg_add_u32(buf, "interval", interval_ms);
+
+	tbl = blobmsg_open_table(buf, "ports");
+	if (names) {
+		blobmsg_for_each_attr(cur, names, rem)
+			if (blobmsg_type(cur) == BLOBMSG_TYPE_STRING)
+				_dump_port(ovsd_name_lookup(blobmsg_get_string(cur)),
+					windows, buf);
+	} else {
+		for (ovsd_name_t i = 0; i < n_ports; i++)
+			_dump_port(i, windows, buf);
+	}
+	blobmsg_close_table(buf, tbl);
+
+	return OVSD_OK;
+}
+
+void
+ovsd_stats_init(unsigned int interval)
+{
+	interval_ms = interval;
+	if (interval_ms)
+		uloop_timeout_set(&sample_timer, interval_ms);
+}
+
+void
+ovsd_stats_done(void)
+{
+	uloop_timeout_cancel(&sample_timer);
+
+	for (ovsd_name_t i = 0; i < n_ports; i++)
+		if (ports[i])
+			_port_free(i);
+	free(ports);
+	ports = NULL;
+	n_ports = 0;
+}
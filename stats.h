@@ -0,0 +1,36 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_STATS_H
+#define __OVSD_STATS_H
+
+#include "ovsd.h"
+
+#define OVSD_STATS_INTERVAL_MS 5000
+
+// samples kept per port, the history covers this many intervals
+#define OVSD_STATS_RING_SIZE 128
+
+/* Sample the counters of all ports ovsd manages every interval_ms into a ring
+ * per port. An interval of 0 disables sampling.
+ */
+void ovsd_stats_init(unsigned int interval_ms);
+void ovsd_stats_done(void);
+
+/* Add the current rates of the given ports (all if NULL) and their minimum,
+ * average and maximum over each of the given windows in seconds to buf.
+ */
+int ovsd_stats_dump(struct blob_attr *ports, struct blob_attr *windows,
+	struct blob_buf *buf);
+
+#endif
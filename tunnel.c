@@ -0,0 +1,331 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <net/if.h>
+
+#include "tunnel.h"
+#include "names.h"
+#include "ovs-shell.h"
+
+#define TUNNEL_LIST_MAXSIZE (256 * 1024)
+
+enum {
+	PEERPOL_NAME,
+	PEERPOL_TYPE,
+	PEERPOL_REMOTE_IP,
+	PEERPOL_KEY,
+	PEERPOL_OPTIONS,
+	__PEERPOL_MAX
+};
+static const struct blobmsg_policy peer_policy[__PEERPOL_MAX] = {
+	[PEERPOL_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[PEERPOL_TYPE] = { .name = "type", .type = BLOBMSG_TYPE_STRING },
+	[PEERPOL_REMOTE_IP] = { .name = "remote_ip", .type = BLOBMSG_TYPE_STRING },
+	[PEERPOL_KEY] = { .name = "key", .type = BLOBMSG_TYPE_STRING },
+	[PEERPOL_OPTIONS] = { .name = "options", .type = BLOBMSG_TYPE_TABLE },
+};
+
+static const struct {
+	const char *type;
+	const char *prefix;
+} tunnel_types[] = {
+	{ "vxlan", "vx" },
+	{ "gre", "gre" },
+	{ "geneve", "gnv" },
+};
+
+struct tunnel_port {
+	ovsd_name_t name;
+	uint32_t hash;
+
+	// desired ports only
+	char *type;
+	char *remote_ip;
+	char *key;
+	struct blob_attr *options;
+
+	bool matched;
+};
+
+static uint32_t
+_hash_str(uint32_t hash, const char *str)
+{
+	if (str)
+		while (*str)
+			hash = (hash ^ (uint8_t) *str++) * 16777619u;
+
+	// terminate every field so that "ab","c" and "a","bc" differ
+	return (hash ^ 0xff) * 16777619u;
+}
+
+/* Value of an option as string, options may be given as strings or numbers */
+static const char *
+_option_value(struct blob_attr *attr, char *buf, size_t len)
+{
+	switch (blobmsg_type(attr)) {
+	case BLOBMSG_TYPE_STRING:
+		return blobmsg_get_string(attr);
+	case BLOBMSG_TYPE_INT32:
+		snprintf(buf, len, "%u", blobmsg_get_u32(attr));
+		return buf;
+	default:
+		return NULL;
+	}
+}
+
+static int
+_parse_peer(struct blob_attr *attr, struct tunnel_port *peer)
+{
+	struct blob_attr *tb[__PEERPOL_MAX], *cur;
+	const char *prefix = NULL;
+	char name[IFNAMSIZ], num[16];
+	uint32_t hash = 2166136261u;
+	int rem;
+
+	blobmsg_parse(peer_policy, __PEERPOL_MAX, tb, blobmsg_data(attr),
+		blobmsg_data_len(attr));
+
+	if (!tb[PEERPOL_REMOTE_IP])
+		return OVSD_EINVALID_ARG;
+
+	peer->type = tb[PEERPOL_TYPE] ? blobmsg_get_string(tb[PEERPOL_TYPE]) :
+		"vxlan";
+	for (int i = 0; i < ARRAY_SIZE(tunnel_types); i++)
+		if (!strcmp(peer->type, tunnel_types[i].type))
+			prefix = tunnel_types[i].prefix;
+	if (!prefix)
+		return OVSD_EINVALID_ARG;
+
+	peer->remote_ip = blobmsg_get_string(tb[PEERPOL_REMOTE_IP]);
+	peer->key = blobmsg_get_string(tb[PEERPOL_KEY]);
+	peer->options = tb[PEERPOL_OPTIONS];
+
+	// ports without a name are named after their remote end
+	if (tb[PEERPOL_NAME]) {
+		if (strlen(blobmsg_get_string(tb[PEERPOL_NAME])) >= IFNAMSIZ)
+			return OVSD_EINVALID_ARG;
+		peer->name = ovsd_name_get(blobmsg_get_string(tb[PEERPOL_NAME]));
+	} else {
+		snprintf(name, sizeof(name), "%s%08x", prefix,
+			_hash_str(_hash_str(hash, peer->remote_ip), peer->key));
+		peer->name = ovsd_name_get(name);
+	}
+
+	hash = _hash_str(hash, peer->type);
+	hash = _hash_str(hash, peer->remote_ip);
+	hash = _hash_str(hash, peer->key);
+	if (peer->options) {
+		blobmsg_for_each_attr(cur, peer->options, rem) {
+			if (!_option_value(cur, num, sizeof(num)))
+				return OVSD_EINVALID_ARG;
+
+			hash = _hash_str(hash, blobmsg_name(cur));
+			hash = _hash_str(hash, _option_value(cur, num, sizeof(num)));
+		}
+	}
+	peer->hash = hash;
+
+	return OVSD_OK;
+}
+
+/* Read the tunnel ports ovsd created on the bridge earlier. With --bare, the
+ * output has the name and the external_ids of every interface on a line of
+ * their own, records are separated by empty lines.
+ */
+static int
+_list_tunnels(char *bridge, struct tunnel_port **ports, int *n_ports)
+{
+	char *out, *line, *save, *tok, *tsave, cond[strlen(bridge) + 32];
+	struct tunnel_port *p = NULL, *tmp;
+	int ret, n = 0;
+
+	snprintf(cond, sizeof(cond), "external_ids:%s=%s", TUNNEL_EXTID_BRIDGE,
+		bridge);
+
+	char * const argv[] = {
+		OVS_VSCTL, "--bare", "--columns=name,external_ids", "find",
+		"Interface", cond, NULL
+	};
+
+	out = malloc(TUNNEL_LIST_MAXSIZE);
+	if (!out)
+		return OVSD_EUNKNOWN;
+
+	ret = ovs_vsctl_output(argv, out, TUNNEL_LIST_MAXSIZE);
+	if (ret)
+		goto out;
+
+	for (line = strtok_r(out, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (!strchr(line, '=')) {
+			tmp = realloc(p, (n + 1) * sizeof(*p));
+			if (!tmp) {
+				ret = OVSD_EUNKNOWN;
+				goto out;
+			}
+
+			p = tmp;
+			memset(&p[n], 0, sizeof(*p));
+			p[n++].name = ovsd_name_get(line);
+			continue;
+		}
+
+		if (!n)
+			continue;
+
+		for (tok = strtok_r(line, " ", &tsave); tok;
+				tok = strtok_r(NULL, " ", &tsave))
+			if (!strncmp(tok, TUNNEL_EXTID_CONFIG "=",
+					strlen(TUNNEL_EXTID_CONFIG "=")))
+				p[n - 1].hash = strtoul(strchr(tok, '=') + 1, NULL, 16);
+	}
+
+out:
+	free(out);
+	*ports = p;
+	*n_ports = n;
+	return ret;
+}
+
+static void
+_txn_set_tunnel(struct ovs_txn *txn, char *bridge, struct tunnel_port *peer,
+	bool clear)
+{
+	const char *name = ovsd_name_str(peer->name);
+	struct blob_attr *cur;
+	char num[16];
+	int rem;
+
+	if (clear)
+		ovs_txn_cmd(txn, ovs_cmd(CMD_CLEAR), "Interface", name, "options",
+			NULL);
+
+	ovs_txn_cmd(txn, ovs_cmd(CMD_SET), "Interface", name, NULL);
+	ovs_txn_argf(txn, "type=%s", peer->type);
+	ovs_txn_argf(txn, "options:remote_ip=\"%s\"", peer->remote_ip);
+	if (peer->key)
+		ovs_txn_argf(txn, "options:key=\"%s\"", peer->key);
+
+	if (peer->options)
+		blobmsg_for_each_attr(cur, peer->options, rem)
+			ovs_txn_argf(txn, "options:%s=\"%s\"", blobmsg_name(cur),
+				_option_value(cur, num, sizeof(num)));
+
+	ovs_txn_argf(txn, "external_ids:%s=%s", TUNNEL_EXTID_BRIDGE, bridge);
+	ovs_txn_argf(txn, "external_ids:%s=%08x", TUNNEL_EXTID_CONFIG,
+		peer->hash);
+}
+
+static void
+_put_ports(struct tunnel_port *ports, int n)
+{
+	for (int i = 0; i < n; i++)
+		ovsd_name_put(ports[i].name);
+}
+
+/* Make the set of tunnel ports ovsd manages on a bridge match the given list
+ * of peers in one transaction. Only ports that are new, gone or changed are
+ * touched, changes are detected by comparing configuration hashes.
+ */
+int
+ovs_tunnel_reconcile(char *bridge, struct blob_attr *peers,
+	struct blob_buf *buf)
+{
+	struct tunnel_port *cur = NULL;
+	int n_cur = 0, n_peers, n = 0, ret;
+	unsigned int added = 0, removed = 0, changed = 0, unchanged = 0;
+	struct blob_attr *attr;
+	struct ovs_txn txn;
+	int rem;
+
+	n_peers = blobmsg_check_array(peers, BLOBMSG_TYPE_TABLE);
+	if (n_peers < 0)
+		return OVSD_EINVALID_ARG;
+
+	struct tunnel_port want[n_peers + 1];
+
+	memset(want, 0, sizeof(want));
+	blobmsg_for_each_attr(attr, peers, rem) {
+		ret = _parse_peer(attr, &want[n]);
+		if (ret)
+			goto out;
+
+		for (int i = 0; i < n; i++) {
+			if (want[i].name == want[n].name) {
+				ret = OVSD_EINVALID_ARG;
+				goto out;
+			}
+		}
+		n++;
+	}
+
+	ret = _list_tunnels(bridge, &cur, &n_cur);
+	if (ret)
+		goto out;
+
+	ovs_txn_init(&txn);
+
+	for (int i = 0; i < n; i++) {
+		struct tunnel_port *old = NULL;
+
+		for (int j = 0; j < n_cur && !old; j++)
+			if (cur[j].name == want[i].name)
+				old = &cur[j];
+
+		if (!old) {
+			ovs_txn_cmd(&txn, ovs_cmd(MODIFIER_MAY_EXIST),
+				ovs_cmd(CMD_ADD_PORT), bridge, ovsd_name_str(want[i].name),
+				NULL);
+			_txn_set_tunnel(&txn, bridge, &want[i], false);
+			added++;
+			continue;
+		}
+
+		old->matched = true;
+		if (old->hash == want[i].hash) {
+			unchanged++;
+			continue;
+		}
+
+		_txn_set_tunnel(&txn, bridge, &want[i], true);
+		changed++;
+	}
+
+	for (int j = 0; j < n_cur; j++) {
+		if (cur[j].matched)
+			continue;
+
+		ovs_txn_cmd(&txn, ovs_cmd(MODIFIER_IF_EXISTS), ovs_cmd(CMD_DEL_PORT),
+			bridge, ovsd_name_str(cur[j].name), NULL);
+		removed++;
+	}
+
+	ret = ovs_txn_commit(&txn);
+	ovs_txn_free(&txn);
+
+	if (!ret) {
+		blobmsg_add_u32(buf, "added", added);
+		blobmsg_add_u32(buf, "removed", removed);
+		blobmsg_add_u32(buf, "changed", changed);
+		blobmsg_add_u32(buf, "unchanged", unchanged);
+	}
+
+out:
+	_put_ports(want, n_peers);
+	_put_ports(cur, n_cur);
+	free(cur);
+	return ret;
+}
@@ -0,0 +1,28 @@
+/*
+ * ovsd - Open vSwitch integration into LEDE's netifd
+ * Copyright (C) 2016 Arne Kappen <akappen@inet.tu-berlin.de>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __OVSD_TUNNEL_H
+#define __OVSD_TUNNEL_H
+
+#include "ovsd.h"
+
+/* Tunnel ports managed by ovsd carry these keys in the external_ids of their
+ * interface: the bridge they belong to and a hash of their configuration.
+ */
+#define TUNNEL_EXTID_BRIDGE "ovsd-tunnel"
+#define TUNNEL_EXTID_CONFIG "ovsd-config"
+
+int ovs_tunnel_reconcile(char *bridge, struct blob_attr *peers,
+	struct blob_buf *buf);
+
+#endif
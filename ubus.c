@@ -15,6 +15,19 @@
 #include <stdio.h>
 
 #include "ovs.h"
+#include "config.h"
+#include "drift.h"
+#include "dump.h"
+#include "fdb.h"
+#include "info.h"
+#include "instance.h"
+#include "log.h"
+#include "offline.h"
+#include "restart.h"
+#include "sched.h"
+#include "slowlog.h"
+#include "state.h"
+#include "stats.h"
 #include "ubus.h"
 
 struct ubus_context *ubus_ctx = NULL;
@@ -22,6 +35,9 @@ static struct blob_buf bbuf;
 static const char *ubus_path;
 static struct ubus_object ovsd_obj;
 
+static void _offline_applied(enum ovsd_offline_op op, struct blob_attr *msg,
+	int ret);
+
 static int
 _ovs_error_to_ubus_error(int s)
 {
@@ -33,6 +49,16 @@ _ovs_error_to_ubus_error(int s)
 				return UBUS_STATUS_INVALID_ARGUMENT;
 		case OVSD_ENOPARENT:
 			return UBUS_STATUS_NOT_FOUND;
+		case OVSD_EBUSY:
+			return UBUS_STATUS_NO_DATA;
+		case OVSD_EOFCONN:
+			return UBUS_STATUS_CONNECTION_FAILED;
+		case OVSD_EOFREJECT:
+			return UBUS_STATUS_INVALID_ARGUMENT;
+		case OVSD_ETIMEOUT:
+			return UBUS_STATUS_TIMEOUT;
+		case OVSD_EOFFLINE:
+			return UBUS_STATUS_CONNECTION_FAILED;
 		default:
 			return UBUS_STATUS_UNKNOWN_ERROR;
 	}
@@ -46,7 +72,7 @@ ovsd_add_ubus_object(void)
 	int ret = ubus_add_object(ubus_ctx, &ovsd_obj);
 
 	if (ret) {
-		fprintf(stderr, "Failed to register '%s' object with ubus: %s\n",
+		ovsd_log_msg(L_CRIT, "Failed to register '%s' object with ubus: %s\n",
 			ovsd_obj.name, ubus_strerror(ret));
 		return ret;
 	}
@@ -101,83 +127,25 @@ ovsd_ubus_init(const char *path)
 	ubus_ctx->connection_lost = ovsd_ubus_connection_lost_cb;
 	ovsd_ubus_add_fd();
 
+	ovsd_sched_init(ubus_ctx);
+	ovsd_offline_init(_offline_applied);
+
 	ovsd_add_ubus_object();
 
 	return 0;
 }
 
-static char**
-_parse_strarray(struct blob_attr *head, size_t len, int *n_entries)
+/* Closing the connection removes the 'ovs' object from ubus */
+void
+ovsd_ubus_done(void)
 {
-	struct blob_attr *cur;
-	int offset = 0;
-
-	char **arr = calloc(len, sizeof(char*));
-	if (!arr)
-		return NULL;
-
-	__blob_for_each_attr(cur, head, len) {
-		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
-			continue;
-
-		arr[offset++] = blobmsg_get_string(cur);
-	}
+	if (!ubus_ctx)
+		return;
 
-	*n_entries = offset;
-	return arr;
+	ubus_free(ubus_ctx);
+	ubus_ctx = NULL;
 }
 
-enum {
-	CREATPOL_BRIDGE,
-	CREATPOL_PARENT,
-	CREATPOL_VLAN,
-	CREATPOL_OFCONTROLLERS,
-	CREATPOL_FAILMODE,
-	CREATPOL_SSLPRIVKEY,
-	CREATPOL_SSLCERT,
-	CREATPOL_SSLCACERT,
-	CREATPOL_SSLBOOTSTRAP,
-	__CREATPOL_MAX
-};
-static const struct blobmsg_policy create_policy[__CREATPOL_MAX] = {
-	[CREATPOL_BRIDGE] = {
-		.name = "name",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_PARENT] = {
-		.name = "parent",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_VLAN] = {
-		.name = "vlan",
-		.type = BLOBMSG_TYPE_INT32,
-	},
-	[CREATPOL_OFCONTROLLERS] = {
-		.name = "ofcontrollers",
-		.type = BLOBMSG_TYPE_ARRAY,
-	},
-	[CREATPOL_FAILMODE] = {
-		.name = "controller_fail_mode",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_SSLPRIVKEY] = {
-		.name = "ssl_private_key",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_SSLCERT] = {
-		.name = "ssl_cert",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_SSLCACERT] = {
-		.name = "ssl_ca_cert",
-		.type = BLOBMSG_TYPE_STRING,
-	},
-	[CREATPOL_SSLBOOTSTRAP] = {
-		.name = "ssl_bootstrap",
-		.type =  BLOBMSG_TYPE_BOOL,
-	},
-};
-
 enum netifd_notification_type {
 	NETIFD_NOTIFY_CREATE,
 	NETIFD_NOTIFY_RELOAD,
@@ -239,162 +207,278 @@ _notify_netifd(enum netifd_notification_type type, const char *bridge,
 	ret = ubus_notify_async(ubus_ctx, &ovsd_obj, netifd_notification[type],
 		bbuf.head, req);
 	if (ret)
-		fprintf(stderr, "%s notification failed: %s\n",
+		ovsd_log_msg(L_WARNING, "%s notification failed: %s\n",
 			netifd_notification[type], ubus_strerror(ret));
 
 	return ret;
 }
 
+/* Queue a change while Open vSwitch is unavailable. The caller is answered
+ * right away, netifd is notified once the change has been applied.
+ */
 static int
-_parse_ofcontroller_opts(struct blob_attr **tb,
-	struct ovswitch_br_config *ovs_cfg)
+_queue_offline(enum ovsd_offline_op op, struct ubus_request_data *req,
+	struct blob_attr *msg)
 {
-	if (!tb[CREATPOL_OFCONTROLLERS])
-		return 0;
-
-	ovs_cfg->ofcontrollers = _parse_strarray(
-		blobmsg_data(tb[CREATPOL_OFCONTROLLERS]),
-		blobmsg_data_len(tb[CREATPOL_OFCONTROLLERS]),
-		&ovs_cfg->n_ofcontrollers);
-
-	if (!ovs_cfg->n_ofcontrollers || !ovs_cfg->ofcontrollers)
-		return -1;
+	int ret = ovsd_offline_queue(op, msg);
 
-	if (tb[CREATPOL_FAILMODE]) {
-		if (!strcmp(blobmsg_get_string(tb[CREATPOL_FAILMODE]), "standalone"))
-			ovs_cfg->fail_mode = OVS_FAIL_MODE_STANDALONE;
-		else if (!strcmp(blobmsg_get_string(tb[CREATPOL_FAILMODE]), "secure"))
-			ovs_cfg->fail_mode = OVS_FAIL_MODE_SECURE;
-		else
-			return -1;
-	} else {
-		ovs_cfg->fail_mode = OVS_FAIL_MODE_STANDALONE;
-	}
+	if (!ret)
+		return 0;
 
-	return 0;
+	_send_errormsg(req, ovs_strerror(ret));
+	return _ovs_error_to_ubus_error(ret);
 }
 
+/* Finish a create request: record the new bridge and notify netifd, or send
+ * the reason of the failure to the caller.
+ */
 static int
-_parse_ssl_opts(struct blob_attr **tb, struct ovswitch_br_config *cfg)
+_create_done(struct ubus_request_data *req, struct blob_attr *msg,
+	struct ovswitch_br_config *ovs_cfg, int ret)
 {
-	if (!tb[CREATPOL_SSLPRIVKEY] || !tb[CREATPOL_SSLCERT] ||
-		!tb[CREATPOL_SSLCACERT])
-		return -1;
+	if (ret && ovsd_offline_active())
+		return _queue_offline(OFFLINE_CREATE, req, msg);
 
-	if (tb[CREATPOL_SSLBOOTSTRAP])
-		cfg->ssl_bootstrap = blobmsg_get_bool(tb[CREATPOL_SSLBOOTSTRAP]);
+	if (ret)
+		goto error;
 
-	cfg->ssl_privkey_file = blobmsg_get_string(tb[CREATPOL_SSLPRIVKEY]);
-	cfg->ssl_cert_file = blobmsg_get_string(tb[CREATPOL_SSLCERT]);
-	cfg->ssl_cacert_file = blobmsg_get_string(tb[CREATPOL_SSLCACERT]);
+	ovsd_state_set_bridge(msg, true);
 
-	return 0;
-}
+	return _notify_netifd(NETIFD_NOTIFY_CREATE, ovs_cfg->name, NULL);
 
-static enum ovsd_status
-_parse_create_msg(struct blob_attr **tb, struct ovswitch_br_config *cfg)
-{
-	// parse name
-	if (!tb[CREATPOL_BRIDGE])
-		return OVSD_EINVALID_ARG;
-	cfg->name = blobmsg_get_string(tb[CREATPOL_BRIDGE]);
+error:
+	ovsd_log_msg(L_WARNING, "Failed to create '%s': %s\n", ovs_cfg->name,
+		ovs_strerror(ret));
 
-	// parse fake bridge options
-	if (tb[CREATPOL_PARENT] && tb[CREATPOL_VLAN]) {
-		cfg->parent = blobmsg_get_string(tb[CREATPOL_PARENT]);
-		cfg->vlan_tag = blobmsg_get_u32(tb[CREATPOL_VLAN]);
-	}
+	char errormsg[strlen("Failed to create : ") + strlen(ovs_cfg->name) +
+				  strlen(ovs_strerror(ret)) + 1];
 
-	// parse SSL options
-	_parse_ssl_opts(tb, cfg);
+	sprintf(errormsg, "Failed to create %s: %s", ovs_cfg->name,
+		ovs_strerror(ret));
+
+	_send_errormsg(req, errormsg);
 
-	// parse list of OF-controllers
-	_parse_ofcontroller_opts(tb, cfg);
-	return OVSD_OK;
+	return _ovs_error_to_ubus_error(ret);
 }
 
 static int
 _handle_create(struct ubus_context *ctx, struct ubus_object *obj,
 	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
-	struct blob_attr *tb[__CREATPOL_MAX];
 	struct ovswitch_br_config ovs_cfg = OVSWITCH_CONFIG_INIT;
 	int ret;
 
-	blobmsg_parse(create_policy, __CREATPOL_MAX, tb, blob_data(msg),
-		blob_len(msg));
+	if (ovsd_offline_active())
+		return _queue_offline(OFFLINE_CREATE, req, msg);
 
-	ret = _parse_create_msg(tb, &ovs_cfg);
-	if (ret)
-		return ret;
+	ret = ovsd_config_parse(msg, &ovs_cfg);
+	if (ret) {
+		ovsd_config_free(&ovs_cfg);
+		return _ovs_error_to_ubus_error(ret);
+	}
 
 	// create the device
 	ret = ovs_create(&ovs_cfg);
 
 	// free string array
-	if (ovs_cfg.ofcontrollers)
-		free(ovs_cfg.ofcontrollers);
+	ovsd_config_free(&ovs_cfg);
 
-	if (ret)
-		goto error;
+	return _create_done(req, msg, &ovs_cfg, ret);
+}
 
-	return _notify_netifd(NETIFD_NOTIFY_CREATE, ovs_cfg.name, NULL);
+/* Create all queued bridges at once, see ovs_create_many(). At boot this
+ * turns netifd's burst of create calls into one transaction per dependency
+ * level instead of one per bridge plus retries for fake bridges.
+ */
+static void
+_handle_create_batch(struct ubus_context *ctx, struct list_head *jobs)
+{
+	struct ovswitch_br_config *cfgs;
+	struct ovsd_job *job, *tmp;
+	int n = 0, i = 0, *status;
+
+	if (ovsd_offline_active()) {
+		list_for_each_entry_safe(job, tmp, jobs, list)
+			ovsd_sched_complete(job, _queue_offline(OFFLINE_CREATE,
+				&job->req, job->msg));
+		return;
+	}
 
-error:
-	fprintf(stderr, "Failed to create '%s': %s\n", ovs_cfg.name,
-		ovs_strerror(ret));
+	list_for_each_entry(job, jobs, list)
+		n++;
 
-	char errormsg[strlen("Failed to create : ") + strlen(ovs_cfg.name) +
-				  strlen(ovs_strerror(ret)) + 1];
+	cfgs = calloc(n, sizeof(*cfgs));
+	status = calloc(n, sizeof(*status));
+	if (!cfgs || !status) {
+		list_for_each_entry_safe(job, tmp, jobs, list)
+			ovsd_sched_complete(job, _handle_create(ctx, job->obj, &job->req,
+				job->method, job->msg));
+		goto out;
+	}
 
-	sprintf(errormsg, "Failed to create %s: %s", ovs_cfg.name,
-		ovs_strerror(ret));
+	list_for_each_entry(job, jobs, list) {
+		cfgs[i] = (struct ovswitch_br_config) OVSWITCH_CONFIG_INIT;
+		status[i] = ovsd_config_parse(job->msg, &cfgs[i]);
+		i++;
+	}
 
-	_send_errormsg(req, errormsg);
+	if (n > 1)
+		ovsd_log_msg(L_INFO, "creating %d bridges\n", n);
 
-	return _ovs_error_to_ubus_error(ret);
+	ovs_create_many(cfgs, status, n);
+
+	i = 0;
+	list_for_each_entry_safe(job, tmp, jobs, list) {
+		// the message did not even name the bridge
+		if (status[i] && !cfgs[i].name)
+			ovsd_sched_complete(job, _ovs_error_to_ubus_error(status[i]));
+		else
+			ovsd_sched_complete(job, _create_done(&job->req, job->msg,
+				&cfgs[i], status[i]));
+
+		ovsd_config_free(&cfgs[i]);
+		i++;
+	}
+
+out:
+	free(cfgs);
+	free(status);
 }
 
+enum {
+	CONFPOL_PORTS,
+	__CONFPOL_MAX
+};
+static const struct blobmsg_policy configure_policy[__CONFPOL_MAX] = {
+	[CONFPOL_PORTS] = { .name = "ports", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+enum {
+	CONFPORTPOL_NAME,
+	__CONFPORTPOL_MAX
+};
+static const struct blobmsg_policy configure_port_policy[__CONFPORTPOL_MAX] = {
+	[CONFPORTPOL_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+};
+
+/* Set the VLAN membership ('tag', 'trunks', 'vlan_mode') of any number of
+ * ports in one transaction. Settings not given for a port are cleared.
+ */
 static int
 _handle_configure(struct ubus_context *ctx, struct ubus_object *obj,
 	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
+	struct blob_attr *tb[__CONFPOL_MAX], *ptb[__CONFPORTPOL_MAX], *cur;
+	int rem, n = 0, ret;
+
+	blobmsg_parse(configure_policy, __CONFPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	if (!tb[CONFPOL_PORTS])
+		return 0;
+
+	int n_ports = blobmsg_check_array(tb[CONFPOL_PORTS], BLOBMSG_TYPE_TABLE);
+	if (n_ports < 0)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+	if (!n_ports)
+		return 0;
+
+	char *ports[n_ports];
+	struct ovsd_port_vlan vlans[n_ports];
+
+	blobmsg_for_each_attr(cur, tb[CONFPOL_PORTS], rem) {
+		blobmsg_parse(configure_port_policy, __CONFPORTPOL_MAX, ptb,
+			blobmsg_data(cur), blobmsg_data_len(cur));
+		if (!ptb[CONFPORTPOL_NAME])
+			return UBUS_STATUS_INVALID_ARGUMENT;
+
+		ports[n] = blobmsg_get_string(ptb[CONFPORTPOL_NAME]);
+		vlans[n] = (struct ovsd_port_vlan) OVSD_PORT_VLAN_INIT;
+		ret = ovsd_config_parse_vlan(blobmsg_data(cur), blobmsg_data_len(cur),
+			&vlans[n]);
+		if (ret) {
+			_send_errormsg(req, ovs_strerror(ret));
+			return _ovs_error_to_ubus_error(ret);
+		}
+		n++;
+	}
+
+	ret = ovs_set_port_vlans(ports, vlans, n);
+	if (ret) {
+		_send_errormsg(req, ovs_strerror(ret));
+		return _ovs_error_to_ubus_error(ret);
+	}
+
 	return 0;
 }
 
-/* Reload a bridge. The bridge is deleted and re-created with the given config
+/* Reload a bridge. If its parent and VLAN stay the same, the new config is
+ * applied in place. Otherwise the bridge is deleted and re-created, a bridge
+ * missing from Open vSwitch is created again.
  */
 static int
 _handle_reload(struct ubus_context *ctx, struct ubus_object *obj,
 	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
 	int ret;
-	struct blob_attr *tb[__CREATPOL_MAX];
 	struct ovswitch_br_config ovs_cfg = OVSWITCH_CONFIG_INIT;
+	struct ovsd_bridge *br;
+	bool in_place;
 
-	blobmsg_parse(create_policy, __CREATPOL_MAX, tb, blobmsg_data(msg),
-		blobmsg_len(msg));
+	if (ovsd_offline_active())
+		return _queue_offline(OFFLINE_RELOAD, req, msg);
 
-	ret = _parse_create_msg(tb, &ovs_cfg);
-	if (ret)
-		return ret;
+	ret = ovsd_config_parse(msg, &ovs_cfg);
+	if (ret) {
+		ovsd_config_free(&ovs_cfg);
+		return _ovs_error_to_ubus_error(ret);
+	}
+
+	// moving a bridge to another instance takes a free and a create
+	br = ovsd_state_bridge(ovsd_name_lookup(ovs_cfg.name));
+	if (br && ovsd_instance_of(br->name) !=
+			ovsd_instance_find(ovs_cfg.instance)) {
+		ovsd_config_free(&ovs_cfg);
+		return UBUS_STATUS_INVALID_ARGUMENT;
+	}
+
+	/*
+	 * Change the bridge in place if possible. Only a new parent or VLAN
+	 * or a lost bridge takes re-creating it, other failures are reported.
+	 */
+	ret = ovs_reconfigure(&ovs_cfg);
+	in_place = ret != OVSD_EINVALID_ARG && ret != OVSD_ENOEXIST;
+	if (!in_place) {
+		ovs_delete(ovs_cfg.name);
+		ret = ovs_create(&ovs_cfg);
+	}
+
+	if (ret && ovsd_offline_active()) {
+		ovsd_config_free(&ovs_cfg);
+		return _queue_offline(OFFLINE_RELOAD, req, msg);
+	}
+
+	if (ret && in_place) {
+		_send_errormsg(req, ovs_strerror(ret));
+		ovsd_config_free(&ovs_cfg);
+		return _ovs_error_to_ubus_error(ret);
+	}
 
-	// delete and re-create the bridge
-	ovs_delete(ovs_cfg.name);
-	ret = ovs_create(&ovs_cfg);
 	if (ret)
-		fprintf(stderr, "Failed to re-create '%s': %s\n", ovs_cfg.name,
-				ovs_strerror(ret));
+		ovsd_log_msg(L_WARNING, "Failed to re-create '%s': %s\n",
+				ovs_cfg.name, ovs_strerror(ret));
+	else
+		ovsd_state_set_bridge(msg, in_place);
 
 	// free string arrays
-	if (ovs_cfg.ofcontrollers)
-		free(ovs_cfg.ofcontrollers);
+	ovsd_config_free(&ovs_cfg);
 
 	return _notify_netifd(NETIFD_NOTIFY_RELOAD, ovs_cfg.name, NULL);
 }
 
 enum {
 	DUMP_INFO_POLICY_NAME,
+	DUMP_INFO_POLICY_GENERATION,
 	__DUMP_INFO_POLICY_MAX,
 };
 
@@ -403,19 +487,77 @@ static struct blobmsg_policy dump_info_policy[__DUMP_INFO_POLICY_MAX] = {
 		.name = "name",
 		.type = BLOBMSG_TYPE_STRING,
 	},
+	[DUMP_INFO_POLICY_GENERATION] = {
+		.name = "generation",
+		.type = BLOBMSG_TYPE_INT32,
+	},
 };
 
 static int
 _handle_dump_info(struct ubus_context *ctx, struct ubus_object *obj,
 	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
-	struct blob_attr *tb[1];
+	struct blob_attr *tb[__DUMP_INFO_POLICY_MAX];
+	uint32_t generation = 0;
 
 	blobmsg_parse(dump_info_policy, __DUMP_INFO_POLICY_MAX, tb,
 		blobmsg_data(msg), blobmsg_len(msg));
 
+	if (tb[DUMP_INFO_POLICY_GENERATION])
+		generation = blobmsg_get_u32(tb[DUMP_INFO_POLICY_GENERATION]);
+
+	blob_buf_init(&bbuf, 0);
+	ovsd_info_dump(blobmsg_get_string(tb[DUMP_INFO_POLICY_NAME]), generation,
+		&bbuf);
+
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+	return 0;
+}
+
+static void
+_dump_all_flush(struct blob_buf *buf, void *priv)
+{
+	ubus_send_reply(ubus_ctx, priv, buf->head);
+}
+
+/* Every managed bridge, sent in several replies if there are many */
+static int
+_handle_dump_all(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	int ret = ovsd_dump_all(&bbuf, _dump_all_flush, req);
+
+	return ret ? _ovs_error_to_ubus_error(ret) : 0;
+}
+
+enum {
+	FDBPOL_BRIDGE,
+	FDBPOL_CURSOR,
+	FDBPOL_LIMIT,
+	__FDBPOL_MAX
+};
+static const struct blobmsg_policy fdb_policy[__FDBPOL_MAX] = {
+	[FDBPOL_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[FDBPOL_CURSOR] = { .name = "cursor", .type = BLOBMSG_TYPE_STRING },
+	[FDBPOL_LIMIT] = { .name = "limit", .type = BLOBMSG_TYPE_INT32 },
+};
+
+/* A page of the MAC learning table of a bridge, see fdb.c */
+static int
+_handle_fdb_show(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__FDBPOL_MAX];
+	int ret;
+
+	blobmsg_parse(fdb_policy, __FDBPOL_MAX, tb, blob_data(msg), blob_len(msg));
+
 	blob_buf_init(&bbuf, 0);
-	ovs_dump_info(&bbuf, blobmsg_get_string(tb[0]));
+	ret = ovsd_fdb_dump(blobmsg_get_string(tb[FDBPOL_BRIDGE]),
+		blobmsg_get_string(tb[FDBPOL_CURSOR]),
+		tb[FDBPOL_LIMIT] ? blobmsg_get_u32(tb[FDBPOL_LIMIT]) : 0, &bbuf);
+	if (ret)
+		return _ovs_error_to_ubus_error(ret);
 
 	ubus_send_reply(ubus_ctx, req, bbuf.head);
 	return 0;
@@ -452,16 +594,25 @@ _handle_free(struct ubus_context *ctx, struct ubus_object *obj,
 	if (!tb[DELPOL_NAME])
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
+	if (ovsd_offline_active())
+		return _queue_offline(OFFLINE_FREE, req, msg);
+
 	ret = ovs_delete(blobmsg_get_string(tb[DELPOL_NAME]));
 
+	if (ret && ovsd_offline_active())
+		return _queue_offline(OFFLINE_FREE, req, msg);
+
 	if (ret)
 		goto error;
 
+	ovsd_state_del_bridge(ovsd_name_lookup(
+		blobmsg_get_string(tb[DELPOL_NAME])));
+
 	return _notify_netifd(NETIFD_NOTIFY_FREE,
 		blobmsg_get_string(tb[DELPOL_NAME]), NULL);
 
 error:
-	fprintf(stderr, "Failed to delete bridge '%s': %s\n",
+	ovsd_log_msg(L_WARNING, "Failed to delete bridge '%s': %s\n",
 		blobmsg_get_string(tb[DELPOL_NAME]), ovs_strerror(ret));
 
 	return _ovs_error_to_ubus_error(ret);
@@ -492,6 +643,11 @@ _handle_check_state(struct ubus_context *ctx, struct ubus_object *obj,
 	if (!tb[CHECK_STATE_POLICY_NAME])
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
+	// answer from the desired state while Open vSwitch cannot be asked
+	if (ovsd_offline_active())
+		return ovsd_state_bridge(ovsd_name_lookup(blobmsg_get_string(
+			tb[CHECK_STATE_POLICY_NAME]))) ? 0 : UBUS_STATUS_NOT_FOUND;
+
 	if (ovs_check_state(blobmsg_get_string(tb[CHECK_STATE_POLICY_NAME])))
 		return UBUS_STATUS_NOT_FOUND;
 
@@ -514,6 +670,8 @@ _handle_hotplug_add(struct ubus_context *ctx, struct ubus_object *obj,
 	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
 {
 	struct blob_attr *tb[__HOTPLUG_ADDPOL_MAX];
+	struct ovsd_port_vlan vlan = OVSD_PORT_VLAN_INIT;
+	ovsd_name_t port;
 	int ret;
 
 	blobmsg_parse(hotplug_add_policy, __HOTPLUG_ADDPOL_MAX, tb,
@@ -522,18 +680,33 @@ _handle_hotplug_add(struct ubus_context *ctx, struct ubus_object *obj,
 	if (!tb[HOTPLUG_ADDPOL_BRIDGE] || !tb[HOTPLUG_ADDPOL_MEMBER])
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
+	// optional access or trunk VLAN settings of the port
+	if (ovsd_config_parse_vlan(blob_data(msg), blob_len(msg), &vlan))
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	if (ovsd_offline_active())
+		return _queue_offline(OFFLINE_PORT_ADD, req, msg);
+
 	ret = ovs_add_port(blobmsg_get_string(tb[HOTPLUG_ADDPOL_BRIDGE]),
-		blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]));
+		blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]), &vlan);
+
+	if (ret && ovsd_offline_active())
+		return _queue_offline(OFFLINE_PORT_ADD, req, msg);
 
 	if (ret)
 		goto error;
 
+	port = ovsd_name_get(blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]));
+	ovsd_state_add_port(ovsd_name_lookup(
+		blobmsg_get_string(tb[HOTPLUG_ADDPOL_BRIDGE])), port);
+	ovsd_name_put(port);
+
 	return _notify_netifd(NETIFD_NOTIFY_HOTPLUG_ADD,
 		blobmsg_get_string(tb[HOTPLUG_ADDPOL_BRIDGE]),
 		blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]));
 
 error:
-	fprintf(stderr, "%s: failed to add port %s: %s\n",
+	ovsd_log_msg(L_WARNING, "%s: failed to add port %s: %s\n",
 		blobmsg_get_string(tb[HOTPLUG_ADDPOL_BRIDGE]),
 		blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]), ovs_strerror(ret));
 
@@ -569,12 +742,22 @@ _handle_hotplug_remove(struct ubus_context *ctx, struct ubus_object *obj,
 	if (!tb[HOTPLUG_DELPOL_BRIDGE] || !tb[HOTPLUG_DELPOL_MEMBER])
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
+	if (ovsd_offline_active())
+		return _queue_offline(OFFLINE_PORT_REMOVE, req, msg);
+
 	ret = ovs_remove_port(blobmsg_get_string(tb[HOTPLUG_DELPOL_BRIDGE]),
 		blobmsg_get_string(tb[HOTPLUG_DELPOL_MEMBER]));
 
+	if (ret && ovsd_offline_active())
+		return _queue_offline(OFFLINE_PORT_REMOVE, req, msg);
+
 	if (ret)
 		goto error;
 
+	ovsd_state_del_port(
+		ovsd_name_lookup(blobmsg_get_string(tb[HOTPLUG_DELPOL_BRIDGE])),
+		ovsd_name_lookup(blobmsg_get_string(tb[HOTPLUG_DELPOL_MEMBER])));
+
 	_notify_netifd(NETIFD_NOTIFY_HOTPLUG_REMOVE,
 		blobmsg_get_string(tb[HOTPLUG_DELPOL_BRIDGE]),
 		blobmsg_get_string(tb[HOTPLUG_DELPOL_MEMBER]));
@@ -582,7 +765,7 @@ _handle_hotplug_remove(struct ubus_context *ctx, struct ubus_object *obj,
 	return 0;
 
 error:
-	fprintf(stderr, "%s: failed to remove port %s: %s\n",
+	ovsd_log_msg(L_WARNING, "%s: failed to remove port %s: %s\n",
 		blobmsg_get_string(tb[HOTPLUG_DELPOL_BRIDGE]),
 		blobmsg_get_string(tb[HOTPLUG_DELPOL_MEMBER]),
 		ovs_strerror(ret));
@@ -614,8 +797,15 @@ _handle_hotplug_prepare(struct ubus_context *ctx, struct ubus_object *obj,
 	if (!tb[HOTPLUG_PREPPOL_BRIDGE])
 		return UBUS_STATUS_INVALID_ARGUMENT;
 
-	if (ovs_prepare_bridge(blobmsg_get_string(tb[HOTPLUG_PREPPOL_BRIDGE])))
+	// answer from the desired state while Open vSwitch cannot be asked
+	if (ovsd_offline_active()) {
+		if (!ovsd_state_bridge(ovsd_name_lookup(blobmsg_get_string(
+				tb[HOTPLUG_PREPPOL_BRIDGE]))))
+			return UBUS_STATUS_NOT_FOUND;
+	} else if (ovs_prepare_bridge(blobmsg_get_string(
+			tb[HOTPLUG_PREPPOL_BRIDGE]))) {
 		return UBUS_STATUS_NOT_FOUND;
+	}
 
 	_notify_netifd(NETIFD_NOTIFY_HOTPLUG_PREPARE,
 		blobmsg_get_string(tb[HOTPLUG_PREPPOL_BRIDGE]), NULL);
@@ -623,12 +813,222 @@ _handle_hotplug_prepare(struct ubus_context *ctx, struct ubus_object *obj,
 	return 0;
 }
 
+enum {
+	FLOWPOL_BRIDGE,
+	FLOWPOL_FLOWS,
+	FLOWPOL_STRICT,
+	__FLOWPOL_MAX
+};
+
+static struct blobmsg_policy flow_mod_policy[__FLOWPOL_MAX] = {
+	[FLOWPOL_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[FLOWPOL_FLOWS] = { .name = "flows", .type = BLOBMSG_TYPE_ARRAY },
+	[FLOWPOL_STRICT] = { .name = "strict", .type = BLOBMSG_TYPE_BOOL },
+};
+
+static const char *flow_mod_method[__OVS_FLOW_CMD_MAX] = {
+	[OVS_FLOW_ADD] = "flow_add",
+	[OVS_FLOW_MODIFY] = "flow_modify",
+	[OVS_FLOW_DELETE] = "flow_delete",
+};
+
+/* Add, modify or delete a set of flows. All flows of one call are committed
+ * to the switch atomically in a single OpenFlow bundle.
+ */
+static int
+_handle_flow_mod(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__FLOWPOL_MAX];
+	enum ovs_flow_cmd cmd;
+	bool strict = false;
+	int ret;
+
+	blobmsg_parse(flow_mod_policy, __FLOWPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	if (!tb[FLOWPOL_BRIDGE] || !tb[FLOWPOL_FLOWS])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	for (cmd = 0; cmd < __OVS_FLOW_CMD_MAX; cmd++)
+		if (!strcmp(flow_mod_method[cmd], method))
+			break;
+
+	if (tb[FLOWPOL_STRICT])
+		strict = blobmsg_get_bool(tb[FLOWPOL_STRICT]);
+
+	blob_buf_init(&bbuf, 0);
+	ret = ovs_flow_mod(blobmsg_get_string(tb[FLOWPOL_BRIDGE]), cmd, strict,
+		tb[FLOWPOL_FLOWS], &bbuf);
+
+	if (ret) {
+		ovsd_log_msg(L_WARNING, "%s: %s failed: %s\n",
+			blobmsg_get_string(tb[FLOWPOL_BRIDGE]), method, ovs_strerror(ret));
+		blobmsg_add_string(&bbuf, "message", ovs_strerror(ret));
+	}
+
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+	return ret ? _ovs_error_to_ubus_error(ret) : 0;
+}
+
+enum {
+	TUNPOL_BRIDGE,
+	TUNPOL_PEERS,
+	__TUNPOL_MAX
+};
+static const struct blobmsg_policy tunnel_policy[__TUNPOL_MAX] = {
+	[TUNPOL_BRIDGE] = { .name = "bridge", .type = BLOBMSG_TYPE_STRING },
+	[TUNPOL_PEERS] = { .name = "peers", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+/* Reconcile the tunnel ports of a bridge with the given list of peers in one
+ * transaction. The reply counts the ports that were added, removed, changed
+ * and left alone.
+ */
+static int
+_handle_set_tunnels(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__TUNPOL_MAX];
+	int ret;
+
+	blobmsg_parse(tunnel_policy, __TUNPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	if (!tb[TUNPOL_BRIDGE] || !tb[TUNPOL_PEERS])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	blob_buf_init(&bbuf, 0);
+	ret = ovs_set_tunnels(blobmsg_get_string(tb[TUNPOL_BRIDGE]),
+		tb[TUNPOL_PEERS], &bbuf);
+	ovsd_info_changed(ovsd_name_lookup(blobmsg_get_string(tb[TUNPOL_BRIDGE])));
+
+	if (ret)
+		blobmsg_add_string(&bbuf, "message", ovs_strerror(ret));
+
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+	return ret ? _ovs_error_to_ubus_error(ret) : 0;
+}
+
+enum {
+	RATEPOL_PORTS,
+	RATEPOL_WINDOWS,
+	__RATEPOL_MAX
+};
+static const struct blobmsg_policy rates_policy[__RATEPOL_MAX] = {
+	[RATEPOL_PORTS] = { .name = "ports", .type = BLOBMSG_TYPE_ARRAY },
+	[RATEPOL_WINDOWS] = { .name = "windows", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+/* Rates of managed ports from the sampled history, see stats.c */
+static int
+_handle_port_rates(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__RATEPOL_MAX];
+
+	blobmsg_parse(rates_policy, __RATEPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	blob_buf_init(&bbuf, 0);
+	if (ovsd_stats_dump(tb[RATEPOL_PORTS], tb[RATEPOL_WINDOWS], &bbuf))
+		return UBUS_STATUS_NOT_SUPPORTED;
+
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+	return 0;
+}
+
+enum {
+	SLOWPOL_THRESHOLD,
+	SLOWPOL_CLEAR,
+	__SLOWPOL_MAX
+};
+static const struct blobmsg_policy slow_log_policy[__SLOWPOL_MAX] = {
+	[SLOWPOL_THRESHOLD] = { .name = "threshold", .type = BLOBMSG_TYPE_INT32 },
+	[SLOWPOL_CLEAR] = { .name = "clear", .type = BLOBMSG_TYPE_BOOL },
+};
+
+/* ovs-vsctl calls that were slow or failed. The log is returned before it is
+ * cleared, and a new threshold only applies to later calls.
+ */
+static int
+_handle_slow_log(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__SLOWPOL_MAX];
+
+	blobmsg_parse(slow_log_policy, __SLOWPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	blob_buf_init(&bbuf, 0);
+	ovsd_slowlog_dump(&bbuf);
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+
+	if (tb[SLOWPOL_THRESHOLD])
+		ovsd_slowlog_set_threshold(blobmsg_get_u32(tb[SLOWPOL_THRESHOLD]));
+	if (tb[SLOWPOL_CLEAR] && blobmsg_get_bool(tb[SLOWPOL_CLEAR]))
+		ovsd_slowlog_clear();
+
+	return 0;
+}
+
+static int
+_handle_status(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	blob_buf_init(&bbuf, 0);
+	ovsd_sched_dump(&bbuf);
+	ovsd_instance_dump(&bbuf);
+	ovsd_offline_dump(&bbuf);
+	ovsd_drift_dump(&bbuf);
+	ovsd_log_dump(&bbuf);
+
+	ubus_send_reply(ubus_ctx, req, bbuf.head);
+	return 0;
+}
+
+enum {
+	LOGPOL_LEVEL,
+	__LOGPOL_MAX
+};
+static const struct blobmsg_policy log_level_policy[__LOGPOL_MAX] = {
+	[LOGPOL_LEVEL] = { .name = "level", .type = BLOBMSG_TYPE_INT32 },
+};
+
+/* Change the log level at runtime */
+static int
+_handle_set_log_level(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	struct blob_attr *tb[__LOGPOL_MAX];
+
+	blobmsg_parse(log_level_policy, __LOGPOL_MAX, tb, blob_data(msg),
+		blob_len(msg));
+
+	if (!tb[LOGPOL_LEVEL] ||
+			ovsd_log_set_level(blobmsg_get_u32(tb[LOGPOL_LEVEL])))
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	ovsd_log_msg(L_NOTICE, "log level set to %d\n", ovsd_log_get_level());
+	return 0;
+}
+
+/* Hand the state over to a new ovsd binary once no requests are pending */
+static int
+_handle_hot_restart(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	ovsd_restart_request();
+	return 0;
+}
+
 enum {
 	// device handler interface
 	METHOD_CREATE,
 	METHOD_CONFIG_INIT,
 	METHOD_RELOAD,
 	METHOD_DUMP_INFO,
+	METHOD_DUMP_ALL,
 	METHOD_DUMP_STATS,
 	METHOD_CHECK_STATE,
 	METHOD_FREE,
@@ -637,29 +1037,195 @@ enum {
 	METHOD_HOTPLUG_ADD,
 	METHOD_HOTPLUG_REMOVE,
 	METHOD_HOTPLUG_PREPARE,
+
+	// OpenFlow programming
+	METHOD_FLOW_ADD,
+	METHOD_FLOW_MODIFY,
+	METHOD_FLOW_DELETE,
+
+	// overlay tunnels
+	METHOD_SET_TUNNELS,
+
+	// port counters
+	METHOD_PORT_RATES,
+
+	// MAC learning table
+	METHOD_FDB_SHOW,
+
+	// daemon introspection
+	METHOD_STATUS,
+	METHOD_SLOW_LOG,
+	METHOD_SET_LOG_LEVEL,
+	METHOD_HOT_RESTART,
 	__METHODS_MAX
 };
+
+/* A change queued while Open vSwitch was unavailable has been applied */
+static void
+_offline_applied(enum ovsd_offline_op op, struct blob_attr *msg, int ret)
+{
+	struct blob_attr *tb[__HOTPLUG_ADDPOL_MAX];
+	char *bridge, *member;
+	ovsd_name_t port;
+
+	if (op == OFFLINE_PORT_ADD || op == OFFLINE_PORT_REMOVE) {
+		blobmsg_parse(hotplug_add_policy, __HOTPLUG_ADDPOL_MAX, tb,
+			blob_data(msg), blob_len(msg));
+		bridge = blobmsg_get_string(tb[HOTPLUG_ADDPOL_BRIDGE]);
+		member = blobmsg_get_string(tb[HOTPLUG_ADDPOL_MEMBER]);
+	} else {
+		blobmsg_parse(delete_policy, __DELPOL_MAX, tb, blob_data(msg),
+			blob_len(msg));
+		bridge = blobmsg_get_string(tb[DELPOL_NAME]);
+		member = NULL;
+	}
+
+	if (ret) {
+		ovsd_log_msg(L_WARNING, "%s: queued change failed: %s\n", bridge,
+			ovs_strerror(ret));
+		return;
+	}
+
+	switch (op) {
+	case OFFLINE_CREATE:
+		ovsd_state_set_bridge(msg, true);
+		_notify_netifd(NETIFD_NOTIFY_CREATE, bridge, NULL);
+		break;
+	case OFFLINE_RELOAD:
+		ovsd_state_set_bridge(msg, false);
+		_notify_netifd(NETIFD_NOTIFY_RELOAD, bridge, NULL);
+		break;
+	case OFFLINE_FREE:
+		ovsd_state_del_bridge(ovsd_name_lookup(bridge));
+		_notify_netifd(NETIFD_NOTIFY_FREE, bridge, NULL);
+		break;
+	case OFFLINE_PORT_ADD:
+		port = ovsd_name_get(member);
+		ovsd_state_add_port(ovsd_name_lookup(bridge), port);
+		ovsd_name_put(port);
+		_notify_netifd(NETIFD_NOTIFY_HOTPLUG_ADD, bridge, member);
+		break;
+	case OFFLINE_PORT_REMOVE:
+		ovsd_state_del_port(ovsd_name_lookup(bridge),
+			ovsd_name_lookup(member));
+		_notify_netifd(NETIFD_NOTIFY_HOTPLUG_REMOVE, bridge, member);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Handlers of methods that are served through the request scheduler and the
+ * class they are queued in. Methods without an entry are served immediately.
+ */
+static const struct {
+	ubus_handler_t handler;
+	enum ovsd_sched_class cls;
+	ovsd_batch_handler_t batch;
+} queued_methods[__METHODS_MAX] = {
+	[METHOD_CREATE] = { _handle_create, SCHED_CLASS_LIFECYCLE,
+		_handle_create_batch },
+	[METHOD_CONFIG_INIT] = { _handle_configure, SCHED_CLASS_LIFECYCLE },
+	[METHOD_RELOAD] = { _handle_reload, SCHED_CLASS_RELOAD },
+	[METHOD_DUMP_INFO] = { _handle_dump_info, SCHED_CLASS_READ },
+	[METHOD_DUMP_ALL] = { _handle_dump_all, SCHED_CLASS_READ },
+	[METHOD_DUMP_STATS] = { _handle_dump_stats, SCHED_CLASS_READ },
+	[METHOD_CHECK_STATE] = { _handle_check_state, SCHED_CLASS_READ },
+	[METHOD_FREE] = { _handle_free, SCHED_CLASS_LIFECYCLE },
+
+	[METHOD_HOTPLUG_ADD] = { _handle_hotplug_add, SCHED_CLASS_HOTPLUG },
+	[METHOD_HOTPLUG_REMOVE] = { _handle_hotplug_remove, SCHED_CLASS_HOTPLUG },
+	[METHOD_HOTPLUG_PREPARE] = { _handle_hotplug_prepare, SCHED_CLASS_HOTPLUG },
+
+	[METHOD_FLOW_ADD] = { _handle_flow_mod, SCHED_CLASS_LIFECYCLE },
+	[METHOD_FLOW_MODIFY] = { _handle_flow_mod, SCHED_CLASS_LIFECYCLE },
+	[METHOD_FLOW_DELETE] = { _handle_flow_mod, SCHED_CLASS_LIFECYCLE },
+
+	[METHOD_SET_TUNNELS] = { _handle_set_tunnels, SCHED_CLASS_LIFECYCLE },
+
+	[METHOD_FDB_SHOW] = { _handle_fdb_show, SCHED_CLASS_READ },
+};
+
+static int _handle_queued(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg);
+
 static struct ubus_method ubus_methods[__METHODS_MAX] = {
 	// device handler interface
-	[METHOD_CREATE] = UBUS_METHOD("create", _handle_create, create_policy),
-	[METHOD_CONFIG_INIT] = UBUS_METHOD_NOARG("configure", _handle_configure),
-	[METHOD_RELOAD] = UBUS_METHOD("reload", _handle_reload, create_policy),
-	[METHOD_DUMP_INFO] = UBUS_METHOD("dump_info", _handle_dump_info,
+	[METHOD_CREATE] = UBUS_METHOD("create", _handle_queued, create_policy),
+	[METHOD_CONFIG_INIT] = UBUS_METHOD("configure", _handle_queued,
+		configure_policy),
+	[METHOD_RELOAD] = UBUS_METHOD("reload", _handle_queued, create_policy),
+	[METHOD_DUMP_INFO] = UBUS_METHOD("dump_info", _handle_queued,
 		dump_info_policy),
-	[METHOD_DUMP_STATS] = UBUS_METHOD_NOARG("dump_stats", _handle_dump_stats),
-	[METHOD_CHECK_STATE] = UBUS_METHOD("check_state", _handle_check_state,
+	[METHOD_DUMP_ALL] = UBUS_METHOD_NOARG("dump_all", _handle_queued),
+	[METHOD_DUMP_STATS] = UBUS_METHOD_NOARG("dump_stats", _handle_queued),
+	[METHOD_CHECK_STATE] = UBUS_METHOD("check_state", _handle_queued,
 			check_state_policy),
-	[METHOD_FREE] = UBUS_METHOD("free", _handle_free, delete_policy),
+	[METHOD_FREE] = UBUS_METHOD("free", _handle_queued, delete_policy),
 
 	// hotplug ops
-	[METHOD_HOTPLUG_ADD] = UBUS_METHOD("add", _handle_hotplug_add,
+	[METHOD_HOTPLUG_ADD] = UBUS_METHOD("add", _handle_queued,
 		hotplug_add_policy),
-	[METHOD_HOTPLUG_REMOVE] = UBUS_METHOD("remove", _handle_hotplug_remove,
+	[METHOD_HOTPLUG_REMOVE] = UBUS_METHOD("remove", _handle_queued,
 		hotplug_del_policy),
-	[METHOD_HOTPLUG_PREPARE] = UBUS_METHOD("prepare", _handle_hotplug_prepare,
+	[METHOD_HOTPLUG_PREPARE] = UBUS_METHOD("prepare", _handle_queued,
 		hotplug_prep_policy),
+
+	// OpenFlow programming
+	[METHOD_FLOW_ADD] = UBUS_METHOD("flow_add", _handle_queued,
+		flow_mod_policy),
+	[METHOD_FLOW_MODIFY] = UBUS_METHOD("flow_modify", _handle_queued,
+		flow_mod_policy),
+	[METHOD_FLOW_DELETE] = UBUS_METHOD("flow_delete", _handle_queued,
+		flow_mod_policy),
+
+	// overlay tunnels
+	[METHOD_SET_TUNNELS] = UBUS_METHOD("set_tunnels", _handle_queued,
+		tunnel_policy),
+
+	// port counters
+	[METHOD_PORT_RATES] = UBUS_METHOD("port_rates", _handle_port_rates,
+		rates_policy),
+
+	// MAC learning table
+	[METHOD_FDB_SHOW] = UBUS_METHOD("fdb_show", _handle_queued, fdb_policy),
+
+	// daemon introspection
+	[METHOD_STATUS] = UBUS_METHOD_NOARG("status", _handle_status),
+	[METHOD_SLOW_LOG] = UBUS_METHOD("slow_log", _handle_slow_log,
+		slow_log_policy),
+	[METHOD_SET_LOG_LEVEL] = UBUS_METHOD("set_log_level", _handle_set_log_level,
+		log_level_policy),
+	[METHOD_HOT_RESTART] = UBUS_METHOD_NOARG("hot_restart",
+		_handle_hot_restart),
 };
 
+/* Put a request into the queue of its class. The reply is sent once the
+ * scheduler gets to it. If the queue is full, the caller is told right away.
+ */
+static int
+_handle_queued(struct ubus_context *ctx, struct ubus_object *obj,
+	struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+	int ret;
+
+	for (int i = 0; i < __METHODS_MAX; i++) {
+		if (!queued_methods[i].handler || strcmp(ubus_methods[i].name, method))
+			continue;
+
+		ret = ovsd_sched_submit(obj, req, method, msg, queued_methods[i].cls,
+			queued_methods[i].handler, queued_methods[i].batch);
+		if (!ret)
+			return 0;
+
+		ovsd_log_msg(L_WARNING, "%s: %s\n", method, ovs_strerror(ret));
+		_send_errormsg(req, ovs_strerror(ret));
+		return _ovs_error_to_ubus_error(ret);
+	}
+
+	return UBUS_STATUS_METHOD_NOT_FOUND;
+}
+
 static struct ubus_object_type ovsd_obj_type =
 	UBUS_OBJECT_TYPE("ovsd", ubus_methods);
 
@@ -16,5 +16,6 @@
 
 
 int ovsd_ubus_init(const char *path);
+void ovsd_ubus_done(void);
 
 #endif